@@ -12,6 +12,8 @@
 #ifndef _DATA_WRITER_HH
 #define _DATA_WRITER_HH
 
+#include <string>
+#include <vector>
 #include <boost/noncopyable.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include "types.hh"
@@ -21,6 +23,20 @@ namespace jill {
 
 using timestamp_t = boost::posix_time::ptime;
 
+/** Reasons why data may be missing from a channel */
+enum gap_cause_t {
+        SHED = 0,               // dropped to relieve backpressure on the writer
+        OVERRUN = 1,            // didn't fit in a full buffer
+        INACTIVE = 2,           // not recorded because the channel was quiet
+};
+
+/** A log message from another client */
+struct log_message_t {
+        timestamp_t time;
+        std::string source;
+        std::string message;
+};
+
 /**
  * ABC for classes that write (or otherwise consume) multichannel sampled and
  * event data.
@@ -33,7 +49,8 @@ using timestamp_t = boost::posix_time::ptime;
  * close_entry() at appropriate points in the data stream.
  *
  * The log() and xrun() methods are provided for callers to store messages or
- * indications that the data may have gaps.
+ * indications that the data may have gaps. If the caller knows exactly which
+ * frames are missing, it should report them with gap().
  */
 class data_writer : boost::noncopyable {
 
@@ -73,6 +90,29 @@ public:
          */
         virtual void write(data_block_t const * data, nframes_t start, nframes_t stop) = 0;
 
+        /**
+         * Record that data are missing from a channel. Gaps may be reported
+         * before or after the data around them are written. May be a noop.
+         *
+         * @param id      the id (channel) of the missing data
+         * @param frame   the first missing frame
+         * @param nframes the number of missing frames
+         * @param cause   the reason the data are missing
+         */
+        virtual void gap(std::string const & id, nframes_t frame, nframes_t nframes,
+                         gap_cause_t cause) {}
+
+        /**
+         * Record that the current entry holds a recorded segment (e.g. from
+         * a trigger onset to the end of the posttrigger period). Entries may
+         * hold more than one segment, in which case the frames between them
+         * are reported as gaps. May be a noop.
+         *
+         * @param onset   the first frame of the segment
+         * @param offset  the frame after the end of the segment
+         */
+        virtual void segment(nframes_t onset, nframes_t offset) {}
+
         /**
          * Write a log message to the file. May be a noop.
          *
@@ -85,6 +125,16 @@ public:
                          std::string source,
                          std::string message) {}
 
+        /**
+         * Write a batch of log messages. The default implementation calls
+         * log() for each one; writers that can store several messages at once
+         * should override this.
+         */
+        virtual void log_messages(std::vector<log_message_t> const & messages) {
+                for (auto const & m : messages)
+                        log(m.time, m.source, m.message);
+        }
+
         /**
          * Request data to be flushed to disk. Implementing classes must flush data
          * to disk on cleanup or at appropriate intervals, but this function is
@@ -92,6 +142,16 @@ public:
          */
         virtual void flush() {}
 
+        /**
+         * Do some of the work of creating the next entry ahead of time, so
+         * that new_entry() returns quickly. Callers should call this when
+         * there's no data waiting to be written. Implementations should only do
+         * a small amount of work in each call.
+         *
+         * @return true if there's more work to do
+         */
+        virtual bool prepare_entry() { return false; }
+
 };
 
 }
@@ -67,6 +67,16 @@ block_ringbuffer::peek() const
         return ptr;
 }
 
+data_block_t const *
+block_ringbuffer::peek_next(data_block_t const * block) const
+{
+        // the storage is mirrored, so blocks are contiguous past the end
+        std::size_t offset = reinterpret_cast<char const *>(block) - (buffer() + read_offset())
+                + block->size();
+        if (offset < _read_ahead_ptr)
+                return reinterpret_cast<data_block_t const *>(buffer() + read_offset() + offset);
+        return nullptr;
+}
 
 void
 block_ringbuffer::release()
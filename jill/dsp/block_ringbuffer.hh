@@ -103,6 +103,15 @@ public:
          */
         data_block_t const * peek() const;
 
+        /**
+         * Access the blocks between the tail and the read-ahead pointer.
+         * Returns a pointer to the block after @a block, or NULL if that block
+         * hasn't been returned by peek_ahead().
+         *
+         * @param block  a block returned by peek() or peek_next()
+         */
+        data_block_t const * peek_next(data_block_t const * block) const;
+
         /**
          * Release the oldest block in the read queue, making the memory
          * available to the write thread and advancing the read pointer
@@ -12,49 +12,186 @@
 #ifndef _BUFFERED_DATA_WRITER_HH
 #define _BUFFERED_DATA_WRITER_HH
 
+#include <chrono>
 #include <memory>
 #include <iosfwd>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <cstring>
+#include <vector>
 #include "../data_thread.hh"
 #include "../data_writer.hh"
+#include "../logging.hh"
+#include "../util/thread_config.hh"
+#include "block_ringbuffer.hh"
+#include "log_receiver.hh"
+#include "ringbuffer.hh"
+
+/*
+ * # Notes on buffered data_thread objects
+ *
+ * Wait-free functions are provided to the producer thread by using a
+ * ringbuffer. The consumer thread pulls data off the ringbuffer and passes it
+ * to the data_writer object. If there's no data in the ringbuffer, the consumer
+ * writes any queued log messages and, if the flush policy calls for it, requests
+ * the writer to flush data to disk. It also gives the writer a chance to
+ * prepare the next entry, so that opening it later is quick. It then waits for
+ * a condition variable that's flagged when the consumer calls push().
+ *
+ * Log messages from other clients are received and parsed by a log_receiver,
+ * which runs its own thread. The consumer collects them in batches so that
+ * receiving messages doesn't compete with writing data. Messages are written
+ * whenever the ringbuffer is empty, or sooner if a full batch is waiting, so
+ * they don't pile up while the consumer is busy.
+ *
+ * Flushing data to disk can be expensive (for ARF files, it entails writing
+ * HDF5 metadata), so it's governed by a policy rather than done every time the
+ * ringbuffer is empty. The consumer flushes once a set amount of data has
+ * passed through the buffer, or when the ringbuffer is empty and a set time has
+ * elapsed since the last flush. While the ringbuffer is empty, it waits for the
+ * condition variable only until that deadline. With neither limit set, data are
+ * flushed only when the writer closes an entry and when the thread exits.
+ *
+ * Any thread may signal the consumer thread to start a new entry or to mark the
+ * current entry with an xrun indicator by calling reset() or xrun(). These
+ * functions use gcc atomic primitives to update the _reset_pending and _xrun
+ * flags. Resets are latched by the producer thread to the time of the next
+ * period of sampled data pushed to the buffer, and the frame is passed to the
+ * consumer through a small queue (_resets), so that the entry boundary falls
+ * at the same frame regardless of how far behind the consumer is, even if it
+ * hasn't handled the previous reset yet. This keeps entries aligned when
+ * several writers are fed by the same process loop.
+ *
+ * Channels can be assigned priorities to control which data are dropped when
+ * the consumer falls behind. Each channel below max_priority is shed (i.e.,
+ * not stored in the ringbuffer) when the free space in the ringbuffer drops
+ * below a level that decreases with priority, and restored once the free space
+ * recovers. For each block that is shed, the producer thread passes a record of
+ * the missing frames to the consumer through a second ringbuffer. Because the
+ * consumer usually lags behind the producer, it drains these records and hands
+ * them to the data_writer via gap() before it reaches the data around them.
+ * Blocks that don't fit in a full ringbuffer are reported the same way, and the
+ * total number of frames dropped from each channel is counted. Channel state
+ * is kept in a preallocated table so that push() remains wait-free. Only if a
+ * gap can't be recorded (because the channel table or the gap ringbuffer is
+ * full) does push() fall back to flagging an xrun.
+ *
+ * Similarly, calls to stop() atomically update the _state variable so that
+ * calls to push() no longer add data to the ringbuffer and so that the consumer
+ * thread exits when the ringbuffer is fully flushed.
+ */
 
 namespace jill {
 
 namespace dsp {
 
-class block_ringbuffer;
-
 /**
  * An implementation of the data thread that uses a ringbuffer to move data
  * between the push() function and a writer thread.  The logic for actually
  * storing the data (and log messages) is provided through an owned data_writer.
  * This implementation records continuously, though other threads may call
  * reset() to split data into separate entries.
+ *
+ * The type of the data_writer is a template parameter. With the default
+ * (jill::data_writer), the sink is selected at runtime and every call to it is
+ * virtual. Instantiating the template with a concrete (final) writer type binds
+ * the sink at compile time, so that the calls in the writer thread can be
+ * inlined. Use the buffered_data_writer alias for the polymorphic form.
  */
-class buffered_data_writer : public data_thread {
+template <typename Writer>
+class basic_buffered_data_writer : public data_thread {
 
 public:
+        using writer_type = Writer;
+
+        /** channels with this priority (the default) are never shed */
+        static const int max_priority = 9;
+        /** maximum number of channels with individual priorities and gap tracking */
+        static const std::size_t max_channels = 1024;
+
         /**
          * Initialize buffered writer
          *
          * @param writer       the sink for the data
          * @param buffer_size  the initial size of the ringbuffer (in bytes)
          */
-        buffered_data_writer(std::unique_ptr<data_writer> writer, std::size_t buffer_size=4096);
-        ~buffered_data_writer() override;
+        basic_buffered_data_writer(std::unique_ptr<writer_type> writer, std::size_t buffer_size=4096)
+                : _state(Stopped), _reset_frame(0),
+                  _writer(std::move(writer)),
+                  _buffer(new block_ringbuffer(buffer_size)),
+                  _xrun(false), _reset_pending(false), _resets(max_resets),
+                  _shed_threshold(0.5), _channels(max_channels), _nchannels(0),
+                  _gaps(max_gaps), _channel_idx(0),
+                  _flush_interval(1000), _flush_bytes(0), _unflushed(0),
+                  _messages() {
+                DBG << "buffered_data_writer initializing";
+        }
+
+        ~basic_buffered_data_writer() override {
+                DBG << "buffered_data_writer closing";
+                // need to make sure synchrons are not in use
+                stop();                 // no more new data; exit writer thread
+                join();                 // wait for writer thread to exit
+        }
 
         /* implementations of data_thread methods */
 
         void push(nframes_t time, dtype_t dtype, char const * id,
-                  std::size_t size, void const * data) override;
-        void data_ready() override;
-        void xrun() override;
-        void reset() override;
-        void stop() override;
-        void start() override;
-        void join() override;
+                  std::size_t size, void const * data) override {
+                if (_state != Stopping) {
+                        if (dtype == SAMPLED && _reset_pending &&
+                            __sync_bool_compare_and_swap(&_reset_pending, true, false)) {
+                                if (_resets.push(time) == 0)
+                                        xrun();
+                        }
+                        channel_t * chan = channel(id);
+                        if (chan && shed(*chan, time, dtype, size))
+                                return;
+                        if (_buffer->push(time, dtype, id, size, data) == 0) {
+                                if (chan)
+                                        push_gap(*chan, time, block_frames(dtype, size), OVERRUN);
+                                xrun();
+                        }
+                }
+        }
+
+        void data_ready() override {
+                _ready.notify_one();
+        }
+
+        void xrun() override {
+                // don't generate log message here
+                __sync_bool_compare_and_swap(&_xrun, false, true);
+        }
+
+        void reset() override {
+                if (_state == Running)
+                        __sync_bool_compare_and_swap(&_reset_pending, false, true);
+        }
+
+        void stop() override {
+                // release condition variable to prevent deadlock
+                if (__sync_bool_compare_and_swap(&_state, Running, Stopping))
+                        data_ready();
+        }
+
+        void start() override {
+                if (_state == Stopped) {
+                        _xrun = _reset_pending = false;
+                        _resets.pop(static_cast<nframes_t *>(nullptr));
+                        _state = Running;
+                        _thread = std::thread(&basic_buffered_data_writer::thread, this);
+                }
+                else {
+                        throw std::runtime_error("Tried to start already running writer thread");
+                }
+        }
+
+        void join() override {
+                if (_thread.joinable())
+                        _thread.join();
+        }
 
         /**
          * Resize the ringbuffer. Only takes effect if the new size is larger
@@ -65,11 +202,72 @@ public:
          * only be called when data are no longer being added to the buffer
          * (i.e. in resize_buffer callback)
          */
-        std::size_t request_buffer_size(std::size_t bytes) override;
+        std::size_t request_buffer_size(std::size_t bytes) override {
+                // block until the buffer is empty
+                std::lock_guard<std::mutex> lck(_lock);
+                if (bytes > _buffer->size()) {
+                        _buffer->resize(bytes);
+                }
+                return _buffer->size();
+        }
+
+        /**
+         * Set the priority of a channel. Channels with lower priority are
+         * dropped first when the ringbuffer starts to fill up. Must be called
+         * before start().
+         *
+         * @param id        the id of the channel
+         * @param priority  0 (lowest) to max_priority (never dropped; default)
+         */
+        void set_priority(std::string const & id, int priority) {
+                channel_t * chan = channel(id.c_str());
+                if (chan) chan->priority = std::max(0, std::min(priority, max_priority));
+        }
+
+        /**
+         * Set the free space in the ringbuffer (as a fraction of its size)
+         * below which channels with priority 0 are shed. Channels with higher
+         * priority are shed at proportionally lower levels.
+         */
+        void set_shed_threshold(float fraction) {
+                _shed_threshold = std::max(0.0f, std::min(fraction, 1.0f));
+        }
+
+        /**
+         * Set how often data are flushed to disk. Call before start().
+         *
+         * @param interval_ms  flush when the buffer is empty and this many ms
+         *                     have elapsed since the last flush (0 to disable)
+         * @param bytes        flush after this many bytes have passed through the
+         *                     buffer, even if it's not empty (0 to disable)
+         */
+        void set_flush_policy(unsigned int interval_ms, std::size_t bytes) {
+                _flush_interval = std::chrono::milliseconds(interval_ms);
+                _flush_bytes = bytes;
+        }
+
+        /**
+         * @return the total number of frames from a channel that have been
+         * dropped because they were shed or didn't fit in the ringbuffer. Safe
+         * to call from any thread.
+         */
+        std::uint64_t dropped_frames(std::string const & id) {
+                std::size_t n = __sync_fetch_and_add(&_nchannels, 0);
+                for (std::size_t i = 0; i < n; ++i) {
+                        if (id.compare(0, sizeof(channel_t::id) - 1, _channels[i].id) == 0)
+                                return __sync_fetch_and_add(&_channels[i].dropped, 0);
+                }
+                return 0;
+        }
+
+        /** @return the number of bytes waiting in the ringbuffer */
+        std::size_t buffer_occupancy() const {
+                return _buffer->read_space();
+        }
 
         /**
          * Bind the logger to a zeromq socket. Messages may be sent to this
-         * socket by other programs.
+         * socket by other programs. They are received on a separate thread.
          *
          * @param server_name  the name of the jack server. All the clients of
          *                     the server must log to the same socket.
@@ -77,7 +275,14 @@ public:
          * @note once binding is successful, subsequent calls to this function
          *       do nothing.
          */
-        void bind_logger(std::string const & server_name);
+        void bind_logger(std::string const & server_name) {
+                if (_logger) {
+                        DBG << "already bound to " << server_name;
+                        return;
+                }
+                _logger.reset(new log_receiver(server_name));
+                if (!_logger->bound()) _logger.reset();
+        }
 
 protected:
         /**
@@ -89,34 +294,273 @@ protected:
          * @param data   the header and data for the period. may be null if
          *               there's no data
          */
-        virtual void write(data_block_t const * data);
+        virtual void write(data_block_t const * data) {
+                // close the entry at the first block at or after the reset frame
+                if (take_reset(data->time))
+                        _writer->close_entry();
+                _writer->write(data, 0, 0);
+                _buffer->release();
+        }
+
+        /**
+         * Called when the writer thread is about to exit, before the writer's
+         * entry is closed. Deriving classes that hold blocks in the ringbuffer
+         * (i.e., read ahead of the tail) can write them here, and classes with
+         * additional writers can close them. The default discards held blocks.
+         */
+        virtual void drain() {}
+
+        /**
+         * Give a record of missing data to the writer. Deriving classes with
+         * more than one writer can override this to route it.
+         */
+        virtual void write_gap(char const * id, nframes_t start, nframes_t nframes,
+                               gap_cause_t cause) {
+                _writer->gap(id, start, nframes, cause);
+        }
+
+        /** Notify the writer of an xrun */
+        virtual void write_xrun() {
+                _writer->xrun();
+        }
+
+        /** Flush the writer to disk */
+        virtual void flush_writer() {
+                _writer->flush();
+        }
+
+        /** Let the writer prepare the next entry. @return true if there's more to do */
+        virtual bool prepare_writer() {
+                return _writer->prepare_entry();
+        }
+
+        /**
+         * Check for resets latched at or before a frame. If there are any,
+         * they're removed from the queue, the frame of the last one is stored
+         * in _reset_frame, and true is returned. Call from the writer thread.
+         */
+        bool take_reset(nframes_t time) {
+                bool ret = false;
+                while (_resets.read_space() > 0) {
+                        nframes_t frame = _resets.buffer()[_resets.read_offset()];
+                        if (framediff_t(time - frame) < 0) break;
+                        _resets.pop(&_reset_frame, 1);
+                        ret = true;
+                }
+                return ret;
+        }
 
         /**
-         * Collect log messages from the zmq socket and write them. Call this
-         * when load is low.
+         * Write any log messages collected by the log receiver. Call this when
+         * load is low or when a batch is waiting.
          */
-        void write_messages();
+        void write_messages() {
+                if (!_logger || _logger->pop(_messages) == 0) return;
+                _writer->log_messages(_messages);
+                for (auto const & m : _messages)
+                        _unflushed += m.message.size();
+        }
 
         state_t _state;                            // thread state
-        bool _reset;                               // flag to reset stream
+        nframes_t _reset_frame;                    // first frame after the last reset
 
-        std::unique_ptr<data_writer> _writer;            // output
+        std::unique_ptr<writer_type> _writer;            // output
         std::unique_ptr<block_ringbuffer> _buffer;      // ringbuffer
 
 private:
-        void thread();                              // the writer thread
+        /* storage for channel state used in push() */
+        struct channel_t {
+                char id[48];
+                int priority;
+                bool shedding;          // currently dropping data
+                std::uint64_t dropped;  // total frames dropped
+        };
+
+        /* record of dropped data passed to the writer thread */
+        struct gap_t {
+                char id[48];
+                nframes_t start;
+                nframes_t nframes;
+                gap_cause_t cause;
+                std::uint32_t pad;      // ringbuffer needs power-of-two sized records
+        };
+        static_assert(sizeof(gap_t) == 64, "gap_t must be a power of two in size");
+        static const std::size_t max_gaps = 4096;
+        static const std::size_t max_resets = 64;
+        /* write messages while busy once this many are waiting */
+        static const std::size_t log_batch_size = 64;
+
+        /*
+         * look up a channel by id, adding it if necessary. Channels are usually
+         * pushed in the same order every period, so start at the one after the
+         * last match. Returns nullptr if there's no room in the table.
+         */
+        channel_t * channel(char const * id) {
+                std::size_t n = _nchannels;
+                for (std::size_t i = 0; i < n; ++i) {
+                        std::size_t idx = (_channel_idx + i) % n;
+                        if (strncmp(_channels[idx].id, id, sizeof(channel_t::id) - 1) == 0) {
+                                _channel_idx = idx + 1;
+                                return &_channels[idx];
+                        }
+                }
+                if (n == max_channels) return nullptr;
+                channel_t & chan = _channels[n];
+                strncpy(chan.id, id, sizeof(chan.id) - 1);
+                chan.id[sizeof(chan.id) - 1] = '\0';
+                chan.priority = max_priority;
+                chan.shedding = false;
+                chan.dropped = 0;
+                // publish the entry to other threads only once it's filled in
+                __sync_add_and_fetch(&_nchannels, 1);
+                return &chan;
+        }
+
+        /* number of frames in a block pushed by the producer */
+        static nframes_t block_frames(dtype_t dtype, std::size_t size) {
+                return (dtype == SAMPLED) ? size / sizeof(sample_t) : 1;
+        }
+
+        /* count dropped data and pass a record of it to the writer thread */
+        void push_gap(channel_t & chan, nframes_t time, nframes_t nframes, gap_cause_t cause) {
+                __sync_add_and_fetch(&chan.dropped, nframes);
+                gap_t gap;
+                memcpy(gap.id, chan.id, sizeof(gap.id));
+                gap.start = time;
+                gap.nframes = nframes;
+                gap.cause = cause;
+                gap.pad = 0;
+                if (_gaps.push(gap) == 0)
+                        xrun();
+        }
+
+        /* decide whether to drop a block to relieve backpressure */
+        bool shed(channel_t & chan, nframes_t time, dtype_t dtype, std::size_t size) {
+                if (chan.priority >= max_priority) return false;
+                float free = float(_buffer->write_space()) / _buffer->size();
+                float level = _shed_threshold * (max_priority - chan.priority) / max_priority;
+                // hysteresis keeps channels from flapping near the threshold
+                if (chan.shedding && free > std::min(2 * level, (1 + level) / 2))
+                        chan.shedding = false;
+                else if (!chan.shedding && free < level)
+                        chan.shedding = true;
+                if (!chan.shedding)
+                        return false;
+                push_gap(chan, time, block_frames(dtype, size), SHED);
+                return true;
+        }
+
+        /* give gap records to the writer */
+        void write_gaps() {
+                _gaps.pop([this](gap_t const * gaps, std::size_t count) {
+                                for (std::size_t i = 0; i < count; ++i)
+                                        write_gap(gaps[i].id, gaps[i].start, gaps[i].nframes,
+                                                  gaps[i].cause);
+                                return count;
+                        });
+        }
+
+        /* flush the writer and reset the policy counters */
+        void flush() {
+                flush_writer();
+                _unflushed = 0;
+                _last_flush = std::chrono::steady_clock::now();
+        }
+
+        /* the writer thread */
+        void thread() {
+                data_block_t const * hdr;
+
+                util::configure_thread("disk writer");
+                std::unique_lock<std::mutex> lck(_lock);
+                DBG << "started writer thread";
+                _last_flush = std::chrono::steady_clock::now();
+
+                while (true) {
+                        if (__sync_bool_compare_and_swap(&_xrun, true, false)) {
+                                write_xrun();
+                        }
+                        if (_gaps.read_space()) {
+                                write_gaps();
+                        }
+                        hdr = _buffer->peek_ahead();
+                        if (!hdr) {
+                                write_messages();
+                                /* if ringbuffer empty and Stopping, exit loop */
+                                if (_state == Stopping) {
+                                        break;
+                                }
+                                /* prepare the next entry a step at a time,
+                                 * checking for data in between */
+                                if (prepare_writer()) {
+                                        continue;
+                                }
+                                /* otherwise wait for more data or the flush deadline */
+                                auto ready = [this]{ return(_state == Stopping || _buffer->peek()); };
+                                if (_unflushed == 0 || _flush_interval.count() == 0) {
+                                        _ready.wait(lck, ready);
+                                }
+                                else if (!_ready.wait_until(lck, _last_flush + _flush_interval, ready)) {
+                                        flush();
+                                }
+                        }
+                        else {
+                                if (_logger && _logger->size() >= log_batch_size)
+                                        write_messages();
+                                _unflushed += hdr->size();
+                                write(hdr);
+                                if (_flush_bytes && _unflushed >= _flush_bytes)
+                                        flush();
+                        }
+                }
+                // an xrun may have been flagged as the thread was stopping
+                if (__sync_bool_compare_and_swap(&_xrun, true, false)) {
+                        write_xrun();
+                }
+                drain();
+                _writer->close_entry();
+                flush_writer();
+                for (std::size_t i = 0; i < _nchannels; ++i) {
+                        if (_channels[i].dropped)
+                                LOG << "dropped " << _channels[i].dropped << " frames from "
+                                    << _channels[i].id;
+                }
+                _state = Stopped;
+                DBG << "exited writer thread";
+        }
 
         std::thread _thread;
         std::mutex _lock;                           // mutex for condition variable
         std::condition_variable _ready;             // indicates data ready
 
         bool _xrun;                                // flag to indicate xrun
-        // variables for receiving incoming messages
-        void * _socket;
-        bool _logger_bound;
+        bool _reset_pending;                       // reset requested, not yet latched
+        ringbuffer<nframes_t> _resets;             // frames of latched resets
+        float _shed_threshold;                     // free space to start shedding
+        std::vector<channel_t> _channels;          // per-channel state, preallocated
+        std::size_t _nchannels;                    // entries in use in _channels
+        ringbuffer<gap_t> _gaps;                   // dropped data records
+        std::size_t _channel_idx;                  // where to start channel lookup
+        std::chrono::milliseconds _flush_interval; // max time between flushes when idle
+        std::size_t _flush_bytes;                  // max data between flushes
+        std::size_t _unflushed;                    // data since last flush
+        std::chrono::steady_clock::time_point _last_flush;
+        std::unique_ptr<log_receiver> _logger;      // receives incoming messages
+        std::vector<log_message_t> _messages;       // batch of messages to write
 
 };
 
+template <typename Writer> const int basic_buffered_data_writer<Writer>::max_priority;
+template <typename Writer> const std::size_t basic_buffered_data_writer<Writer>::max_channels;
+template <typename Writer> const std::size_t basic_buffered_data_writer<Writer>::max_gaps;
+template <typename Writer> const std::size_t basic_buffered_data_writer<Writer>::max_resets;
+template <typename Writer> const std::size_t basic_buffered_data_writer<Writer>::log_batch_size;
+
+/** buffered writer with a runtime-polymorphic sink */
+using buffered_data_writer = basic_buffered_data_writer<data_writer>;
+
+extern template class basic_buffered_data_writer<data_writer>;
+
 }} // jill::file
 
 #endif
@@ -11,9 +11,13 @@
 #ifndef _COUNTER_HH
 #define _COUNTER_HH
 
-#include <iosfwd>
+#include <array>
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 #include <boost/noncopyable.hpp>
-#include <boost/circular_buffer.hpp>
 
 namespace jill { namespace dsp {
 
@@ -24,25 +28,47 @@ namespace jill { namespace dsp {
  * This class is a simple queue-based running counter. The queue has a
  * fixed size and data are pushed onto the queue one by one. The
  * running sum of the values in the queue is maintained by adding the
- * new value and subtracting the last value in the queue, which is
+ * new value and subtracting the oldest value in the queue, which is
  * then dropped. A comparison is made between the running total and a
  * threshold.
+ *
+ * The queue is stored in a ring whose size is a power of two, so the
+ * positions are found by masking, and slots that haven't been filled yet
+ * hold zero, so push() doesn't have to check whether the queue is full. The
+ * size of the window can be given as a template parameter, in which case
+ * the ring is stored in the object and the window size is a constant;
+ * otherwise (Size = 0) it's set in the constructor.
  */
-template <class T>
+template <class T, std::size_t Size = 0>
 class running_counter : boost::noncopyable {
 
+        /// the smallest power of two that holds n values
+        static constexpr std::size_t ring_size(std::size_t n) {
+                return (n <= 1) ? 1 : 2 * ring_size((n + 1) / 2);
+        }
+
         /// the storage type
-        using storage_type = boost::circular_buffer<T>;
+        using storage_type = typename std::conditional<Size == 0, std::vector<T>,
+                                                       std::array<T, ring_size(Size)> >::type;
 
 public:
 	/** the data type stored in the counter */
 	using data_type = T;
 	/** the data type for size information */
-        using size_type = typename storage_type::size_type;
+        using size_type = std::size_t;
 
-	/** Initialize the counter. @param size  the size of the running sum window */
-	explicit running_counter(size_type size)
-		: _counts(size), _running_count(0) {}
+	/**
+	 * Initialize the counter.
+	 *
+	 * @param size  the size of the running sum window. Must be at least 1,
+	 *              and equal to Size if that's not zero.
+	 */
+	explicit running_counter(size_type size = Size)
+		: _capacity(size), _mask(ring_size(size) - 1), _npushed(0), _running_count(0) {
+		if (size == 0 || (Size != 0 && size != Size))
+			throw std::invalid_argument("invalid size for running counter");
+		allocate(_counts, ring_size(size));
+	}
 
 	/**
 	 * Add a value to the queue.  If the queue is full, the value at the end
@@ -51,36 +77,52 @@ public:
 	 * @param count          the value to add
 	 */
 	void push(data_type count) {
-                if (_counts.full()) {
-                        _running_count -= _counts.front();
-                }
-                _counts.push_back(count);
-		_running_count += count;
+		// the value pushed capacity() pushes ago, or zero if the queue isn't full
+		data_type const oldest = _counts[(_npushed - capacity()) & mask()];
+		_counts[_npushed & mask()] = count;
+		_running_count += count - oldest;
+		++_npushed;
 	}
 
 	/** Whether the queue is full or not */
-	bool full() const { return _counts.full(); }
+	bool full() const { return _npushed >= capacity(); }
+
+	/** The size of the running sum window */
+	size_type capacity() const { return Size ? Size : _capacity; }
 
 	/** @return the running total */
 	data_type running_count() const { return _running_count; }
 
 	/** reset the counter */
 	void reset() {
-		_counts.clear();
+		std::fill(_counts.begin(), _counts.end(), data_type());
+		_npushed = 0;
 		_running_count = 0;
 	}
 
         /** output the state of the queue to a stream */
-	friend std::ostream& operator<< (std::ostream &os, const running_counter<T> &o) {
-                std::ostream_iterator<data_type> out(os," ");
-		os << o._running_count << " [" << o._counts.size() << '/' << o._counts.capacity() << "] (";
-                std::copy(o._counts.begin(), o._counts.end(), out);
+	friend std::ostream& operator<< (std::ostream &os, const running_counter &o) {
+                size_type n = std::min(o._npushed, o.capacity());
+		os << o._running_count << " [" << n << '/' << o.capacity() << "] (";
+                for (size_type i = o._npushed - n; i != o._npushed; ++i)
+                        os << o._counts[i & o.mask()] << ' ';
 		return os << ')';
 	}
 
 private:
-	/// count of samples in complete blocks
+        size_type mask() const { return Size ? ring_size(Size) - 1 : _mask; }
+
+        static void allocate(std::vector<T> & counts, size_type n) { counts.assign(n, data_type()); }
+        template <std::size_t N>
+        static void allocate(std::array<T, N> & counts, size_type) { counts.fill(data_type()); }
+
+	/// counts in complete blocks
 	storage_type _counts;
+	/// size of the window (if not fixed)
+	size_type _capacity;
+	size_type _mask;
+	/// number of values pushed since the last reset
+	size_type _npushed;
 	/// a running count
 	data_type _running_count;
 };
@@ -12,8 +12,11 @@
 #ifndef _CROSSING_COUNTER_HH
 #define _CROSSING_COUNTER_HH
 
+#include <algorithm>
+#include <stdexcept>
 #include <boost/noncopyable.hpp>
 #include "counter.hh"
+#include "crossing_kernels.hh"
 
 namespace jill { namespace dsp {
 
@@ -23,8 +26,14 @@ namespace jill { namespace dsp {
  * Data are passed to the counter in blocks. The counter adds the number of
  * crossings in the block to a queue (@see jill::dsp::running_counter) to obtain
  * a moving sum of the counts in previous blocks.
+ *
+ * The period size and the number of periods in the window can be fixed at
+ * compile time with the PeriodSize and PeriodCount template parameters (for
+ * example, in a build for a rig with a known sampling rate), which lets the
+ * compiler unroll the period arithmetic. If these are zero, the values given
+ * to the constructor are used.
  */
-template<typename T>
+template<typename T, std::size_t PeriodSize = 0, std::size_t PeriodCount = 0>
 class crossing_counter : boost::noncopyable {
 public:
 	using sample_type = T;
@@ -32,9 +41,19 @@ public:
         using size_type = std::size_t;
 
 
-	crossing_counter(const sample_type &threshold, size_type period_size, size_type period_count)
+	/**
+	 * Initialize the counter.
+	 *
+	 * @param threshold     the sample threshold
+	 * @param period_size   the size of the analysis period (must equal PeriodSize if that's not zero)
+	 * @param period_count  the number of periods in the window (must equal PeriodCount if that's not zero)
+	 */
+	crossing_counter(const sample_type &threshold, size_type period_size = PeriodSize,
+			 size_type period_count = PeriodCount)
 		:  _counter(period_count), _thresh(threshold), _period_size(period_size),
 		   _period_crossings(0), _period_nsamples(0) {
+		if (PeriodSize != 0 && period_size != PeriodSize)
+			throw std::invalid_argument("period size doesn't match template parameter");
 		_max_crossings = period_count * _period_size / 2;
 	}
 
@@ -43,9 +62,22 @@ public:
 	 * analysis periods and the number of counts in each period pushed on to
 	 * a queue. Each time the queue is updated, the total crossing count in
 	 * the analysis window is compared against a count threshold. The return
-	 * value of the function indicates the block in which the count crossed
+	 * value of the function indicates the sample where the count crossed
 	 * this threshold.
 	 *
+	 * For a positive threshold, this is the sample in the deciding period
+	 * where the crossing that put the running count over the threshold
+	 * occurred (or the first sample of the period in this block, if the
+	 * count was already over the threshold or the crossing was in an
+	 * earlier block). A negative threshold can only be passed when a
+	 * period is dropped from the window, so the last sample of the period
+	 * is returned. The crossings in the deciding period are only rescanned
+	 * when the threshold is passed.
+	 *
+	 * The crossings are counted over as much of a period as is available
+	 * at once, using a vectorized kernel for single-precision samples (see
+	 * count_crossings()).
+	 *
 	 * @param samples      A buffer of samples to analyze
 	 * @param size         The number of samples in the buffer. Must be at least 2
 	 * @param count_thresh The count threshold. Can be negative or positive,
@@ -54,38 +86,56 @@ public:
 	 *                     to this buffer. Needs to be at least same size as samples.
 	 *                     Useful for debug.
 	 *
-	 * @returns  -1 if no crossing occurred (including calls with samples < period_size)
-	 *           N=0+ if a crossing occurred in the Nth block of data
+	 * @returns  -1 if the threshold wasn't passed (including calls with samples < period_size)
+	 *           N=0+ if the threshold was passed at the Nth sample
 	 *
 	 */
  	int push(const sample_type * samples, size_type size, count_type count_thresh, sample_type * state=0) {
-		int ret = -1, period = 0;
-		sample_type last = *samples;
+		int ret = -1;
+		sample_type const thresh = _thresh;
+		// the start of the current period in this block, and the
+		// crossings counted in earlier blocks
+		size_type start = 1;
+		count_type carried = _period_crossings;
+		// the running count only changes at the end of a period
+		sample_type level = float(_counter.running_count()) / _max_crossings;
 		if (state)
-			state[0] = float(_counter.running_count()) / _max_crossings;
-		for (size_t i = 1; i < size; ++i) {
-			// I only check positive crossings because
-			// it's faster and there's not much point in
-			// counting both for most signals
-			if (last < _thresh && samples[i] >= _thresh)
-				_period_crossings += 1;
-			last = samples[i];
-			_period_nsamples += 1;
-			if (_period_nsamples >= _period_size)
+			state[0] = level;
+		// I only check positive crossings because it's faster and
+		// there's not much point in counting both for most signals
+		size_type const period = period_size();
+		for (size_type i = 1; i < size;) {
+			size_type left = (period > _period_nsamples) ? period - _period_nsamples : 1;
+			size_type n = std::min(size - i, left);
+			_period_crossings += count_crossings(samples + i - 1, n + 1, thresh);
+			if (state)
+				std::fill(state + i, state + i + n, level);
+			_period_nsamples += n;
+			i += n;
+			if (_period_nsamples >= period)
 			{
 				_counter.push(_period_crossings);
 				if (_counter.full() && ret < 0) {
-					if (count_thresh > 0 && _counter.running_count() > count_thresh)
-						ret = period;
+					if (count_thresh > 0 && _counter.running_count() > count_thresh) {
+						// crossings needed in this block to pass the threshold
+						count_type base = _counter.running_count() - _period_crossings;
+						count_type needed = count_thresh + 1 - base - carried;
+						ret = start;
+						if (needed > 0)
+							ret += std::min(find_crossing(samples + start - 1, i - start + 1,
+										      thresh, needed), i - start) - 1;
+					}
 					else if (count_thresh < 0 && _counter.running_count() < -count_thresh)
-						ret = period;
+						ret = i - 1;
 				} // if (ret < 0)
-				period += 1;
+				start = i;
+				carried = 0;
 				_period_nsamples = 0;
 				_period_crossings = 0;
+				level = float(_counter.running_count()) / _max_crossings;
+				if (state)
+					state[i - 1] = level;
 			}
-			if (state)
-				state[i] = float(_counter.running_count()) / _max_crossings;
 			// here, ret should be the period in blocks or -1 if no crossing
 		}
 		return ret;
@@ -101,20 +151,18 @@ public:
 		_period_nsamples = 0;
 	}
         /** @return the size of the analysis period (in samples) */
-	size_type period_size() const { return _period_size; }
+	size_type period_size() const { return PeriodSize ? PeriodSize : _period_size; }
         /** @return current value of the threshold. */
         sample_type thresh() const { return _thresh;}
 
 private:
         /// running count of crossings
-        running_counter<count_type> _counter;
+        running_counter<count_type, PeriodCount> _counter;
 
 	/// sample threshold
 	volatile sample_type _thresh;
 	/// analysis period size
 	size_type _period_size;
-	/// number of analysis periods
-	size_type _period_count;
 
 	/// count of crossings in the current period (which may span calls to push)
 	count_type _period_crossings;
@@ -0,0 +1,157 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cstring>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JILL_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#include "crossing_kernels.hh"
+
+using std::size_t;
+
+namespace {
+
+/*
+ * Each kernel compares the samples with the threshold a vector at a time,
+ * using unaligned loads offset by one sample for x[i-1] and x[i]. The
+ * comparisons are ordered, so NaNs never count as crossings, as in the scalar
+ * code. The remainder is handled by the reference implementation.
+ */
+
+size_t
+count_scalar(float const * x, size_t n, float thresh)
+{
+        return jill::dsp::count_crossings<float>(x, n, thresh);
+}
+
+#ifdef JILL_X86_KERNELS
+
+__attribute__((target("sse2")))
+size_t
+count_sse2(float const * x, size_t n, float thresh)
+{
+        size_t count = 0, i = 1;
+        __m128 const t = _mm_set1_ps(thresh);
+        for (; i + 4 <= n; i += 4) {
+                __m128 prev = _mm_loadu_ps(x + i - 1);
+                __m128 cur = _mm_loadu_ps(x + i);
+                __m128 m = _mm_and_ps(_mm_cmplt_ps(prev, t), _mm_cmpge_ps(cur, t));
+                count += __builtin_popcount(_mm_movemask_ps(m));
+        }
+        return count + count_scalar(x + i - 1, n - i + 1, thresh);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t
+count_avx2(float const * x, size_t n, float thresh)
+{
+        size_t count = 0, i = 1;
+        __m256 const t = _mm256_set1_ps(thresh);
+        for (; i + 8 <= n; i += 8) {
+                __m256 prev = _mm256_loadu_ps(x + i - 1);
+                __m256 cur = _mm256_loadu_ps(x + i);
+                __m256 m = _mm256_and_ps(_mm256_cmp_ps(prev, t, _CMP_LT_OQ),
+                                         _mm256_cmp_ps(cur, t, _CMP_GE_OQ));
+                count += __builtin_popcount(_mm256_movemask_ps(m));
+        }
+        return count + count_scalar(x + i - 1, n - i + 1, thresh);
+}
+
+__attribute__((target("avx512f,popcnt")))
+size_t
+count_avx512(float const * x, size_t n, float thresh)
+{
+        size_t count = 0, i = 1;
+        __m512 const t = _mm512_set1_ps(thresh);
+        for (; i + 16 <= n; i += 16) {
+                __mmask16 lt = _mm512_cmp_ps_mask(_mm512_loadu_ps(x + i - 1), t, _CMP_LT_OQ);
+                __mmask16 m = _mm512_mask_cmp_ps_mask(lt, _mm512_loadu_ps(x + i), t, _CMP_GE_OQ);
+                count += __builtin_popcount(m);
+        }
+        return count + count_scalar(x + i - 1, n - i + 1, thresh);
+}
+
+#endif
+
+typedef size_t (*kernel_t)(float const *, size_t, float);
+
+struct kernel_info_t {
+        char const * name;
+        kernel_t kernel;
+        bool supported;
+};
+
+kernel_info_t const *
+kernels()
+{
+#ifdef JILL_X86_KERNELS
+        // needed because this is called during static initialization
+        __builtin_cpu_init();
+#endif
+        static kernel_info_t const table[] = {
+#ifdef JILL_X86_KERNELS
+                { "avx512", count_avx512, bool(__builtin_cpu_supports("avx512f")) },
+                { "avx2", count_avx2, bool(__builtin_cpu_supports("avx2")) },
+                { "sse2", count_sse2, bool(__builtin_cpu_supports("sse2")) },
+#endif
+                { "scalar", count_scalar, true },
+                { nullptr, nullptr, false }
+        };
+        return table;
+}
+
+/* the best supported kernel, which is the first in the table */
+kernel_info_t const *
+best_kernel()
+{
+        kernel_info_t const * k = kernels();
+        while (!k->supported) ++k;
+        return k;
+}
+
+kernel_info_t const * current = best_kernel();
+
+}
+
+namespace jill { namespace dsp {
+
+size_t
+count_crossings(float const * x, size_t n, float thresh)
+{
+        return current->kernel(x, n, thresh);
+}
+
+char const *
+crossing_kernel()
+{
+        return current->name;
+}
+
+bool
+set_crossing_kernel(char const * name)
+{
+        if (strcmp(name, "auto") == 0) {
+                current = best_kernel();
+                return true;
+        }
+        for (kernel_info_t const * k = kernels(); k->name; ++k) {
+                if (strcmp(k->name, name) == 0) {
+                        if (!k->supported) return false;
+                        current = k;
+                        return true;
+                }
+        }
+        return false;
+}
+
+}}
@@ -0,0 +1,76 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _CROSSING_KERNELS_HH
+#define _CROSSING_KERNELS_HH
+
+#include <cstddef>
+
+namespace jill { namespace dsp {
+
+/**
+ * Count the positive threshold crossings in a run of samples: the number of
+ * i in [1, n) where x[i-1] < thresh and x[i] >= thresh. This is the reference
+ * implementation, which is used for types without a vectorized kernel.
+ */
+template <typename T>
+std::size_t
+count_crossings(T const * x, std::size_t n, T thresh)
+{
+        std::size_t count = 0;
+        for (std::size_t i = 1; i < n; ++i)
+                count += (x[i-1] < thresh && x[i] >= thresh);
+        return count;
+}
+
+/**
+ * Find the kth positive threshold crossing in a run of samples. This is only
+ * used to locate an event after the crossings have been counted, so there's
+ * no vectorized version.
+ *
+ * @param k  the crossing to find (starting with 1)
+ * @return the index i of the crossing (with x[i-1] < thresh <= x[i]), or n if
+ *         there are fewer than k crossings
+ */
+template <typename T>
+std::size_t
+find_crossing(T const * x, std::size_t n, T thresh, std::size_t k)
+{
+        for (std::size_t i = 1; i < n; ++i) {
+                if (x[i-1] < thresh && x[i] >= thresh && --k == 0)
+                        return i;
+        }
+        return n;
+}
+
+/**
+ * Count positive threshold crossings in single-precision samples. Uses the
+ * widest SIMD kernel the CPU supports (chosen when the library is loaded).
+ * The result is identical to the reference implementation.
+ */
+std::size_t count_crossings(float const * x, std::size_t n, float thresh);
+
+/** @return the name of the kernel used by count_crossings() */
+char const * crossing_kernel();
+
+/**
+ * Select the kernel used by count_crossings() (for testing and
+ * benchmarking). Not thread-safe.
+ *
+ * @param name  "scalar", "sse2", "avx2", "avx512", or "auto" for the best
+ *              available kernel
+ * @return false if the kernel isn't supported on this CPU
+ */
+bool set_crossing_kernel(char const * name);
+
+}}
+
+#endif
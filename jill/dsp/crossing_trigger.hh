@@ -14,6 +14,7 @@
 
 #include <vector>
 #include "crossing_counter.hh"
+#include "signal_detector.hh"
 
 namespace jill { namespace dsp {
 
@@ -25,12 +26,16 @@ namespace jill { namespace dsp {
  * different from the open threshhold) more than a certain number of times in a
  * time window the gate closes.
  *
+ * The period size and the sizes of the opening and closing windows can be
+ * fixed at compile time with the template parameters (see crossing_counter).
  */
-template <typename T>
-class crossing_trigger : boost::noncopyable {
+template <typename T, std::size_t PeriodSize = 0, std::size_t OpenPeriods = 0, std::size_t ClosePeriods = 0>
+class crossing_trigger : public signal_detector<T> {
 public:
 	using sample_type = T;
-	using size_type = typename crossing_counter<T>::size_type;
+	using open_counter_type = crossing_counter<T, PeriodSize, OpenPeriods>;
+	using close_counter_type = crossing_counter<T, PeriodSize, ClosePeriods>;
+	using size_type = typename open_counter_type::size_type;
 
 	/**
 	 * Instantiate a signal detector.
@@ -42,6 +47,8 @@ public:
 	 * @param ccount_thresh    Crossings must stay above this rate to keep gate open
 	 * @param cwindow_periods  The number of periods to analyze for closing
 	 * @param period_size      The size of the analysis period
+	 *
+	 * The window and period sizes must match the template parameters that aren't zero.
 	 */
 	crossing_trigger(const sample_type &othresh, int ocount_thresh, size_type owindow_periods,
 			    const sample_type &cthresh, int ccount_thresh, size_type cwindow_periods,
@@ -57,8 +64,10 @@ public:
 	 *  they are either pushed to the open-threshold counter or the
 	 *  close-threshold counter. If the active counter changes state, the
 	 *  gate is opened or closed, and the offset in the supplied data where
-	 *  this occurred (to the nearest period) is returned. If no state
-	 *  changed, -1 is returned.
+	 *  this occurred is returned. If no state changed, -1 is returned.
+	 *  Onsets are located at the threshold crossing that opened the gate;
+	 *  offsets at the end of the period where the gate closed (see
+	 *  crossing_counter::push).
 	 *
 	 *  @param samples    The input samples
 	 *  @param size       The number of available samples
@@ -68,11 +77,10 @@ public:
                               -1 if no state change occurred
 	 *
 	 */
-	int push(const sample_type * samples, size_type size, sample_type * counts=0) {
+	int push(const sample_type * samples, size_type size, sample_type * counts=0) override {
 		if (_open) {
-			int per = _close_counter.push(samples, size, _close_count_thresh, counts);
-			if (per > -1) {
-				int offset = per * _close_counter.period_size();
+			int offset = _close_counter.push(samples, size, _close_count_thresh, counts);
+			if (offset > -1) {
 				_open = false;
 				_close_counter.reset();
 				// push samples after offset to open counter
@@ -82,9 +90,8 @@ public:
 			}
 		}
 		else {
-			int per = _open_counter.push(samples, size, _open_count_thresh, counts);
-			if (per > -1) {
-				int offset = per * _open_counter.period_size();
+			int offset = _open_counter.push(samples, size, _open_count_thresh, counts);
+			if (offset > -1) {
 				_open = true;
 				_open_counter.reset();
 				// push samples after offset to close counter
@@ -97,7 +104,7 @@ public:
 	}
 
         /** The state of the detector */
-	bool open() const { return _open; }
+	bool open() const override { return _open; }
 
         /** The threshold for going to an open state */
 	sample_type &open_thresh() { return _open_counter.thresh(); }
@@ -108,8 +115,8 @@ public:
 private:
 
 	bool _open;
-	crossing_counter<sample_type> _open_counter;
-	crossing_counter<sample_type> _close_counter;
+	open_counter_type _open_counter;
+	close_counter_type _close_counter;
 	int _open_count_thresh;
 	int _close_count_thresh;
 };
@@ -0,0 +1,412 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _CROSSING_TRIGGER_BANK_HH
+#define _CROSSING_TRIGGER_BANK_HH
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "crossing_kernels.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * A bank of threshold-crossing detectors (see crossing_trigger) that are
+ * evaluated together. Each detector (gate) has its own input and parameters,
+ * but all the gates share the analysis period, so they can be updated in one
+ * pass at the end of each period.
+ *
+ * The state of the gates is stored as a structure of arrays: the crossing
+ * counts for each period are kept in a ring with one row per period and one
+ * column per gate, and the running sums, thresholds, and states are in
+ * separate arrays. The crossings are counted in each input with the
+ * vectorized count_crossings() kernels, and the per-period update loops over
+ * all the gates at once.
+ *
+ * Several gates can analyze the same input with different parameters (for
+ * example, to search for the best parameters offline). The crossings are only
+ * counted once for a run of consecutive gates that have the same input and
+ * active threshold, so gates that differ only in their count thresholds or
+ * windows cost little more than one gate.
+ *
+ * Unlike crossing_trigger, the analysis periods are aligned to the start of
+ * the signal rather than to each block, and the crossing between the last
+ * sample of one block and the first sample of the next is counted, so the
+ * result doesn't depend on how the signal is split into blocks. The gates are
+ * evaluated at the end of each period, when the running count over the
+ * opening (or closing) window is compared to the threshold. An opening gate is
+ * reported at the crossing that put the count over the threshold, or at the
+ * start of the block if that crossing was in an earlier block. A closing gate
+ * is reported at the end of the period.
+ *
+ * The sample thresholds can be fixed, or adapted to the background noise (see
+ * set_adaptive()). In the adaptive mode, the RMS level of each input is
+ * computed in every period, and a noise floor tracks the lower envelope of
+ * these levels: it falls quickly when the level drops below it and rises
+ * slowly otherwise, so that signals much shorter than the time constant
+ * don't raise it much. The thresholds in the parameters are then multiples of
+ * the noise floor, and are updated at the end of each period.
+ *
+ * The parameters can be changed while the bank is running (see stage()). The
+ * new parameters take effect at the next period boundary, so the crossings in
+ * a period are always counted with one set of thresholds.
+ */
+template <typename T>
+class crossing_trigger_bank : boost::noncopyable {
+public:
+        using sample_type = T;
+        using size_type = std::size_t;
+        using count_type = int;
+
+        /** Parameters for a gate */
+        struct params_type {
+                sample_type open_thresh;        // sample threshold for opening
+                count_type open_count;          // open if more crossings than this
+                size_type open_periods;         // integration window for opening
+                sample_type close_thresh;       // sample threshold for closing
+                count_type close_count;         // close if fewer crossings than this
+                size_type close_periods;        // integration window for closing
+        };
+
+        /**
+         * Initialize the bank.
+         *
+         * @param gates        the parameters for each gate
+         * @param period_size  the size of the analysis period (in samples)
+         * @param max_periods  the longest window that can be staged later
+         *                     (the longest window in gates is always allowed)
+         */
+        crossing_trigger_bank(std::vector<params_type> const & gates, size_type period_size,
+                              size_type max_periods=0)
+                : _params(gates), _period_size(std::max<size_type>(period_size, 1)),
+                  _rows(std::max<size_type>(max_periods, 1)), _staged(nullptr) {
+                size_type n = gates.size();
+                for (auto const & p : gates)
+                        _rows = std::max(_rows, std::max(p.open_periods, p.close_periods));
+                _ring.resize(_rows * n);
+                _last.resize(n);
+                _crossings.resize(n);
+                _sum.resize(n);
+                _filled.resize(n);
+                _open.resize(n);
+                _thresh.resize(n);
+                _count_thresh.resize(n);
+                _window.resize(n);
+                _scale.resize(n);
+                _fired.resize(n);
+                _carried.resize(n);
+                _events.reserve(n);
+                _energy.resize(n);
+                _floor.assign(n, 1);
+                _rise = _fall = _min_floor = 0;
+                reset();
+        }
+
+        /** The number of gates */
+        size_type size() const { return _params.size(); }
+
+        /** The size of the analysis period */
+        size_type period_size() const { return _period_size; }
+
+        /** The parameters of gate k */
+        params_type const & params(size_type k) const { return _params[k]; }
+
+        /** The longest window that can be used (in periods) */
+        size_type max_periods() const { return _rows; }
+
+        /**
+         * Stage new parameters for all the gates. They're copied into the
+         * bank at the start of the next period (in a later call to push()),
+         * so the array must not be modified until staged() returns false.
+         * Windows longer than max_periods() are shortened. If the sample
+         * thresholds or windows of a gate change, its running count is
+         * cleared, as when the gate changes state; otherwise the count is
+         * kept. The states of the gates and the noise floors are kept.
+         * Doesn't allocate memory.
+         *
+         * @param params  the new parameters for each gate
+         */
+        void stage(params_type const * params) { _staged = params; }
+
+        /** Whether staged parameters are waiting to be applied */
+        bool staged() const { return _staged != nullptr; }
+
+        /** The state of gate k */
+        bool open(size_type k) const { return _open[k]; }
+
+        /** The running crossing count of gate k */
+        count_type count(size_type k) const { return _sum[k]; }
+
+        /** The active sample threshold of gate k */
+        sample_type thresh(size_type k) const { return _thresh[k]; }
+
+        /**
+         * Adapt the sample thresholds to the noise floor of each input.
+         * The floor starts at the level of the first period.
+         *
+         * @param periods  the time constant for increases in the floor (in
+         *                 periods). Decreases are faster by a factor of 10.
+         * @param min_floor the lowest value of the floor (so that digital
+         *                 silence doesn't lower the thresholds to zero)
+         */
+        void set_adaptive(double periods, sample_type min_floor=1e-5) {
+                _rise = 1.0 / std::max(periods, 1.0);
+                _fall = std::min(10 * _rise, sample_type(1));
+                _min_floor = min_floor;
+                reset();
+        }
+
+        /** Whether the thresholds are adaptive */
+        bool adaptive() const { return _rise > 0; }
+
+        /** The estimated noise floor of the input to gate k (1.0 if not adaptive) */
+        sample_type floor(size_type k) const { return _floor[k]; }
+
+        /** Close all the gates and clear the counters */
+        void reset() {
+                std::fill(_ring.begin(), _ring.end(), 0);
+                std::fill(_crossings.begin(), _crossings.end(), 0);
+                std::fill(_energy.begin(), _energy.end(), 0);
+                _slot = 0;
+                _nsamples = 0;
+                _started = false;
+                for (size_type k = 0; k < size(); ++k) {
+                        _open[k] = 0;
+                        set_state(k);
+                }
+        }
+
+        /**
+         * Analyze a block of samples for each gate. The callback is invoked
+         * as callback(gate, offset, open) each time a gate changes state,
+         * in order of time. Doesn't allocate memory.
+         *
+         * @param inputs    the input for each gate (several gates may share an input)
+         * @param nframes   the number of samples in each input
+         * @param callback  called with the index of the gate, the offset of the
+         *                  state change in the block, and the new state
+         * @param counts    if not null, filled with the normalized running
+         *                  count for each gate (for monitoring)
+         * @param floors    if not null, filled with the noise floor for each
+         *                  gate (for monitoring)
+         */
+        template <typename Callback>
+        void push(sample_type const * const * inputs, size_type nframes, Callback && callback,
+                  sample_type * const * counts=nullptr, sample_type * const * floors=nullptr) {
+                size_type const n = size();
+                if (nframes == 0) return;
+                if (_staged && _nsamples == 0)
+                        apply_staged();
+                if (!_started) {
+                        for (size_type k = 0; k < n; ++k)
+                                _last[k] = inputs[k][0];
+                        _started = true;
+                }
+                // crossings in the current period from earlier blocks
+                std::copy(_crossings.begin(), _crossings.end(), _carried.begin());
+                size_type start = 0;            // start of the current period in this block
+                for (size_type i = 0; i < nframes;) {
+                        size_type len = std::min(nframes - i, _period_size - _nsamples);
+                        count_type c = 0;
+                        sample_type e = 0;
+                        for (size_type k = 0; k < n; ++k) {
+                                sample_type const * x = inputs[k];
+                                sample_type thresh = _thresh[k];
+                                // gates with the same input and threshold as the
+                                // previous gate (e.g., in a parameter grid) use its count
+                                bool same_input = (k > 0 && x == inputs[k-1]);
+                                if (!(same_input && thresh == _thresh[k-1])) {
+                                        if (i == 0) {
+                                                // crossing from the previous block
+                                                c = (_last[k] < thresh && x[0] >= thresh);
+                                                c += count_crossings(x, len, thresh);
+                                        }
+                                        else {
+                                                c = count_crossings(x + i - 1, len + 1, thresh);
+                                        }
+                                }
+                                _crossings[k] += c;
+                                if (counts)
+                                        std::fill(counts[k] + i, counts[k] + i + len,
+                                                  _sum[k] * _scale[k]);
+                                if (floors)
+                                        std::fill(floors[k] + i, floors[k] + i + len, _floor[k]);
+                                if (_rise > 0) {
+                                        if (!same_input) {
+                                                e = 0;
+                                                for (size_type j = i; j < i + len; ++j)
+                                                        e += x[j] * x[j];
+                                        }
+                                        _energy[k] += e;
+                                }
+                        }
+                        _nsamples += len;
+                        i += len;
+                        if (_nsamples == _period_size) {
+                                update();
+                                _nsamples = 0;
+                                _events.clear();
+                                for (size_type k = 0; k < n; ++k) {
+                                        if (_fired[k]) {
+                                                size_type offset = _open[k] ? i - 1
+                                                        : onset(k, inputs[k], start, i);
+                                                // keep the events sorted by time
+                                                auto it = _events.end();
+                                                while (it != _events.begin() && (it - 1)->first > offset)
+                                                        --it;
+                                                _events.insert(it, event_type(offset, k));
+                                                _open[k] = !_open[k];
+                                                set_state(k);
+                                        }
+                                        if (counts)
+                                                counts[k][i - 1] = _sum[k] * _scale[k];
+                                }
+                                if (_rise > 0)
+                                        adapt();
+                                for (auto const & e : _events)
+                                        callback(e.second, e.first, bool(_open[e.second]));
+                                if (_staged)
+                                        apply_staged();
+                                std::fill(_carried.begin(), _carried.end(), 0);
+                                start = i;
+                        }
+                }
+                for (size_type k = 0; k < n; ++k)
+                        _last[k] = inputs[k][nframes - 1];
+        }
+
+private:
+        using event_type = std::pair<size_type, size_type>;  // offset, gate
+
+        /*
+         * Locate the crossing in [start, stop) that put the count for gate k
+         * over its opening threshold. Called after update() and before the
+         * state of the gate is changed.
+         */
+        size_type onset(size_type k, sample_type const * x, size_type start, size_type stop) const {
+                count_type c = _ring[((_slot - 1) % _rows) * size() + k];
+                count_type needed = _count_thresh[k] + 1 - (_sum[k] - c) - _carried[k];
+                if (needed <= 0) return start;
+                sample_type thresh = _thresh[k];
+                if (start == 0) {
+                        // crossing from the previous block
+                        if (_last[k] < thresh && x[0] >= thresh && --needed == 0)
+                                return 0;
+                        start = 1;
+                }
+                return std::min(start - 1 + find_crossing(x + start - 1, stop - start + 1, thresh,
+                                                          needed), stop - 1);
+        }
+
+        /* add the counts for the current period to the ring and check thresholds */
+        void update() {
+                size_type const n = size();
+                count_type * row = _ring.data() + (_slot % _rows) * n;
+                // this loop is branch-free so that it can be vectorized
+                for (size_type k = 0; k < n; ++k) {
+                        count_type c = _crossings[k];
+                        count_type w = _window[k];
+                        count_type full = _filled[k] >= w;
+                        size_type old_row = (_slot + _rows - w) % _rows;
+                        count_type old = full ? _ring[old_row * n + k] : 0;
+                        _sum[k] += c - old;
+                        row[k] = c;
+                        _filled[k] += !full;
+                        count_type ready = _filled[k] >= w;
+                        // closing thresholds are stored negated
+                        count_type s = _open[k] ? -_sum[k] : _sum[k];
+                        _fired[k] = ready & (s > _count_thresh[k]);
+                        _crossings[k] = 0;
+                }
+                _slot += 1;
+        }
+
+        /* update the noise floors and the thresholds at the end of a period */
+        void adapt() {
+                size_type const n = size();
+                for (size_type k = 0; k < n; ++k) {
+                        sample_type level = std::sqrt(_energy[k] / _period_size);
+                        sample_type f = _floor[k];
+                        sample_type rate = (level < f) ? _fall : _rise;
+                        // the first period sets the floor
+                        f = (_slot == 1) ? level : f + rate * (level - f);
+                        _floor[k] = std::max(f, _min_floor);
+                        _thresh[k] = (_open[k] ? _params[k].close_thresh : _params[k].open_thresh)
+                                * _floor[k];
+                        _energy[k] = 0;
+                }
+        }
+
+        /* copy the staged parameters (at a period boundary) */
+        void apply_staged() {
+                for (size_type k = 0; k < size(); ++k) {
+                        params_type p = _staged[k];
+                        p.open_periods = std::min(p.open_periods, _rows);
+                        p.close_periods = std::min(p.close_periods, _rows);
+                        params_type const & old = _params[k];
+                        bool keep = (p.open_thresh == old.open_thresh && p.close_thresh == old.close_thresh &&
+                                     p.open_periods == old.open_periods && p.close_periods == old.close_periods);
+                        _params[k] = p;
+                        if (keep)
+                                _count_thresh[k] = _open[k] ? -p.close_count : p.open_count;
+                        else
+                                set_state(k);
+                }
+                _staged = nullptr;
+        }
+
+        /* set the active thresholds and window for the state of gate k, and clear its count */
+        void set_state(size_type k) {
+                params_type const & p = _params[k];
+                _thresh[k] = (_open[k] ? p.close_thresh : p.open_thresh) * _floor[k];
+                _count_thresh[k] = _open[k] ? -p.close_count : p.open_count;
+                _window[k] = std::max<size_type>(_open[k] ? p.close_periods : p.open_periods, 1);
+                _scale[k] = sample_type(2) / (_window[k] * _period_size);
+                _sum[k] = 0;
+                _filled[k] = 0;
+                _fired[k] = 0;
+        }
+
+        std::vector<params_type> _params;
+        size_type _period_size;
+        size_type _rows;                        // number of periods in the ring
+        size_type _slot;                        // number of periods analyzed
+        size_type _nsamples;                    // samples analyzed in the current period
+        bool _started;                          // whether _last is valid
+        params_type const * _staged;            // parameters to apply at the next period
+
+        std::vector<count_type> _ring;          // crossings in each period [row][gate]
+        std::vector<sample_type> _last;         // last sample of the previous block
+        std::vector<count_type> _crossings;     // crossings in the current period
+        std::vector<count_type> _sum;           // crossings in the active window
+        std::vector<count_type> _filled;        // periods in the active window
+        std::vector<count_type> _open;          // gate state
+        std::vector<sample_type> _thresh;       // active sample threshold
+        std::vector<count_type> _count_thresh;  // active count threshold (negated to close)
+        std::vector<count_type> _window;        // active window size
+        std::vector<sample_type> _scale;        // normalization for the count output
+        std::vector<count_type> _fired;         // gates that changed state in this period
+        std::vector<count_type> _carried;       // crossings in the current period from earlier blocks
+        std::vector<event_type> _events;        // state changes in this period
+
+        sample_type _rise;                      // rate of increase in the floor (0 if fixed)
+        sample_type _fall;                      // rate of decrease in the floor
+        sample_type _min_floor;
+        std::vector<sample_type> _energy;       // sum of squares in the current period
+        std::vector<sample_type> _floor;        // noise floor (1 if fixed)
+};
+
+}}
+
+#endif
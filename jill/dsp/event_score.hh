@@ -0,0 +1,87 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _EVENT_SCORE_HH
+#define _EVENT_SCORE_HH
+
+#include <cstdint>
+#include <vector>
+
+namespace jill { namespace dsp {
+
+/** An interval of time [start, stop), in samples */
+struct interval_t {
+        std::uint64_t start;
+        std::uint64_t stop;
+};
+
+/**
+ * The agreement between the intervals where a detector's gate was open and a
+ * set of labelled intervals (e.g., marked by hand).
+ */
+struct event_score {
+        std::size_t hits = 0;           // labels overlapped by a detection
+        std::size_t misses = 0;         // labels not overlapped by any detection
+        std::size_t false_alarms = 0;   // detections that don't overlap any label
+        double latency = 0;             // sum over hits of detected - labelled onset (samples)
+
+        /** The mean latency of the hits (in samples) */
+        double mean_latency() const { return hits ? latency / hits : 0; }
+
+        event_score & operator+=(event_score const & other) {
+                hits += other.hits;
+                misses += other.misses;
+                false_alarms += other.false_alarms;
+                latency += other.latency;
+                return *this;
+        }
+};
+
+/**
+ * Score detected intervals against labelled intervals. A label is hit if any
+ * detection overlaps it, and the latency is measured to the first such
+ * detection (it's negative if the detector opened early). Both lists must be
+ * sorted by start time, and the intervals in each list must not overlap.
+ *
+ * @param detected   the intervals where the gate was open
+ * @param labels     the labelled intervals
+ * @param tolerance  extend the labels by this many samples on either side
+ */
+inline event_score
+score_events(std::vector<interval_t> const & detected, std::vector<interval_t> const & labels,
+             std::uint64_t tolerance=0)
+{
+        event_score score;
+        std::vector<bool> matched(detected.size(), false);
+        std::size_t j = 0;
+        for (interval_t const & label : labels) {
+                std::uint64_t lo = (label.start > tolerance) ? label.start - tolerance : 0;
+                std::uint64_t hi = label.stop + tolerance;
+                // skip detections that ended before this label
+                while (j < detected.size() && detected[j].stop <= lo) ++j;
+                if (j < detected.size() && detected[j].start < hi) {
+                        score.hits += 1;
+                        score.latency += double(detected[j].start) - double(label.start);
+                        for (std::size_t k = j; k < detected.size() && detected[k].start < hi; ++k)
+                                matched[k] = true;
+                }
+                else {
+                        score.misses += 1;
+                }
+        }
+        for (bool m : matched)
+                score.false_alarms += !m;
+        return score;
+}
+
+}}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _FIR_DECIMATOR_HH
+#define _FIR_DECIMATOR_HH
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * Reduces the sampling rate of a signal by an integer factor, using a
+ * linear-phase FIR filter to prevent aliasing.
+ *
+ * Only the retained outputs are computed, so the cost per input sample is
+ * ntaps / factor multiply-adds (the polyphase form of the filter). Outputs are
+ * aligned to absolute frame counts that are multiples of the factor and are
+ * corrected for the delay of the filter, so a decimated channel stays
+ * registered to the channels it was recorded with. The filter history is
+ * carried between calls to process(), so a continuous signal can be split into
+ * blocks (and entries) at arbitrary points without edge effects.
+ */
+class fir_decimator {
+
+public:
+        typedef sample_t sample_type;
+        typedef std::size_t size_type;
+
+        /**
+         * Initialize the decimator.
+         *
+         * @param factor  the decimation factor. Must be at least 1.
+         * @param order   the number of taps on either side of the center of the
+         *                filter, per unit of decimation. Larger values give a
+         *                sharper cutoff.
+         */
+        explicit fir_decimator(unsigned int factor, unsigned int order=8)
+                : _factor(factor), _delay(factor * order), _time(0), _next(0) {
+                if (factor < 1) throw std::invalid_argument("decimation factor must be >= 1");
+                design(_taps, factor, _delay);
+                _buf.reserve(_taps.size() * 4);
+                reset(0);
+        }
+
+        unsigned int factor() const { return _factor; }
+
+        /** The delay of the filter, in input samples */
+        nframes_t delay() const { return _delay; }
+
+        /** The filter coefficients */
+        std::vector<float> const & taps() const { return _taps; }
+
+        /** The frame count of the next input sample the decimator expects */
+        nframes_t next_frame() const { return _time + _buf.size(); }
+
+        /**
+         * Clear the filter history. The signal is assumed to be zero before
+         * @a frame, which is the frame count of the next input sample.
+         */
+        void reset(nframes_t frame) {
+                _buf.assign(_delay, 0.0f);
+                _time = frame - _delay;
+                _next = frame + (_factor - frame % _factor) % _factor;
+        }
+
+        /**
+         * Filter and decimate a block of samples.
+         *
+         * @param in     the input samples, which follow the previous block
+         * @param n      the number of input samples
+         * @param out    filled with the outputs computed from this block
+         * @param frame  set to the frame count of the first output
+         * @return the number of outputs
+         */
+        size_type process(sample_type const * in, size_type n,
+                          std::vector<sample_type> & out, nframes_t & frame) {
+                _buf.insert(_buf.end(), in, in + n);
+                frame = _next;
+                out.clear();
+                // output at frame t is centered on input t, so it needs
+                // inputs up to t + delay
+                while (framediff_t(_time + _buf.size() - _next) > framediff_t(_delay)) {
+                        out.push_back(dot(_buf.data() + (_next - _delay - _time)));
+                        _next += _factor;
+                }
+                // discard history the next output doesn't need
+                size_type used = _next - _delay - _time;
+                _buf.erase(_buf.begin(), _buf.begin() + used);
+                _time += used;
+                return out.size();
+        }
+
+        /**
+         * Compute the outputs that are waiting on future inputs, assuming the
+         * signal is zero after the last input. The filter state is not
+         * changed, so this can be used to terminate an entry without
+         * interrupting a continuous signal.
+         *
+         * @param out    filled with the outputs
+         * @param frame  set to the frame count of the first output
+         * @return the number of outputs
+         */
+        size_type flush(std::vector<sample_type> & out, nframes_t & frame) const {
+                std::vector<sample_type> buf(_buf);
+                buf.resize(_buf.size() + _delay, 0.0f);
+                frame = _next;
+                out.clear();
+                for (nframes_t t = _next; framediff_t(next_frame() - t) > 0; t += _factor)
+                        out.push_back(dot(buf.data() + (t - _delay - _time)));
+                return out.size();
+        }
+
+        /**
+         * Design a windowed-sinc lowpass filter with a cutoff just below the
+         * Nyquist frequency of the decimated signal.
+         */
+        static void design(std::vector<float> & taps, unsigned int factor, nframes_t delay) {
+                size_type ntaps = 2 * delay + 1;
+                double const fc = 0.5 / factor;
+                double sum = 0;
+                std::vector<double> h(ntaps);
+                for (size_type i = 0; i < ntaps; ++i) {
+                        double x = double(i) - delay;
+                        double sinc = (x == 0) ? 2 * fc : std::sin(2 * M_PI * fc * x) / (M_PI * x);
+                        // blackman window
+                        double w = 0.42 - 0.5 * std::cos(2 * M_PI * i / (ntaps - 1)) +
+                                0.08 * std::cos(4 * M_PI * i / (ntaps - 1));
+                        h[i] = (ntaps > 1) ? sinc * w : 1.0;
+                        sum += h[i];
+                }
+                taps.resize(ntaps);
+                for (size_type i = 0; i < ntaps; ++i)
+                        taps[i] = h[i] / sum;  // unity gain at DC
+        }
+
+private:
+        /* inner product of the (symmetric) filter with ntaps samples */
+        sample_type dot(sample_type const * x) const {
+                float const * h = _taps.data();
+                size_type const n = _taps.size();
+                size_type i = 0;
+                float acc = 0;
+#ifdef __SSE__
+                __m128 sum = _mm_setzero_ps();
+                for (; i + 4 <= n; i += 4)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(h + i), _mm_loadu_ps(x + i)));
+                float part[4];
+                _mm_storeu_ps(part, sum);
+                acc = (part[0] + part[1]) + (part[2] + part[3]);
+#endif
+                for (; i < n; ++i)
+                        acc += h[i] * x[i];
+                return acc;
+        }
+
+        unsigned int _factor;
+        nframes_t _delay;
+        std::vector<float> _taps;
+        std::vector<sample_type> _buf;  // input history
+        nframes_t _time;                // frame count of _buf[0]
+        nframes_t _next;                // frame count of the next output
+};
+
+}}
+
+#endif
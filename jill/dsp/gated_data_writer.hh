@@ -0,0 +1,194 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _GATED_DATA_WRITER_HH
+#define _GATED_DATA_WRITER_HH
+
+#include <deque>
+#include <map>
+#include <utility>
+#include "buffered_data_writer.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * This implementation of the disk_thread class derives from
+ * buffered_data_writer, adding per-channel gating to continuous recording.
+ *
+ * Entries are opened and closed as in the base class, but each sampled channel
+ * is only written while it's active, with some padding before and after. A
+ * channel is active in any period where the signal crosses a threshold (in the
+ * positive direction) at least a minimum number of times.
+ *
+ * The consumer analyzes blocks as they are read from the head of the queue
+ * with peek_ahead(), but holds them in the ringbuffer until no later onset
+ * could extend back over them. This is the same prebuffering used by
+ * triggered_data_writer, so the pre-onset padding is taken from data that's
+ * already in memory. The ringbuffer needs to be large enough to hold this
+ * much data for all the channels.
+ *
+ * The periods when a channel is not written are passed to the data_writer as
+ * gaps with cause INACTIVE, so the activity intervals of each channel can be
+ * recovered from the entry.
+ */
+template <typename Writer>
+class basic_gated_data_writer : public basic_buffered_data_writer<Writer> {
+public:
+        using writer_type = Writer;
+
+        /**
+         * Initialize gated writer.
+         *
+         * @param writer          the sink for the data
+         * @param threshold       the threshold for detecting activity (in sample units)
+         * @param min_crossings   the number of crossings in a period for a channel
+         *                        to be considered active
+         * @param prepad_frames   the number of frames to write before activity
+         * @param postpad_frames  the number of frames to write after activity
+         */
+        basic_gated_data_writer(std::unique_ptr<writer_type> writer,
+                                sample_t threshold, unsigned int min_crossings,
+                                nframes_t prepad_frames, nframes_t postpad_frames)
+                : basic_buffered_data_writer<Writer>(std::move(writer)),
+                  _threshold(threshold), _min_crossings(std::max(min_crossings, 1U)),
+                  _prepad(prepad_frames), _postpad(postpad_frames), _head(0), _started(false) {
+                DBG << "gated_data_writer initializing";
+        }
+
+        ~basic_gated_data_writer() override {
+                DBG << "gated_data_writer closing";
+                this->stop();
+                this->join();
+        }
+
+        /**
+         * Exclude a channel from gating, so that it's always written. Must be
+         * called before start().
+         */
+        void set_ungated(std::string const & id) {
+                _gates[id].gated = false;
+        }
+
+protected:
+
+        /** @see buffered_data_writer::write() */
+        void write(data_block_t const * data) override {
+                if (data->dtype == SAMPLED)
+                        detect(data);
+                if (!_started || framediff_t(data->time - _head) > 0)
+                        _head = data->time;
+                _started = true;
+                // write blocks that are too old to be extended by a later onset
+                data_block_t const * tail = this->_buffer->peek();
+                while (tail && framediff_t(_head - (tail->time + tail->nframes())) >= framediff_t(_prepad)) {
+                        write_tail(tail);
+                        this->_buffer->release();
+                        tail = this->_buffer->peek();
+                }
+        }
+
+        /** @see buffered_data_writer::drain() */
+        void drain() override {
+                data_block_t const * tail;
+                while ((tail = this->_buffer->peek())) {
+                        write_tail(tail);
+                        this->_buffer->release();
+                }
+        }
+
+private:
+        /* an interval of frames [first, second) */
+        typedef std::pair<nframes_t, nframes_t> interval_t;
+
+        struct gate_t {
+                bool gated = true;
+                sample_t last = 0;                      // last sample analyzed
+                std::deque<interval_t> active;          // intervals to write
+        };
+
+        /* analyze a block from the head of the queue and extend the active intervals */
+        void detect(data_block_t const * data) {
+                gate_t & gate = _gates[data->id()];
+                if (!gate.gated) return;
+                auto const * samples = static_cast<sample_t const *>(data->data());
+                nframes_t nframes = data->nframes();
+                unsigned int crossings = 0;
+                sample_t last = gate.last;
+                for (nframes_t i = 0; i < nframes; ++i) {
+                        crossings += (last < _threshold && samples[i] >= _threshold);
+                        last = samples[i];
+                }
+                gate.last = last;
+                if (crossings < _min_crossings) return;
+
+                interval_t iv(data->time - _prepad, data->time + nframes + _postpad);
+                if (!gate.active.empty() && framediff_t(iv.first - gate.active.back().second) <= 0) {
+                        gate.active.back().second = iv.second;
+                }
+                else {
+                        DBG << "channel active: id=" << data->id() << ", time=" << data->time;
+                        gate.active.push_back(iv);
+                }
+        }
+
+        /* write a block from the tail of the queue, or the parts of it that are active */
+        void write_tail(data_block_t const * data) {
+                // close the entry at the first block at or after the reset
+                // frame; the next entry starts there even if nothing is active
+                if (this->take_reset(data->time))
+                        this->_writer->close_entry();
+                if (!this->_writer->ready())
+                        this->_writer->new_entry(data->time);
+
+                auto gate = _gates.find(data->id());
+                if (data->dtype != SAMPLED || gate == _gates.end() || !gate->second.gated) {
+                        this->_writer->write(data, 0, 0);
+                        return;
+                }
+
+                std::deque<interval_t> & active = gate->second.active;
+                nframes_t const start = data->time;
+                nframes_t const stop = start + data->nframes();
+                nframes_t pos = start;
+                // intervals that end before this block are done
+                while (!active.empty() && framediff_t(active.front().second - start) <= 0)
+                        active.pop_front();
+                for (auto const & iv : active) {
+                        if (framediff_t(iv.first - stop) >= 0) break;
+                        nframes_t on = (framediff_t(iv.first - start) > 0) ? iv.first : start;
+                        nframes_t off = (framediff_t(iv.second - stop) < 0) ? iv.second : stop;
+                        if (on != pos)
+                                this->_writer->gap(data->id(), pos, on - pos, INACTIVE);
+                        this->_writer->write(data, on - start, off - start);
+                        pos = off;
+                }
+                if (pos != stop)
+                        this->_writer->gap(data->id(), pos, stop - pos, INACTIVE);
+        }
+
+        const sample_t _threshold;
+        const unsigned int _min_crossings;
+        const nframes_t _prepad;
+        const nframes_t _postpad;
+
+        std::map<std::string, gate_t> _gates;   // per-channel state (consumer)
+        nframes_t _head;                        // time of the latest block analyzed
+        bool _started;                          // whether _head is valid
+};
+
+/** gated writer with a runtime-polymorphic sink */
+using gated_data_writer = basic_gated_data_writer<data_writer>;
+
+extern template class basic_gated_data_writer<data_writer>;
+
+}}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <sstream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+
+#include "../logging.hh"
+#include "../zmq.hh"
+#include "../util/thread_config.hh"
+#include "log_receiver.hh"
+
+using namespace jill;
+using namespace jill::dsp;
+using std::string;
+
+/* how long the receiving thread blocks on the socket before checking for exit */
+static const int recv_timeout_ms = 100;
+
+log_receiver::log_receiver(string const & server_name, std::size_t queue_size)
+        : _socket(nullptr), _queue_size(queue_size), _size(0), _running(true)
+{
+        namespace fs = boost::filesystem;
+        std::ostringstream endpoint;
+        fs::path path("/tmp/org.meliza.jill");
+        path /= server_name;
+        if (!fs::exists(path)) {
+                fs::create_directories(path);
+        }
+        path /= "msg";
+        endpoint << "ipc://" << path.string();
+        void * socket = zmq::context::socket(ZMQ_DEALER);
+        if (zmq_bind(socket, endpoint.str().c_str()) < 0) {
+                LOG << "unable to bind to endpoint " << endpoint.str();
+                zmq_close(socket);
+                return;
+        }
+        zmq_setsockopt(socket, ZMQ_RCVTIMEO, &recv_timeout_ms, sizeof(recv_timeout_ms));
+        INFO << "logger bound to " << endpoint.str();
+        _socket = socket;
+        _queue.reserve(_queue_size);
+        _thread = std::thread(&log_receiver::thread, this);
+}
+
+log_receiver::~log_receiver()
+{
+        {
+                std::lock_guard<std::mutex> lck(_lock);
+                _running = false;
+        }
+        _space.notify_one();
+        if (_thread.joinable()) _thread.join();
+        if (_socket) zmq_close(_socket);
+}
+
+std::size_t
+log_receiver::pop(std::vector<log_message_t> & messages)
+{
+        messages.clear();
+        {
+                std::lock_guard<std::mutex> lck(_lock);
+                // the caller's storage is recycled for the queue
+                messages.swap(_queue);
+                __sync_lock_test_and_set(&_size, 0);
+        }
+        _space.notify_one();
+        return messages.size();
+}
+
+void
+log_receiver::thread()
+{
+        using namespace boost::posix_time;
+        std::vector<log_message_t> batch;
+        std::size_t room;
+        int flags;
+        util::configure_thread("log receiver");
+        DBG << "started log receiver thread";
+        while (true) {
+                {
+                        std::unique_lock<std::mutex> lck(_lock);
+                        _space.wait(lck, [this]{ return !_running || _queue.size() < _queue_size; });
+                        if (!_running) break;
+                        room = _queue_size - _queue.size();
+                }
+                // block for the first message, then take whatever else is
+                // waiting, up to the room in the queue
+                for (flags = 0; batch.size() < room; flags = ZMQ_DONTWAIT) {
+                        // expect a three-part message: source, timestamp, message
+                        std::vector<string> parts = zmq::recv(_socket, flags);
+                        if (parts.empty()) break;
+                        if (parts.size() < 3) continue;
+                        try {
+                                batch.push_back({from_iso_string(parts[1]), parts[0], parts[2]});
+                        }
+                        catch (std::exception const & e) {
+                                LOG << "bad timestamp in message from " << parts[0];
+                        }
+                }
+                if (batch.empty()) continue;
+                std::lock_guard<std::mutex> lck(_lock);
+                _queue.insert(_queue.end(), std::make_move_iterator(batch.begin()),
+                              std::make_move_iterator(batch.end()));
+                __sync_lock_test_and_set(&_size, _queue.size());
+                batch.clear();
+        }
+        DBG << "exited log receiver thread";
+}
@@ -0,0 +1,82 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _LOG_RECEIVER_HH
+#define _LOG_RECEIVER_HH
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#include "../data_writer.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * Receives log messages from other clients of the jack server on a zeromq
+ * socket. Messages are received, and their timestamps parsed, by a dedicated
+ * thread, and then placed in a bounded queue. Another thread (usually the
+ * thread that owns the data_writer) collects them in batches with pop().
+ *
+ * If the queue is full, the receiving thread stops reading from the socket
+ * until there's room again, so that messages accumulate in zeromq rather than
+ * in this object.
+ */
+class log_receiver : boost::noncopyable {
+
+public:
+        /**
+         * Bind a zeromq DEALER socket for log messages and start the receiving
+         * thread. Check bound() to see if binding was successful.
+         *
+         * @param server_name  the name of the jack server. All the clients of
+         *                     the server must log to the same socket.
+         * @param queue_size   the maximum number of messages held in the queue
+         */
+        explicit log_receiver(std::string const & server_name, std::size_t queue_size=4096);
+        ~log_receiver();
+
+        /** @return true if the socket was bound and messages are being received */
+        bool bound() const { return _socket != nullptr; }
+
+        /** @return the (approximate) number of messages waiting in the queue */
+        std::size_t size() const { return __sync_fetch_and_add(&_size, 0); }
+
+        /**
+         * Retrieve all the messages in the queue. Does not block if the queue is
+         * empty.
+         *
+         * @param messages  vector to receive the messages. Any existing contents
+         *                  are discarded.
+         * @return the number of messages retrieved
+         */
+        std::size_t pop(std::vector<log_message_t> & messages);
+
+private:
+        /* the receiving thread */
+        void thread();
+
+        void * _socket;
+        std::size_t const _queue_size;
+        mutable std::size_t _size;
+        bool _running;
+        std::vector<log_message_t> _queue;
+        std::mutex _lock;
+        std::condition_variable _space;         // indicates room in the queue
+        std::thread _thread;
+};
+
+}}
+
+#endif
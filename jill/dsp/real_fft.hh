@@ -0,0 +1,133 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _REAL_FFT_HH
+#define _REAL_FFT_HH
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+
+namespace jill { namespace dsp {
+
+/**
+ * Discrete Fourier transform of a real signal whose length is a power of two.
+ *
+ * All the tables (bit-reversal permutation and twiddle factors) and the work
+ * buffer are computed when the object is constructed, so transform() and
+ * power() don't allocate memory and can be called from the process callback.
+ * The n real inputs are packed into n/2 complex values, which are transformed
+ * with an iterative radix-2 FFT and then separated into the n/2 + 1
+ * non-redundant bins of the real transform.
+ */
+template <typename T>
+class real_fft : boost::noncopyable {
+public:
+        using value_type = T;
+        using complex_type = std::complex<T>;
+        using size_type = std::size_t;
+
+        /**
+         * Plan a transform.
+         *
+         * @param size  the number of (real) input samples. Must be a power of
+         *              two and at least 2.
+         */
+        explicit real_fft(size_type size)
+                : _size(size), _half(size / 2), _bitrev(_half), _twiddle(_half / 2 + 1),
+                  _post(_half + 1), _work(_half) {
+                if (size < 2 || (size & (size - 1)))
+                        throw std::invalid_argument("FFT size must be a power of 2");
+                size_type bits = 0;
+                while ((size_type(1) << bits) < _half) ++bits;
+                for (size_type i = 0; i < _half; ++i) {
+                        size_type r = 0;
+                        for (size_type b = 0; b < bits; ++b)
+                                r |= ((i >> b) & 1) << (bits - 1 - b);
+                        _bitrev[i] = r;
+                }
+                for (size_type j = 0; j < _twiddle.size(); ++j)
+                        _twiddle[j] = std::polar(1.0, -2 * M_PI * j / _half);
+                for (size_type k = 0; k <= _half; ++k)
+                        _post[k] = std::polar(1.0, -2 * M_PI * k / _size);
+        }
+
+        /** The number of input samples */
+        size_type size() const { return _size; }
+
+        /** The number of output bins (size() / 2 + 1) */
+        size_type nbins() const { return _half + 1; }
+
+        /**
+         * Compute the transform.
+         *
+         * @param in   size() input samples
+         * @param out  nbins() output coefficients, from DC to the Nyquist frequency
+         */
+        void transform(value_type const * in, complex_type * out) {
+                fft(in);
+                for (size_type k = 0; k <= _half; ++k)
+                        out[k] = bin(k);
+        }
+
+        /**
+         * Compute the power spectrum (the squared magnitude of the transform).
+         *
+         * @param in   size() input samples
+         * @param out  nbins() output values, from DC to the Nyquist frequency
+         */
+        void power(value_type const * in, value_type * out) {
+                fft(in);
+                for (size_type k = 0; k <= _half; ++k)
+                        out[k] = std::norm(bin(k));
+        }
+
+private:
+        /* transform the input, packed as complex values, into _work */
+        void fft(value_type const * in) {
+                for (size_type m = 0; m < _half; ++m)
+                        _work[_bitrev[m]] = complex_type(in[2*m], in[2*m+1]);
+                for (size_type len = 2; len <= _half; len <<= 1) {
+                        size_type step = _half / len;
+                        size_type h = len / 2;
+                        for (size_type i = 0; i < _half; i += len) {
+                                for (size_type j = 0; j < h; ++j) {
+                                        complex_type u = _work[i+j];
+                                        complex_type v = _work[i+j+h] * _twiddle[j * step];
+                                        _work[i+j] = u + v;
+                                        _work[i+j+h] = u - v;
+                                }
+                        }
+                }
+        }
+
+        /* bin k of the real transform, from the packed transform in _work */
+        complex_type bin(size_type k) const {
+                complex_type z = _work[k % _half];
+                complex_type zc = std::conj(_work[(_half - k) % _half]);
+                complex_type even = (z + zc) * value_type(0.5);
+                complex_type odd = (z - zc) * complex_type(0, -0.5);
+                return even + _post[k] * odd;
+        }
+
+        size_type _size;
+        size_type _half;
+        std::vector<size_type> _bitrev;         // bit-reversal permutation for _half points
+        std::vector<complex_type> _twiddle;     // exp(-2 pi i j / _half)
+        std::vector<complex_type> _post;        // exp(-2 pi i k / _size)
+        std::vector<complex_type> _work;
+};
+
+}}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _SIGNAL_DETECTOR_HH
+#define _SIGNAL_DETECTOR_HH
+
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+
+namespace jill { namespace dsp {
+
+/**
+ * ABC for detectors that open and close a gate based on the contents of a
+ * signal. Samples are analyzed in blocks of arbitrary size, which must be
+ * contiguous.
+ */
+template <typename T>
+class signal_detector : boost::noncopyable {
+public:
+        using sample_type = T;
+
+        virtual ~signal_detector() = default;
+
+        /**
+         * Analyze a block of samples.
+         *
+         * @param samples  the input samples
+         * @param size     the number of samples
+         * @param counts   if not null, a buffer at least as large as samples to
+         *                 store the state of the detector (for monitoring)
+         * @return the offset in the block where the gate opened or closed, or
+         *         -1 if the state didn't change
+         */
+        virtual int push(sample_type const * samples, std::size_t size, sample_type * counts=0) = 0;
+
+        /** The state of the detector */
+        virtual bool open() const = 0;
+};
+
+}}
+
+#endif
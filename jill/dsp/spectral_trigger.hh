@@ -0,0 +1,204 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _SPECTRAL_TRIGGER_HH
+#define _SPECTRAL_TRIGGER_HH
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "counter.hh"
+#include "real_fft.hh"
+#include "signal_detector.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * A signal detector based on the distribution of energy across frequencies.
+ * Zero-crossing counts respond to any loud sound; this detector instead
+ * computes the power spectrum of each analysis period and the fraction of the
+ * power that falls in a frequency band (e.g. the range of birdsong), so
+ * broadband or low-frequency noise doesn't open the gate.
+ *
+ * The gate is controlled in the same way as crossing_trigger: while the gate
+ * is closed, the detector counts the periods where the band ratio is at least
+ * the opening ratio, and the gate opens when more than a certain number of
+ * the periods in the opening window pass. While the gate is open, the periods
+ * where the ratio is at least the closing ratio are counted, and the gate
+ * closes when fewer than a certain number of periods in the closing window
+ * pass. Giving a closing ratio below the opening ratio adds hysteresis.
+ *
+ * Each period is multiplied by a Hann window and zero-padded to a power of
+ * two. The FFT is planned and all the buffers are allocated in the
+ * constructor, so push() can be called in the process callback. Periods are
+ * aligned to the start of the signal, not to each block.
+ */
+template <typename T>
+class spectral_trigger : public signal_detector<T> {
+public:
+        using sample_type = T;
+        using size_type = std::size_t;
+
+        /**
+         * Instantiate a signal detector.
+         *
+         * @param band_low         The lower edge of the band (as a fraction of the sampling rate)
+         * @param band_high        The upper edge of the band (as a fraction of the sampling rate)
+         * @param oratio           The minimum band ratio for a period to count toward opening
+         * @param ocount_thresh    The gate opens if more periods than this pass
+         * @param owindow_periods  The number of periods to analyze for opening
+         * @param cratio           The minimum band ratio for a period to count toward staying open
+         * @param ccount_thresh    The gate closes if fewer periods than this pass
+         * @param cwindow_periods  The number of periods to analyze for closing
+         * @param period_size      The size of the analysis period
+         */
+        spectral_trigger(double band_low, double band_high,
+                         sample_type oratio, int ocount_thresh, size_type owindow_periods,
+                         sample_type cratio, int ccount_thresh, size_type cwindow_periods,
+                         size_type period_size)
+                : _open(false),
+                  _period_size(std::max<size_type>(period_size, 1)),
+                  _fft(fft_size(_period_size)),
+                  _open_counter(std::max<size_type>(owindow_periods, 1)),
+                  _close_counter(std::max<size_type>(cwindow_periods, 1)),
+                  _open_ratio(oratio), _close_ratio(cratio),
+                  _open_count_thresh(ocount_thresh), _close_count_thresh(ccount_thresh),
+                  _window(_period_size), _frame(_fft.size(), 0), _power(_fft.nbins()),
+                  _nsamples(0), _ratio(0), _state(0) {
+                if (!(band_low >= 0 && band_low < band_high && band_high <= 0.5))
+                        throw std::invalid_argument("frequency band must be between 0 and "
+                                                    "the Nyquist frequency");
+                size_type nfft = _fft.size();
+                // DC is excluded, so an offset in the signal doesn't count
+                _band_start = std::max<size_type>(std::ceil(band_low * nfft), 1);
+                _band_stop = std::min<size_type>(std::floor(band_high * nfft), nfft / 2) + 1;
+                if (_band_start >= _band_stop)
+                        throw std::invalid_argument("frequency band is narrower than the "
+                                                    "resolution of the analysis period");
+                for (size_type i = 0; i < _period_size; ++i)
+                        _window[i] = 0.5 - 0.5 * std::cos(2 * M_PI * (i + 0.5) / _period_size);
+        }
+
+        /**
+         *  Analyze a block of samples. At the end of each period, the band
+         *  ratio is compared against the threshold for the current state of
+         *  the gate. If the active counter passes its threshold, the gate is
+         *  opened or closed, and the offset in the supplied data where this
+         *  occurred (the last sample of the period) is returned. If no state
+         *  changed, -1 is returned. As with crossing_trigger, only the first
+         *  change in a block is reported. Doesn't allocate memory.
+         *
+         *  @param samples    The input samples
+         *  @param size       The number of available samples
+         *  @param counts     A buffer, at least as large as samples, to store the
+         *                    fraction of periods passing in the active window
+         *  @returns          The sample offset where a state change occurred, or
+         *                    -1 if no state change occurred
+         */
+        int push(const sample_type * samples, size_type size, sample_type * counts=0) override {
+                int ret = -1;
+                for (size_type i = 0; i < size;) {
+                        size_type len = std::min(size - i, _period_size - _nsamples);
+                        std::copy(samples + i, samples + i + len, _frame.begin() + _nsamples);
+                        if (counts)
+                                std::fill(counts + i, counts + i + len, _state);
+                        _nsamples += len;
+                        i += len;
+                        if (_nsamples < _period_size) break;
+                        _nsamples = 0;
+                        _ratio = band_ratio();
+                        running_counter<int> & counter = _open ? _close_counter : _open_counter;
+                        counter.push(_ratio >= (_open ? _close_ratio : _open_ratio));
+                        if (ret < 0 && counter.full() &&
+                            (_open ? counter.running_count() < _close_count_thresh
+                                   : counter.running_count() > _open_count_thresh)) {
+                                _open = !_open;
+                                counter.reset();
+                                ret = i - 1;
+                        }
+                        running_counter<int> const & active = _open ? _close_counter : _open_counter;
+                        _state = sample_type(active.running_count()) / active.capacity();
+                        if (counts)
+                                counts[i - 1] = _state;
+                }
+                return ret;
+        }
+
+        /** The state of the detector */
+        bool open() const override { return _open; }
+
+        /** Close the gate and clear the counters */
+        void reset() {
+                _open = false;
+                _open_counter.reset();
+                _close_counter.reset();
+                _nsamples = 0;
+                _state = 0;
+        }
+
+        /** The band ratio in the last complete period */
+        sample_type ratio() const { return _ratio; }
+
+        /** The number of points in the FFT */
+        size_type fft_size() const { return _fft.size(); }
+
+        /** The threshold for going to an open state */
+        sample_type &open_ratio() { return _open_ratio; }
+
+        /** The threshold for going to a closed state */
+        sample_type &close_ratio() { return _close_ratio; }
+
+private:
+        /* the smallest power of two that holds a period */
+        static size_type fft_size(size_type period_size) {
+                size_type n = 2;
+                while (n < period_size) n <<= 1;
+                return n;
+        }
+
+        /* the fraction of the (non-DC) power of the current period in the band */
+        sample_type band_ratio() {
+                std::transform(_window.begin(), _window.end(), _frame.begin(), _frame.begin(),
+                               [](sample_type w, sample_type x) { return w * x; });
+                _fft.power(_frame.data(), _power.data());
+                sample_type band = 0, total = 0;
+                for (size_type k = 1; k < _power.size(); ++k) {
+                        total += _power[k];
+                        if (k >= _band_start && k < _band_stop)
+                                band += _power[k];
+                }
+                return (total > 0) ? band / total : 0;
+        }
+
+        bool _open;
+        size_type _period_size;
+        real_fft<sample_type> _fft;
+        running_counter<int> _open_counter;     // periods passing in the opening window
+        running_counter<int> _close_counter;    // periods passing in the closing window
+        sample_type _open_ratio;
+        sample_type _close_ratio;
+        int _open_count_thresh;
+        int _close_count_thresh;
+        size_type _band_start;                  // first bin in band
+        size_type _band_stop;                   // one past the last bin in band
+
+        std::vector<sample_type> _window;       // taper for each period
+        std::vector<sample_type> _frame;        // the current period (zero-padded)
+        std::vector<sample_type> _power;        // power spectrum of the last period
+        size_type _nsamples;                    // samples in the current period
+        sample_type _ratio;
+        sample_type _state;
+};
+
+}}
+
+#endif
@@ -1,7 +1,11 @@
 #ifndef _TRIGGERED_DATA_WRITER_HH
 #define _TRIGGERED_DATA_WRITER_HH
 
+#include <map>
+#include <vector>
 #include "buffered_data_writer.hh"
+#include "signal_detector.hh"
+#include "../midi.hh"
 
 namespace jill { namespace dsp {
 
@@ -17,11 +21,41 @@ namespace jill { namespace dsp {
  *
  * "prebuffering" is provided, so that data before an onset event can be written
  * to disk.  Similarly, the object can be configured to continue writing for
- * some time after an offset event.
+ * some time after an offset event. Blocks are analyzed as they are read from
+ * the head of the queue with peek_ahead(), and held in the ringbuffer until
+ * they are older than the longest pretrigger window.
+ *
+ * By default, each onset starts a new entry. With bursty triggers this makes
+ * many short entries. Optionally, an onset that arrives soon enough after an
+ * offset can extend the current entry instead, so that the entry holds several
+ * recorded segments. The frames between segments aren't written, and the
+ * segments are reported with data_writer::segment(), so the timing of the
+ * data can be recovered.
+ *
+ * Recordings can also be triggered by signal detectors running on sampled
+ * channels in the consumer thread. The detectors see each block as it's read
+ * from the head of the queue, so this avoids the latency of sending trigger
+ * events to the writer through a separate client. An onset or offset from a
+ * detector has the same effect as an event on the trigger channel of the
+ * group the detected channel belongs to.
+ *
+ * Channels can be divided into trigger groups, each with its own trigger
+ * channel, recording state, pre/posttrigger windows, and data_writer (and thus
+ * its own entries). The groups share the ringbuffer and the consumer thread.
+ * The writer passed to the constructor belongs to the default group, which
+ * records all the channels that aren't assigned to another group, and which
+ * also stores log messages.
+ *
+ * As with basic_buffered_data_writer, the type of the data_writer is a template
+ * parameter; triggered_data_writer is the polymorphic form.
  */
-class triggered_data_writer : public buffered_data_writer {
+template <typename Writer>
+class basic_triggered_data_writer : public basic_buffered_data_writer<Writer> {
         friend class triggered_data_writer_test;
 public:
+        using writer_type = Writer;
+        using detector_type = signal_detector<sample_t>;
+
         /**
          * Initialize buffered writer.
          *
@@ -32,31 +66,329 @@ public:
          * @param posttrigger_frames  the number of frames to record from after
          *                            trigger offset events
          */
-        triggered_data_writer(std::unique_ptr<data_writer> writer,
-                              std::string trigger_port,
-                              nframes_t pretrigger_frames, nframes_t posttrigger_frames);
+        basic_triggered_data_writer(std::unique_ptr<writer_type> writer,
+                                    std::string trigger_port,
+                                    nframes_t pretrigger_frames, nframes_t posttrigger_frames)
+                : basic_buffered_data_writer<Writer>(std::move(writer)),
+                  _max_pretrigger(pretrigger_frames), _holdoff(0), _pack(false),
+                  _head(0), _started(false) {
+                DBG << "triggered_data_writer initializing";
+                _groups.emplace_back(std::move(trigger_port), this->_writer.get(),
+                                     pretrigger_frames, posttrigger_frames);
+        }
+
+        ~basic_triggered_data_writer() override {
+                DBG << "triggered_data_writer closing";
+                this->stop();
+                this->join();
+        }
+
+        /**
+         * Add a trigger group. Must be called before start().
+         *
+         * @param writer              the sink for the group's data
+         * @param trigger_port        id of channel carrying the group's trigger events
+         * @param channels            the ids of the channels in the group
+         * @param pretrigger_frames   the number of frames to record from before
+         *                            trigger onset events
+         * @param posttrigger_frames  the number of frames to record from after
+         *                            trigger offset events
+         */
+        void add_trigger_group(std::unique_ptr<writer_type> writer, std::string trigger_port,
+                               std::vector<std::string> const & channels,
+                               nframes_t pretrigger_frames, nframes_t posttrigger_frames) {
+                std::size_t idx = _groups.size();
+                _group_writers.push_back(std::move(writer));
+                _groups.emplace_back(trigger_port, _group_writers.back().get(),
+                                     pretrigger_frames, posttrigger_frames);
+                _group_index[trigger_port] = idx;
+                for (auto const & id : channels)
+                        _group_index[id] = idx;
+                _max_pretrigger = std::max(_max_pretrigger, pretrigger_frames);
+        }
 
-        ~triggered_data_writer() override;
+        /**
+         * Trigger recording with a detector running on a sampled channel. A
+         * group is recording while any of its detectors is open (or until an
+         * offset event on its trigger channel). Must be called before start().
+         *
+         * @param channel   the id of the channel to analyze
+         * @param detector  the detector
+         */
+        void add_detector(std::string const & channel, std::unique_ptr<detector_type> detector) {
+                _detectors[channel] = std::move(detector);
+        }
+
+        /**
+         * Merge triggers into the current entry if the onset arrives within
+         * some time of the previous offset. The entry is kept open for the
+         * hold-off period even if it's longer than the posttrigger period.
+         * Must be called before start().
+         *
+         * @param holdoff_frames  the hold-off period (0 to start a new entry
+         *                        for every onset)
+         */
+        void set_merge_holdoff(nframes_t holdoff_frames) {
+                _holdoff = holdoff_frames;
+        }
+
+        /**
+         * Pack all the triggered segments into the current entry, however far
+         * apart they are. Entries are only closed by a reset (or at exit).
+         * Must be called before start().
+         */
+        void set_pack_segments(bool pack) {
+                _pack = pack;
+        }
 
 protected:
 
         /** @see buffered_data_writer::write() */
-        void write(data_block_t const *) override;
+        void write(data_block_t const * data) override {
+                std::string id = data->id();
+                group_t & group = _groups[group_of(id)];
+                if (!_started || framediff_t(data->time - _head) > 0)
+                        _head = data->time;
+                _started = true;
+
+                /* handle trigger channel */
+                if (data->dtype == EVENT && id == group.trigger_port) {
+                        if (group.recording) {
+                                if (midi::is_offset(data->data(), data->sz_data)) {
+                                        DBG << "trigger off event: port=" << id << ", time=" << data->time;
+                                        stop_recording(group, data->time);
+                                }
+                        }
+                        else {
+                                if (midi::is_onset(data->data(), data->sz_data)) {
+                                        DBG << "trigger on event: port=" << id << ", time=" << data->time;
+                                        start_recording(group, data->time, data);
+                                }
+                        }
+                }
+                else if (data->dtype == SAMPLED && !_detectors.empty()) {
+                        detect(group, data);
+                }
+
+                if (group.recording) {
+                        // Executed when an onset trigger has occurred and
+                        // stop_recording was not called, so write full block.
+                        group.writer->write(data, 0, 0);
+                        advance_written(group, data->time + data->nframes());
+                }
+                else if (group.writer->ready()) {
+                        // executed when stop_recording was called, so we're writing
+                        // post-trigger periods. If enough data has been written, close
+                        // entry. Entries held open for a later onset are
+                        // closed at the end of the hold-off period.
+                        framediff_t compare = group.last_offset - data->time;
+                        if (compare >= 0) {
+                                // (a stop frame of 0 writes the whole block)
+                                nframes_t stop = std::min<nframes_t>(compare, data->nframes());
+                                group.writer->write(data, 0, stop);
+                                advance_written(group, data->time + (stop ? stop : data->nframes()));
+                        }
+                        else if (!holding(group, data->time)) {
+                                group.writer->segment(group.segment_start, group.written);
+                                group.writer->close_entry();
+                        }
+                }
+                // a reset ends the current recordings and entries; otherwise
+                // it's cleared so that it doesn't affect the next ones
+                if (this->take_reset(_head)) {
+                        for (auto & g : _groups) {
+                                if (g.recording) stop_recording(g, this->_reset_frame);
+                                g.hold = false;
+                        }
+                }
+
+                // release blocks on tail of queue that are older than any
+                // group's prebuffer
+                data_block_t const * tail = this->_buffer->peek();
+                while (tail && framediff_t(_head - (tail->time + tail->nframes())) > framediff_t(_max_pretrigger)) {
+                        this->_buffer->release();
+                        tail = this->_buffer->peek();
+                }
+        }
+
+        /** @see buffered_data_writer::drain() */
+        void drain() override {
+                for (auto & g : _groups) {
+                        if (g.writer->ready())
+                                g.writer->segment(g.segment_start, g.written);
+                }
+                for (auto & w : _group_writers) {
+                        w->close_entry();
+                        w->flush();
+                }
+        }
+
+        /** @see buffered_data_writer::write_gap() */
+        void write_gap(char const * id, nframes_t start, nframes_t nframes, gap_cause_t cause) override {
+                _groups[group_of(id)].writer->gap(id, start, nframes, cause);
+        }
+
+        /** @see buffered_data_writer::write_xrun() */
+        void write_xrun() override {
+                for (auto & g : _groups)
+                        g.writer->xrun();
+        }
+
+        /** @see buffered_data_writer::prepare_writer() */
+        bool prepare_writer() override {
+                for (auto & g : _groups) {
+                        if (g.writer->prepare_entry()) return true;
+                }
+                return false;
+        }
+
+        /** @see buffered_data_writer::flush_writer() */
+        void flush_writer() override {
+                for (auto & g : _groups)
+                        g.writer->flush();
+        }
 
 private:
-        /** start recording at time - pretrigger */
-        void start_recording(nframes_t time);
-        /** stop recording at time + posttrigger */
-        void stop_recording(nframes_t time);
+        /* the state of a trigger group */
+        struct group_t {
+                group_t(std::string port, writer_type * w, nframes_t pre, nframes_t post)
+                        : trigger_port(std::move(port)), writer(w), pretrigger(pre),
+                          posttrigger(std::max(post, 1U)), recording(false), hold(false),
+                          last_offset(0), offset_time(0), segment_start(0), written(0),
+                          has_written(false), detecting(0) {}
+                std::string trigger_port;
+                writer_type * writer;
+                nframes_t pretrigger;
+                nframes_t posttrigger;
+                bool recording;         // flag to track whether data are being written
+                bool hold;              // whether the entry is held open after posttrigger
+                nframes_t last_offset;  // track time since last offset
+                nframes_t offset_time;  // time of the last offset
+                nframes_t segment_start; // start of the current segment
+                nframes_t written;      // end of the last data written
+                bool has_written;
+                int detecting;          // number of detectors that are open
+        };
+
+        /* the index of the group a channel belongs to */
+        std::size_t group_of(std::string const & id) const {
+                if (_group_index.empty()) return 0;
+                auto it = _group_index.find(id);
+                return (it == _group_index.end()) ? 0 : it->second;
+        }
 
-        std::string _trigger_port;
-        const nframes_t _pretrigger;
-        const nframes_t _posttrigger;
+        /* run the channel's detector (if any) on a block from the head of the queue */
+        void detect(group_t & group, data_block_t const * data) {
+                auto it = _detectors.find(data->id());
+                if (it == _detectors.end()) return;
+                detector_type & detector = *it->second;
+                auto const * samples = static_cast<sample_t const *>(data->data());
+                int offset = detector.push(samples, data->nframes());
+                if (offset < 0) return;
+                nframes_t time = data->time + offset;
+                if (detector.open()) {
+                        LOG << "signal on: channel=" << it->first << ", frame=" << time;
+                        if (group.detecting++ == 0 && !group.recording)
+                                start_recording(group, time, data);
+                }
+                else {
+                        LOG << "signal off: channel=" << it->first << ", frame=" << time;
+                        if (--group.detecting == 0 && group.recording)
+                                stop_recording(group, time);
+                }
+        }
 
-        bool _recording;        // flag to track whether data are being written
-        nframes_t _last_offset; // track time since last offset
+        /*
+         * Record that the group's data have been written up to end. Event
+         * blocks end before the sampled blocks of the same period, so the
+         * mark only moves forward.
+         */
+        static void advance_written(group_t & group, nframes_t end) {
+                if (!group.has_written || framediff_t(end - group.written) > 0)
+                        group.written = end;
+                group.has_written = true;
+        }
+
+        /* true if the group's entry should be kept open for another onset at time */
+        bool holding(group_t const & group, nframes_t time) const {
+                return group.hold && (_pack || framediff_t(time - group.offset_time) <= framediff_t(_holdoff));
+        }
+
+        /*
+         * This function handles opening a new entry and writing data in the
+         * prebuffer. The event_time argument indicates the time when the
+         * trigger event occurred, so we start at the tail of the ringbuffer
+         * and write the group's blocks from event_time - pretrigger up to the
+         * block at the head of the queue. The prebuffer is shortened if it
+         * would overlap data already written in the previous entry. If the
+         * onset is within the hold-off period, the data are added to the
+         * current entry, and the previous segment is reported so the frames
+         * skipped since then can be accounted for.
+         */
+        void start_recording(group_t & group, nframes_t event_time, data_block_t const * head) {
+                nframes_t onset = event_time - group.pretrigger;
+                if (group.has_written && framediff_t(group.written - onset) > 0)
+                        onset = group.written;
+                if (group.writer->ready() && holding(group, event_time)) {
+                        if (onset != group.written) {
+                                INFO << "extending entry; skipped frames " << group.written << "--" << onset;
+                                group.writer->segment(group.segment_start, group.written);
+                                group.segment_start = onset;
+                        }
+                }
+                else {
+                        if (group.writer->ready())
+                                group.writer->segment(group.segment_start, group.written);
+                        group.writer->new_entry(onset);
+                        group.segment_start = onset;
+                }
+
+                INFO << "writing pretrigger data from " << onset << "--" << event_time;
+                std::size_t idx = &group - _groups.data();
+                for (data_block_t const * ptr = this->_buffer->peek(); ptr && ptr != head;
+                     ptr = this->_buffer->peek_next(ptr)) {
+                        /* skip earlier periods and other groups. Comparisons
+                         * are signed so that they hold when the frame counter
+                         * wraps */
+                        if (framediff_t(ptr->time + ptr->nframes() - onset) <= 0 ||
+                            group_of(ptr->id()) != idx)
+                                continue;
+                        framediff_t start = onset - ptr->time;
+                        DBG << "prebuf frame: t=" << ptr->time << ", on=" << start
+                            << ", id=" << ptr->id() << ", dtype=" << ptr->dtype;
+                        group.writer->write(ptr, (start > 0) ? start : 0, 0);
+                }
+                group.recording = true;
+        }
+
+        /*
+         * this function doesn't close the entry immediately, but sets flags so that
+         * write() will do this at the appropriate time
+         */
+        void stop_recording(group_t & group, nframes_t event_time) {
+                group.recording = false;
+                group.hold = (_holdoff > 0 || _pack);
+                group.offset_time = event_time;
+                group.last_offset = event_time + group.posttrigger;
+                INFO << "writing posttrigger data from " << event_time << "--" << group.last_offset;
+        }
+
+        std::vector<group_t> _groups;                           // default group is first
+        std::vector<std::unique_ptr<writer_type> > _group_writers; // writers for added groups
+        std::map<std::string, std::size_t> _group_index;        // channel and trigger ids
+        std::map<std::string, std::unique_ptr<detector_type> > _detectors; // by channel
+        nframes_t _max_pretrigger;
+        nframes_t _holdoff;     // merge onsets this soon after an offset
+        bool _pack;             // merge all onsets
+        nframes_t _head;        // time of the latest block read
+        bool _started;          // whether _head is valid
 };
 
+/** triggered writer with a runtime-polymorphic sink */
+using triggered_data_writer = basic_triggered_data_writer<data_writer>;
+
+extern template class basic_triggered_data_writer<data_writer>;
+
 }}
 
 #endif
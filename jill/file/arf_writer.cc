@@ -1,4 +1,5 @@
 #include <arf.hpp>
+#include <hdf5_hl.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #define BOOST_UUID_NO_TYPE_TRAITS
 #include <boost/uuid/random_generator.hpp>
@@ -11,6 +12,10 @@
 #include "../midi.hh"
 
 #define JILL_LOGDATASET_NAME "jill_log"
+#define JILL_INDEXDATASET_NAME "jill_entry_index"
+#define JILL_GAPDATASET_NAME "jill_gaps"
+#define JILL_NEXTENTRY_NAME "jill_next_entry"
+#define JILL_SEGMENTDATASET_NAME "jill_segments"
 #define ARF_CHUNK_SIZE 1024
 
 using namespace std;
@@ -39,6 +44,38 @@ struct event_t {
         char const * message;   // message (hex encoded for standard midi status)
 };
 
+/**
+ * @brief Storage format for the entry index
+ */
+struct entry_index_t {
+        char const * name;      // name of the entry
+        std::uint32_t jack_frame; // frame count at entry start
+        std::int64_t sec;       // entry timestamp
+        std::int64_t usec;
+        std::uint32_t duration; // length of the entry (in frames)
+};
+
+/**
+ * @brief Storage format for gaps in the data
+ */
+struct gap_t {
+        std::uint32_t start;    // relative to entry start
+        std::uint32_t nframes;  // number of missing frames
+        char const * channel;   // the channel with missing data
+        char const * cause;     // why the data are missing
+};
+
+/**
+ * @brief Storage format for the segments in an entry
+ */
+struct segment_t {
+        std::uint32_t start;    // relative to entry start
+        std::uint32_t nframes;  // length of the segment
+        std::uint32_t offset;   // frames stored in earlier segments
+};
+
+static char const * gap_causes[] = { "shed", "overrun", "inactive" };
+
 /**
  * convert a midi message to hex
  * @param in   the midi message
@@ -89,6 +126,50 @@ struct datatype_traits<event_t> {
         }
 };
 
+template<>
+struct datatype_traits<entry_index_t> {
+        static hid_t value() {
+                hid_t str = H5Tcopy(H5T_C_S1);
+                H5Tset_size(str, H5T_VARIABLE);
+                H5Tset_cset(str, H5T_CSET_UTF8);
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(entry_index_t));
+                H5Tinsert(ret, "name", HOFFSET(entry_index_t, name), str);
+                H5Tinsert(ret, "jack_frame", HOFFSET(entry_index_t, jack_frame), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "sec", HOFFSET(entry_index_t, sec), H5T_NATIVE_INT64);
+                H5Tinsert(ret, "usec", HOFFSET(entry_index_t, usec), H5T_NATIVE_INT64);
+                H5Tinsert(ret, "duration", HOFFSET(entry_index_t, duration), H5T_NATIVE_UINT32);
+                H5Tclose(str);
+                return ret;
+        }
+};
+
+template<>
+struct datatype_traits<gap_t> {
+        static hid_t value() {
+                hid_t str = H5Tcopy(H5T_C_S1);
+                H5Tset_size(str, H5T_VARIABLE);
+                H5Tset_cset(str, H5T_CSET_UTF8);
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(gap_t));
+                H5Tinsert(ret, "start", HOFFSET(gap_t, start), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "nframes", HOFFSET(gap_t, nframes), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "channel", HOFFSET(gap_t, channel), str);
+                H5Tinsert(ret, "cause", HOFFSET(gap_t, cause), str);
+                H5Tclose(str);
+                return ret;
+        }
+};
+
+template<>
+struct datatype_traits<segment_t> {
+        static hid_t value() {
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(segment_t));
+                H5Tinsert(ret, "start", HOFFSET(segment_t, start), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "nframes", HOFFSET(segment_t, nframes), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "offset", HOFFSET(segment_t, offset), H5T_NATIVE_UINT32);
+                return ret;
+        }
+};
+
 }}}
 
 arf_writer::arf_writer(string const & filename,
@@ -106,6 +187,11 @@ arf_writer::arf_writer(string const & filename,
 
         _file.reset(new arf::file(filename, "a"));
         LOG << "opened file: " << filename;
+        if (_file->contains(JILL_NEXTENTRY_NAME)) {
+                // left over from a crash
+                H5Ldelete(_file->hid(), JILL_NEXTENTRY_NAME, H5P_DEFAULT);
+                INFO << "removed unused entry /" << JILL_NEXTENTRY_NAME;
+        }
         if (!_file->has_attribute("file_creator")) {
                 _file->write_attribute("file_creator", "org.meliza.jill/jrecord " JILL_VERSION);
         }
@@ -125,32 +211,102 @@ arf_writer::arf_writer(string const & filename,
                                                        logtype, ARF_CHUNK_SIZE, _compression));
                 INFO << "created log dataset /" << JILL_LOGDATASET_NAME;
         }
-        _get_last_entry_index();
+
+        // open/create entry index. If the index is missing or doesn't match
+        // the entries in the file, fall back to scanning the file
+        arf::h5t::wrapper<entry_index_t> it;
+        arf::h5t::datatype indextype(it);
+        if (_file->contains(JILL_INDEXDATASET_NAME)) {
+                _index.reset(new arf::h5pt::packet_table(_file->hid(), JILL_INDEXDATASET_NAME));
+                if (indextype != *(_index->datatype())) {
+                        throw arf::Exception(JILL_INDEXDATASET_NAME " has wrong datatype");
+                }
+                if (!_read_entry_index()) {
+                        INFO << "entry index is stale; scanning file";
+                        _get_last_entry_index();
+                }
+        }
+        else {
+                _index.reset(new arf::h5pt::packet_table(_file->hid(), JILL_INDEXDATASET_NAME,
+                                                         indextype, ARF_CHUNK_SIZE, _compression));
+                INFO << "created entry index /" << JILL_INDEXDATASET_NAME;
+                _get_last_entry_index();
+        }
+}
+
+arf_writer::~arf_writer()
+{
+        if (_next_entry) {
+                _next_dsets.clear();
+                _next_entry.reset();
+                H5Ldelete(_file->hid(), JILL_NEXTENTRY_NAME, H5P_DEFAULT);
+        }
 }
 
 void
 arf_writer::new_entry(nframes_t frame_count)
 {
         utime_t frame_usec = 0;
-
-        std::ostringstream name;
-        name << _data_source.name() << '_' << setw(4) << setfill('0') << _entry_idx++;
+        string name = _entry_name(_entry_idx++);
 
         close_entry();
         _entry_start = frame_count;
+        _last_frame = frame_count;
 
-        time_duration ts;
         frame_usec = _data_source.time(_entry_start);
-        ts = (_base_ptime + microseconds(frame_usec - _base_usec)) - epoch;
-
-        _entry.reset(new arf::entry(*_file, name.str(),
-                                    ts.total_seconds(), ts.fractional_seconds()));
+        _entry_time = (_base_ptime + microseconds(frame_usec - _base_usec)) - epoch;
+
+        if (_next_entry) {
+                // commit the prepared entry: give it a name and a timestamp
+                if (H5Lmove(_file->hid(), JILL_NEXTENTRY_NAME, _file->hid(), name.c_str(),
+                            H5P_DEFAULT, H5P_DEFAULT) < 0)
+                        throw arf::Exception("unable to rename prepared entry to " + name);
+                _entry.swap(_next_entry);
+                _next_entry.reset();
+                H5Adelete(_entry->hid(), "timestamp");
+                std::vector<std::int64_t> timestamp = { _entry_time.total_seconds(),
+                                                        _entry_time.fractional_seconds() };
+                _entry->write_attribute("timestamp", timestamp);
+                _dsets.swap(_next_dsets);
+                _next_dsets.clear();
+                for (auto const & dset : _dsets)
+                        _write_dataset_offset(dset.second, dset.first);
+        }
+        else {
+                _entry.reset(new arf::entry(*_file, name,
+                                            _entry_time.total_seconds(),
+                                            _entry_time.fractional_seconds()));
+                _write_entry_attrs(*_entry);
+        }
 
         LOG << "created entry: " << _entry->name() << " (frame=" << _entry_start << ")" ;
 
         arf::h5a::node::attr_writer a = _entry->write_attribute();
         a("jack_frame", _entry_start);
         a("jack_usec", frame_usec);
+}
+
+bool
+arf_writer::prepare_entry()
+{
+        // one step at a time, so the caller can get back to writing data
+        if (!_next_entry) {
+                _next_entry.reset(new arf::entry(*_file, JILL_NEXTENTRY_NAME, 0, 0));
+                _write_entry_attrs(*_next_entry);
+                return true;
+        }
+        for (auto const & chan : _channels) {
+                if (_next_dsets.find(chan.first) != _next_dsets.end()) continue;
+                _next_dsets[chan.first] = create_dataset(*_next_entry, chan.first, chan.second);
+                return true;
+        }
+        return false;
+}
+
+void
+arf_writer::_write_entry_attrs(arf::entry & entry)
+{
+        arf::h5a::node::attr_writer a = entry.write_attribute();
         a("jack_sampling_rate", _data_source.sampling_rate());
         a("entry_creator", "org.meliza.jill/jrecord " JILL_VERSION);
         for_each(_attrs.begin(), _attrs.end(), a);
@@ -159,14 +315,45 @@ arf_writer::new_entry(nframes_t frame_count)
 void
 arf_writer::close_entry()
 {
+        // finish decimated channels with the samples that are waiting on
+        // future input; the filter state carries over to the next entry
+        for (auto const & dec : _decimators) {
+                auto dset = _dsets.find(dec.first);
+                if (dset == _dsets.end()) continue;
+                nframes_t frame;
+                std::size_t n = dec.second.flush(_decimated, frame);
+                _write_decimated(dset->second, dec.second, frame, n);
+        }
+        // datasets are created ahead of time for every channel seen so far,
+        // so remove the ones that got no data in this entry
+        std::vector<string> empty;
+        for (auto const & dset : _dsets) {
+                hsize_t nrecords = 0;
+                H5PTget_num_packets(dset.second->hid(), &nrecords);
+                if (nrecords == 0) empty.push_back(dset.first);
+        }
         _dsets.clear();         // release any old packet tables
         if (_entry) {
+                for (auto const & name : empty)
+                        H5Ldelete(_entry->hid(), name.c_str(), H5P_DEFAULT);
+                _write_gaps(true);
+                _gap_table.reset();
+                _write_segments();
                 LOG << "closed entry: " << _entry->name() << " (frame=" << _last_frame << ")";
                 _entry->write_attribute("trial_off", _last_frame - _entry_start);
                 // if (!aligned())
                 //         o << " (warning: unequal dataset length)";
+                string name = _entry->name();
+                // strip leading slash from path
+                if (!name.empty() && name[0] == '/') name.erase(0, 1);
+                entry_index_t rec = { name.c_str(), _entry_start,
+                                      _entry_time.total_seconds(), _entry_time.fractional_seconds(),
+                                      _last_frame - _entry_start };
+                _index->write(&rec, 1);
+                _entry.reset();
+                // closing an entry is a natural checkpoint
+                if (_file) _file->flush();
         }
-        _entry.reset();
 }
 
 bool
@@ -207,7 +394,20 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
         if (data->dtype == SAMPLED) {
                 dset = get_dataset(id, true);
                 auto * samples = reinterpret_cast<sample_t const *>(data->data());
-                dset->second->write(samples + start_frame, stop_frame - start_frame);
+                auto dec = _decimators.find(id);
+                if (dec == _decimators.end()) {
+                        dset->second->write(samples + start_frame, stop_frame - start_frame);
+                }
+                else {
+                        // restart the filter if the channel isn't continuous
+                        nframes_t frame = data->time + start_frame;
+                        if (dec->second.next_frame() != frame)
+                                dec->second.reset(frame);
+                        std::size_t n = dec->second.process(samples + start_frame,
+                                                            stop_frame - start_frame,
+                                                            _decimated, frame);
+                        _write_decimated(dset->second, dec->second, frame, n);
+                }
         }
         else if (data->dtype == EVENT) {
                 char * message = nullptr;
@@ -223,7 +423,127 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
                 dset->second->write(&e, 1);
                 if (message) delete[] message;
         }
-        _last_frame = data->time + stop_frame;
+        // channels may be written in partial blocks, so only move forward
+        if (framediff_t(data->time + stop_frame - _last_frame) > 0)
+                _last_frame = data->time + stop_frame;
+}
+
+void
+arf_writer::set_decimation(string const & id, unsigned int factor)
+{
+        if (factor <= 1) {
+                _decimators.erase(id);
+                return;
+        }
+        if (_data_source.sampling_rate() % factor)
+                LOG << "warning: sampling rate of " << id << " is not a multiple of " << factor;
+        _decimators.erase(id);
+        _decimators.emplace(id, dsp::fir_decimator(factor));
+        LOG << "decimating " << id << " by " << factor << " ("
+            << _data_source.sampling_rate() / factor << " Hz)";
+}
+
+void
+arf_writer::_write_decimated(arf::packet_table_ptr const & pt, dsp::fir_decimator const & dec,
+                             nframes_t frame, std::size_t n)
+{
+        // outputs before the start of the entry belong to the previous one
+        std::size_t skip = 0;
+        while (skip < n && framediff_t(frame + skip * dec.factor() - _entry_start) < 0)
+                ++skip;
+        if (skip < n)
+                pt->write(_decimated.data() + skip, n - skip);
+}
+
+void
+arf_writer::gap(string const & id, nframes_t frame, nframes_t nframes, gap_cause_t cause)
+{
+        // merge with the open run for the channel if contiguous
+        for (auto it = _gaps.rbegin(); it != _gaps.rend(); ++it) {
+                if (it->id == id && !it->done) {
+                        if (it->cause == cause && it->start + it->nframes == frame) {
+                                it->nframes += nframes;
+                                return;
+                        }
+                        it->done = true;
+                        break;
+                }
+        }
+        _gaps.push_back({id, frame, nframes, cause, false});
+        if (_entry) _write_gaps(false);
+}
+
+void
+arf_writer::_write_gaps(bool closing)
+{
+        framediff_t entry_len = _last_frame - _entry_start;
+        for (auto it = _gaps.begin(); it != _gaps.end();) {
+                // gap boundaries relative to entry start
+                framediff_t start = it->start - _entry_start;
+                framediff_t stop = start + framediff_t(it->nframes);
+                // runs that may still grow, or that the data hasn't reached
+                // yet, may belong to a later entry
+                if (!closing && (!it->done || stop > entry_len)) {
+                        ++it;
+                        continue;
+                }
+                if (_entry && stop > 0 && start < entry_len) {
+                        if (!_gap_table) {
+                                _gap_table = _entry->create_packet_table<gap_t>(JILL_GAPDATASET_NAME,
+                                                                                "samples", arf::INTERVAL,
+                                                                                false, ARF_CHUNK_SIZE,
+                                                                                _compression);
+                        }
+                        start = std::max<framediff_t>(start, 0);
+                        stop = std::min(stop, entry_len);
+                        gap_t g = { std::uint32_t(start), std::uint32_t(stop - start),
+                                    it->id.c_str(), gap_causes[it->cause] };
+                        _gap_table->write(&g, 1);
+                        if (it->cause != INACTIVE)
+                                LOG << "missing data: " << it->id << " (frame=" << it->start
+                                    << ", n=" << it->nframes << ", cause=" << gap_causes[it->cause] << ")";
+                }
+                // keep the part of a gap that extends past the end of the entry
+                if (stop <= entry_len)
+                        it = _gaps.erase(it);
+                else {
+                        if (start < entry_len) {
+                                it->start = _last_frame;
+                                it->nframes = stop - entry_len;
+                        }
+                        ++it;
+                }
+        }
+}
+
+void
+arf_writer::segment(nframes_t onset, nframes_t offset)
+{
+        if (_entry) _segments.push_back({ onset, offset });
+}
+
+void
+arf_writer::_write_segments()
+{
+        // an entry with one segment doesn't need an index
+        if (_segments.size() > 1) {
+                // the data in sampled datasets are packed, so each segment
+                // starts after the frames stored for earlier ones
+                std::vector<segment_t> records;
+                std::uint32_t packed = 0;
+                for (auto const & seg : _segments) {
+                        segment_t rec = { seg.onset - _entry_start, seg.offset - seg.onset, packed };
+                        records.push_back(rec);
+                        packed += rec.nframes;
+                }
+                arf::packet_table_ptr pt =
+                        _entry->create_packet_table<segment_t>(JILL_SEGMENTDATASET_NAME, "samples",
+                                                               arf::INTERVAL, false,
+                                                               ARF_CHUNK_SIZE, _compression);
+                pt->write(records.data(), records.size());
+                LOG << "stored " << _segments.size() << " segments in " << _entry->name();
+        }
+        _segments.clear();
 }
 
 void
@@ -243,6 +563,62 @@ arf_writer::log(timestamp_t utc, string source, string msg)
         _log->write(&message, 1);
 }
 
+void
+arf_writer::log_messages(vector<log_message_t> const & messages)
+{
+        // append all the messages in one call to the packet table
+        vector<string> text;
+        vector<message_t> records;
+        text.reserve(messages.size());
+        records.reserve(messages.size());
+        for (auto const & m : messages) {
+                text.push_back("[" + m.source + "] " + m.message);
+                time_duration t = m.time - epoch;
+                records.push_back({ t.total_seconds(), t.fractional_seconds(), text.back().c_str() });
+        }
+        if (!records.empty())
+                _log->write(records.data(), records.size());
+}
+
+string
+arf_writer::_entry_name(std::size_t idx) const
+{
+        std::ostringstream name;
+        name << _data_source.name() << '_' << setw(4) << setfill('0') << idx;
+        return name.str();
+}
+
+bool
+arf_writer::_read_entry_index()
+{
+        hsize_t nrecords = 0;
+        unsigned int val;
+        size_t srclen = strlen(_data_source.name());
+        H5PTget_num_packets(_index->hid(), &nrecords);
+        if (nrecords > 0) {
+                vector<entry_index_t> records(nrecords);
+                if (H5PTread_packets(_index->hid(), 0, nrecords, records.data()) < 0) {
+                        return false;
+                }
+                for (auto & rec : records) {
+                        if (rec.name == nullptr || strncmp(rec.name, _data_source.name(), srclen) != 0)
+                                continue;
+                        if (sscanf(rec.name + srclen, "_%u", &val) == 1 && val + 1 > _entry_idx)
+                                _entry_idx = val + 1;
+                }
+                H5PTfree_vlen_buff(_index->hid(), nrecords, records.data());
+        }
+        // the index is stale if the next entry already exists (e.g. from a
+        // crash before the entry was closed) or the last indexed entry is gone
+        if (H5Lexists(_file->hid(), _entry_name(_entry_idx).c_str(), H5P_DEFAULT) > 0)
+                return false;
+        if (_entry_idx > 0 &&
+            H5Lexists(_file->hid(), _entry_name(_entry_idx - 1).c_str(), H5P_DEFAULT) <= 0)
+                return false;
+        INFO << "last entry index (from /" JILL_INDEXDATASET_NAME "): " << _entry_idx;
+        return true;
+}
+
 void
 arf_writer::_get_last_entry_index()
 {
@@ -261,6 +637,18 @@ arf_writer::_get_last_entry_index()
 
 arf_writer::dset_map_type::iterator
 arf_writer::get_dataset(string const & name, bool is_sampled)
+{
+        auto dset = _dsets.find(name);
+        if (dset == _dsets.end()) {
+                arf::packet_table_ptr pt = create_dataset(*_entry, name, is_sampled);
+                _write_dataset_offset(pt, name);
+                dset = _dsets.insert(dset, make_pair(name,pt));
+        }
+        return dset;
+}
+
+arf::packet_table_ptr
+arf_writer::create_dataset(arf::entry & entry, string const & name, bool is_sampled)
 {
         auto uuid = _dset_uuids.find(name);
         if (uuid == _dset_uuids.end()) {
@@ -269,26 +657,40 @@ arf_writer::get_dataset(string const & name, bool is_sampled)
                 uuid = _dset_uuids.insert(uuid, make_pair(name, _uuid));
                 INFO << "uuid for " << name << ": " << uuid->second;
         }
-
-        auto dset = _dsets.find(name);
-        if (dset == _dsets.end()) {
-                arf::packet_table_ptr pt;
-                if (is_sampled) {
-                        pt = _entry->create_packet_table<sample_t>(name, "", arf::UNDEFINED,
-                                                                   false, ARF_CHUNK_SIZE,
-                                                                   _compression);
-                }
-                else {
-                        pt = _entry->create_packet_table<event_t>(name, "samples", arf::EVENT,
-                                                                  false, ARF_CHUNK_SIZE,
-                                                                  _compression);
-                }
+        // remember the channel so it can be created ahead of time in the next entry
+        _channels[name] = is_sampled;
+
+        arf::packet_table_ptr pt;
+        if (is_sampled) {
+                pt = entry.create_packet_table<sample_t>(name, "", arf::UNDEFINED,
+                                                         false, ARF_CHUNK_SIZE,
+                                                         _compression);
+        }
+        else {
+                pt = entry.create_packet_table<event_t>(name, "samples", arf::EVENT,
+                                                        false, ARF_CHUNK_SIZE,
+                                                        _compression);
+        }
+        auto dec = _decimators.find(name);
+        if (is_sampled && dec != _decimators.end()) {
+                unsigned int factor = dec->second.factor();
+                pt->write_attribute("sampling_rate", _data_source.sampling_rate() / factor);
+                pt->write_attribute("decimation", factor);
+        }
+        else {
                 pt->write_attribute("sampling_rate", _data_source.sampling_rate());
-                pt->write_attribute("uuid", uuid->second);
-                LOG << "created dataset: " << pt->name();
-                dset = _dsets.insert(dset, make_pair(name,pt));
         }
+        pt->write_attribute("uuid", uuid->second);
+        LOG << "created dataset: " << pt->name();
+        return pt;
+}
 
-        return dset;
-
+void
+arf_writer::_write_dataset_offset(arf::packet_table_ptr const & pt, string const & name)
+{
+        auto dec = _decimators.find(name);
+        if (dec == _decimators.end() || !_channels[name]) return;
+        // decimated outputs are aligned to multiples of the factor
+        unsigned int factor = dec->second.factor();
+        pt->write_attribute("decimation_offset", (factor - _entry_start % factor) % factor);
 }
@@ -1,12 +1,15 @@
 #ifndef _ARF_WRITER_HH
 #define _ARF_WRITER_HH
 
+#include <deque>
 #include <map>
 #include <string>
+#include <vector>
 #include <iosfwd>
 #include <arf/types.hpp>
 
 #include "../data_writer.hh"
+#include "../dsp/fir_decimator.hh"
 
 namespace jill {
 
@@ -15,9 +18,11 @@ namespace jill {
 namespace file {
 
 /**
- * Class for storing data in an ARF file. Access is not thread-safe.
+ * Class for storing data in an ARF file. Access is not thread-safe. The class
+ * is final so that basic_buffered_data_writer<arf_writer> can bind its calls
+ * statically.
  */
-class arf_writer : public data_writer {
+class arf_writer final : public data_writer {
 public:
         /**
          * Initialize an ARF writer.
@@ -32,7 +37,7 @@ public:
                    jill::data_source const & source,
                    std::map<std::string,std::string> entry_attrs,
                    int compression=0);
-        ~arf_writer() override = default;
+        ~arf_writer() override;
 
         /* data_writer overrides */
         bool ready() const override;
@@ -40,8 +45,25 @@ public:
         void close_entry() override;
         void xrun() override;
         void write(data_block_t const *, nframes_t, nframes_t) override;
+        void gap(std::string const &, nframes_t, nframes_t, gap_cause_t) override;
+        void segment(nframes_t, nframes_t) override;
         void log(timestamp_t, std::string, std::string) override;
+        void log_messages(std::vector<log_message_t> const &) override;
         void flush() override;
+        bool prepare_entry() override;
+
+        /**
+         * Store a sampled channel at a reduced sampling rate. The data are
+         * lowpass filtered and decimated as they are written. The filter state
+         * is carried across blocks and entries as long as the channel is
+         * continuous. The sampling_rate attribute of the dataset is set to the
+         * decimated rate, and the first sample of the dataset is at
+         * decimation_offset frames from the start of the entry.
+         *
+         * @param id      the name of the channel
+         * @param factor  the decimation factor (1 to store at the full rate)
+         */
+        void set_decimation(std::string const & id, unsigned int factor);
 
 protected:
         typedef std::map<std::string, arf::packet_table_ptr> dset_map_type;
@@ -55,9 +77,49 @@ protected:
          */
         dset_map_type::iterator get_dataset(std::string const & name, bool is_sampled);
 
+        /** Create a dataset (channel) in an entry */
+        arf::packet_table_ptr create_dataset(arf::entry & entry, std::string const & name,
+                                             bool is_sampled);
+
 private:
-        /* find last entry index */
+        /* a run of missing frames in a channel */
+        struct gap_record_t {
+                std::string id;
+                nframes_t start;
+                nframes_t nframes;
+                gap_cause_t cause;
+                bool done;              // a later run has started in the channel
+        };
+
+        /* a recorded segment of the current entry */
+        struct segment_record_t {
+                nframes_t onset;
+                nframes_t offset;
+        };
+
+        /* write decimated samples that fall in the current entry */
+        void _write_decimated(arf::packet_table_ptr const & pt, dsp::fir_decimator const & dec,
+                              nframes_t frame, std::size_t n);
+
+        /* write the attributes that don't depend on the entry's start time */
+        void _write_entry_attrs(arf::entry & entry);
+        /* write the attributes that depend on the entry's start time */
+        void _write_dataset_offset(arf::packet_table_ptr const & pt, std::string const & name);
+
+        /*
+         * store finished gaps that the data has passed, or all gaps that
+         * overlap the current entry if it's closing, and discard older ones
+         */
+        void _write_gaps(bool closing);
+        /* store the index of segments in the current entry */
+        void _write_segments();
+
+        /* find last entry index by scanning the entries in the file */
         void _get_last_entry_index();
+        /* find last entry index from the index dataset. false if stale */
+        bool _read_entry_index();
+        /* name of the entry with index idx */
+        std::string _entry_name(std::size_t idx) const;
 
         // references
         jill::data_source const & _data_source;
@@ -66,10 +128,19 @@ private:
         arf::file_ptr _file;                       // output file
         std::map<std::string, std::string> _attrs; // attributes for new entries
         arf::packet_table_ptr _log;                // log dataset
+        arf::packet_table_ptr _index;              // entry index dataset
         arf::entry_ptr _entry;                     // current entry (owned by thread)
         dset_map_type _dsets;                      // pointers to packet tables (owned)
+        arf::entry_ptr _next_entry;                // entry prepared ahead of time
+        dset_map_type _next_dsets;                 // packet tables in _next_entry
+        std::map<std::string, bool> _channels;     // channels seen (and if sampled)
         std::map<std::string, std::string> _dset_uuids; // session/channel uuid
+        std::deque<gap_record_t> _gaps;            // gaps not yet stored in an entry
+        arf::packet_table_ptr _gap_table;          // gap records in the current entry
+        std::vector<segment_record_t> _segments; // segments in the current entry
         int _compression;                          // compression level for new datasets
+        std::map<std::string, dsp::fir_decimator> _decimators; // decimated channels
+        std::vector<sample_t> _decimated;          // output buffer for decimators
 
         // these variables allow more precise timestamps; they are registered to
         // each other when set_data_source is called
@@ -78,6 +149,7 @@ private:
 
         // local state
         nframes_t _entry_start;                    // offset sample counts
+        boost::posix_time::time_duration _entry_time; // timestamp of current entry
         nframes_t _last_frame;                     // last frame written to the
                                                    // current entry
         std::size_t _entry_idx;                    // manage entry numbering
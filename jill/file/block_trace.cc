@@ -0,0 +1,187 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cstring>
+
+#include "../logging.hh"
+#include "../util/thread_config.hh"
+#include "block_trace.hh"
+
+using namespace jill;
+using namespace jill::file;
+using std::string;
+
+static char const trace_magic[] = "JILLTRC1";
+
+block_trace_recorder::block_trace_recorder(string const & path, nframes_t sampling_rate,
+                                           nframes_t period_size, std::size_t buffer_size)
+        : _state(Stopped), _fp(std::fopen(path.c_str(), "wb")),
+          _buffer(new dsp::block_ringbuffer(buffer_size)),
+          _last_time(0), _dropped(0)
+{
+        if (!_fp) throw FileError("unable to open trace file " + path);
+        std::uint32_t header[2] = { sampling_rate, period_size };
+        std::fwrite(trace_magic, 8, 1, _fp);
+        std::fwrite(header, sizeof(header), 1, _fp);
+        LOG << "recording block trace to " << path;
+}
+
+block_trace_recorder::~block_trace_recorder()
+{
+        stop();
+        join();
+        if (_dropped)
+                LOG << "block trace is incomplete: " << _dropped << " calls were not recorded";
+        std::fclose(_fp);
+}
+
+void
+block_trace_recorder::push(nframes_t time, dtype_t dtype, char const * id,
+                           std::size_t size, void const * data)
+{
+        if (_state == Stopping) return;
+        _last_time = time;
+        if (_buffer->push(time, dtype, id, size, data) == 0)
+                __sync_add_and_fetch(&_dropped, 1);
+}
+
+void
+block_trace_recorder::push_op(trace_op_t op)
+{
+        // other calls are stored as blocks with no id and the op as data
+        char c = op;
+        if (_state == Stopping) return;
+        if (_buffer->push(_last_time, SAMPLED, "", 1, &c) == 0)
+                __sync_add_and_fetch(&_dropped, 1);
+}
+
+void
+block_trace_recorder::data_ready()
+{
+        push_op(TRACE_DATA_READY);
+        _ready.notify_one();
+}
+
+void
+block_trace_recorder::xrun()
+{
+        push_op(TRACE_XRUN);
+}
+
+void
+block_trace_recorder::reset()
+{
+        push_op(TRACE_RESET);
+}
+
+void
+block_trace_recorder::stop()
+{
+        // release condition variable to prevent deadlock
+        if (__sync_bool_compare_and_swap(&_state, Running, Stopping))
+                _ready.notify_one();
+}
+
+void
+block_trace_recorder::start()
+{
+        if (_state == Stopped) {
+                _state = Running;
+                _thread = std::thread(&block_trace_recorder::thread, this);
+        }
+}
+
+void
+block_trace_recorder::join()
+{
+        if (_thread.joinable())
+                _thread.join();
+}
+
+std::size_t
+block_trace_recorder::request_buffer_size(std::size_t bytes)
+{
+        // block until the buffer is empty
+        std::lock_guard<std::mutex> lck(_lock);
+        if (bytes > _buffer->size()) {
+                _buffer->resize(bytes);
+        }
+        return _buffer->size();
+}
+
+void
+block_trace_recorder::thread()
+{
+        data_block_t const * hdr;
+        util::configure_thread("trace recorder");
+        std::unique_lock<std::mutex> lck(_lock);
+        while (true) {
+                hdr = _buffer->peek();
+                if (!hdr) {
+                        if (_state == Stopping) break;
+                        std::fflush(_fp);
+                        _ready.wait(lck, [this]{ return(_state == Stopping || _buffer->peek()); });
+                        continue;
+                }
+                trace_record_t rec;
+                rec.time = hdr->time;
+                rec.dtype = hdr->dtype;
+                if (hdr->sz_id == 0) {
+                        rec.op = *static_cast<char const *>(hdr->data());
+                        rec.sz_id = rec.sz_data = 0;
+                        std::fwrite(&rec, sizeof(rec), 1, _fp);
+                }
+                else {
+                        rec.op = TRACE_PUSH;
+                        rec.sz_id = hdr->sz_id;
+                        rec.sz_data = hdr->sz_data;
+                        std::fwrite(&rec, sizeof(rec), 1, _fp);
+                        std::fwrite(hdr + 1, hdr->sz_id + hdr->sz_data, 1, _fp);
+                }
+                _buffer->release();
+        }
+        std::fflush(_fp);
+        _state = Stopped;
+}
+
+
+block_trace_reader::block_trace_reader(string const & path)
+        : _fp(std::fopen(path.c_str(), "rb"))
+{
+        char magic[8];
+        std::uint32_t header[2];
+        if (!_fp) throw FileError("unable to open trace file " + path);
+        if (std::fread(magic, 8, 1, _fp) != 1 || memcmp(magic, trace_magic, 8) != 0 ||
+            std::fread(header, sizeof(header), 1, _fp) != 1) {
+                std::fclose(_fp);
+                throw FileError(path + " is not a block trace");
+        }
+        _sampling_rate = header[0];
+        _period_size = header[1];
+}
+
+block_trace_reader::~block_trace_reader()
+{
+        std::fclose(_fp);
+}
+
+bool
+block_trace_reader::next(trace_record_t & record, string & id, std::vector<char> & data)
+{
+        if (std::fread(&record, sizeof(record), 1, _fp) != 1)
+                return false;
+        id.resize(record.sz_id);
+        data.resize(record.sz_data);
+        if ((record.sz_id && std::fread(&id[0], record.sz_id, 1, _fp) != 1) ||
+            (record.sz_data && std::fread(data.data(), record.sz_data, 1, _fp) != 1))
+                throw FileError("block trace is truncated");
+        return true;
+}
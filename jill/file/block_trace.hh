@@ -0,0 +1,148 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _BLOCK_TRACE_HH
+#define _BLOCK_TRACE_HH
+
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+#include "../data_thread.hh"
+#include "../dsp/block_ringbuffer.hh"
+
+/*
+ * # Block trace format
+ *
+ * A block trace is a record of the calls a program makes to a data_thread, so
+ * that a session can be replayed offline into any writer. The file starts with
+ * the 8-byte magic string "JILLTRC1" and the sampling rate (uint32) and period
+ * size (uint32) of the session. This is followed by one record per call,
+ * consisting of a trace_record_t header and, for push() calls, the id and the
+ * data. All values are in native byte order.
+ */
+
+namespace jill { namespace file {
+
+/** The calls recorded in a block trace */
+enum trace_op_t {
+        TRACE_PUSH = 0,
+        TRACE_DATA_READY = 1,
+        TRACE_XRUN = 2,
+        TRACE_RESET = 3,
+};
+
+/** The header of a record in a block trace */
+struct trace_record_t {
+        std::uint32_t time;     // time of the block; for other calls, time of the last block
+        std::uint8_t op;        // trace_op_t
+        std::uint8_t dtype;     // dtype_t (push only)
+        std::uint16_t sz_id;    // number of bytes in the id
+        std::uint32_t sz_data;  // number of bytes in the data
+};
+static_assert(sizeof(trace_record_t) == 12, "trace_record_t must be packed");
+
+/**
+ * A data_thread that records the calls made to it in a block trace. Calls are
+ * stored in a ringbuffer and written to disk by a background thread, so
+ * push(), data_ready(), xrun() and reset() are wait-free. Programs can call
+ * the recorder alongside the data_thread that does the real work.
+ */
+class block_trace_recorder : public data_thread {
+
+public:
+        /**
+         * Open a trace file for writing.
+         *
+         * @param path           the path of the file. Truncated if it exists.
+         * @param sampling_rate  the sampling rate of the data
+         * @param period_size    the number of frames in each period
+         * @param buffer_size    the initial size of the ringbuffer (in bytes)
+         *
+         * @throws FileError if the file can't be opened
+         */
+        block_trace_recorder(std::string const & path, nframes_t sampling_rate,
+                             nframes_t period_size, std::size_t buffer_size=1 << 20);
+        ~block_trace_recorder() override;
+
+        void push(nframes_t time, dtype_t dtype, char const * id,
+                  std::size_t size, void const * data) override;
+        void data_ready() override;
+        void xrun() override;
+        void reset() override;
+        void stop() override;
+        void start() override;
+        void join() override;
+        std::size_t request_buffer_size(std::size_t bytes) override;
+
+        /** @return the number of calls that were not recorded because the buffer was full */
+        std::size_t dropped() const { return _dropped; }
+
+private:
+        /* record a call other than push() */
+        void push_op(trace_op_t op);
+        /* the writer thread */
+        void thread();
+
+        state_t _state;
+        std::FILE * _fp;
+        std::unique_ptr<dsp::block_ringbuffer> _buffer;
+        nframes_t _last_time;
+        std::size_t _dropped;
+
+        std::thread _thread;
+        std::mutex _lock;
+        std::condition_variable _ready;
+};
+
+/**
+ * Reads the records in a block trace.
+ */
+class block_trace_reader : boost::noncopyable {
+
+public:
+        /**
+         * Open a trace file for reading.
+         *
+         * @throws FileError if the file can't be opened or isn't a block trace
+         */
+        explicit block_trace_reader(std::string const & path);
+        ~block_trace_reader();
+
+        nframes_t sampling_rate() const { return _sampling_rate; }
+        nframes_t period_size() const { return _period_size; }
+
+        /**
+         * Read the next record.
+         *
+         * @param record  the header of the record
+         * @param id      the id of the block (push only)
+         * @param data    the data of the block (push only)
+         * @return false if there are no more records
+         * @throws FileError if the file is truncated
+         */
+        bool next(trace_record_t & record, std::string & id, std::vector<char> & data);
+
+private:
+        std::FILE * _fp;
+        nframes_t _sampling_rate;
+        nframes_t _period_size;
+};
+
+}}
+
+#endif
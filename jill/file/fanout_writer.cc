@@ -0,0 +1,259 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "fanout_writer.hh"
+#include "../logging.hh"
+#include "../util/thread_config.hh"
+
+using namespace jill;
+using namespace jill::file;
+using std::string;
+
+fanout_writer::fanout_writer(std::vector<std::unique_ptr<data_writer> > children,
+                             std::size_t queue_size)
+        : _queue_size(queue_size), _entry(false)
+{
+        for (auto & writer : children) {
+                std::unique_ptr<child_t> child(new child_t);
+                child->writer = std::move(writer);
+                child->queued_bytes = 0;
+                child->dropped = false;
+                child->running = true;
+                _children.push_back(std::move(child));
+        }
+        for (auto & child : _children) {
+                child->thread = std::thread(&fanout_writer::run, this, std::ref(*child));
+        }
+        DBG << "fanout_writer initialized with " << _children.size() << " children";
+}
+
+fanout_writer::~fanout_writer()
+{
+        // workers drain their queues before exiting
+        for (auto & child : _children) {
+                {
+                        std::lock_guard<std::mutex> lck(child->lock);
+                        child->running = false;
+                }
+                child->ready.notify_one();
+        }
+        for (auto & child : _children) {
+                if (child->thread.joinable()) child->thread.join();
+        }
+}
+
+bool
+fanout_writer::ready() const
+{
+        return _entry;
+}
+
+void
+fanout_writer::new_entry(nframes_t frame)
+{
+        broadcast(command_t::NEW_ENTRY, frame);
+        _entry = true;
+}
+
+void
+fanout_writer::close_entry()
+{
+        if (!_entry) return;
+        broadcast(command_t::CLOSE_ENTRY);
+        _entry = false;
+}
+
+void
+fanout_writer::xrun()
+{
+        broadcast(command_t::XRUN);
+}
+
+void
+fanout_writer::write(data_block_t const * data, nframes_t start, nframes_t stop)
+{
+        // open an entry in all the children at the same frame
+        if (!_entry) new_entry(data->time);
+        char const * ptr = reinterpret_cast<char const *>(data);
+        for (auto & child : _children) {
+                command_t cmd;
+                cmd.op = command_t::WRITE;
+                cmd.block.assign(ptr, ptr + data->size());
+                cmd.start = start;
+                cmd.stop = stop;
+                enqueue(*child, std::move(cmd));
+        }
+}
+
+void
+fanout_writer::gap(string const & id, nframes_t frame, nframes_t nframes, gap_cause_t cause)
+{
+        for (auto & child : _children) {
+                command_t cmd;
+                cmd.op = command_t::GAP;
+                cmd.id = id;
+                cmd.frame = frame;
+                cmd.nframes = nframes;
+                cmd.cause = cause;
+                enqueue(*child, std::move(cmd));
+        }
+}
+
+void
+fanout_writer::segment(nframes_t onset, nframes_t offset)
+{
+        for (auto & child : _children) {
+                command_t cmd;
+                cmd.op = command_t::SEGMENT;
+                cmd.start = onset;
+                cmd.stop = offset;
+                enqueue(*child, std::move(cmd));
+        }
+}
+
+void
+fanout_writer::log(timestamp_t time, string source, string message)
+{
+        for (auto & child : _children) {
+                command_t cmd;
+                cmd.op = command_t::MESSAGE;
+                cmd.time = time;
+                cmd.source = source;
+                cmd.message = message;
+                enqueue(*child, std::move(cmd));
+        }
+}
+
+void
+fanout_writer::flush()
+{
+        broadcast(command_t::FLUSH);
+}
+
+void
+fanout_writer::broadcast(command_t::op_t op, nframes_t frame)
+{
+        for (auto & child : _children) {
+                command_t cmd;
+                cmd.op = op;
+                cmd.frame = frame;
+                enqueue(*child, std::move(cmd));
+        }
+}
+
+void
+fanout_writer::enqueue(child_t & child, command_t && cmd)
+{
+        {
+                std::lock_guard<std::mutex> lck(child.lock);
+                if (cmd.op == command_t::WRITE) {
+                        if (child.queued_bytes + cmd.block.size() > _queue_size) {
+                                // only data are dropped; entry boundaries are
+                                // always passed on. The child is told which
+                                // frames are missing.
+                                data_block_t const * data =
+                                        reinterpret_cast<data_block_t const *>(cmd.block.data());
+                                nframes_t stop = (cmd.stop > 0) ? std::min(cmd.stop, data->nframes())
+                                        : data->nframes();
+                                queue_gap(child, data->id(), data->time + cmd.start,
+                                          stop - cmd.start);
+                                child.dropped = true;
+                                return;
+                        }
+                        child.queued_bytes += cmd.block.size();
+                }
+                child.queue.push_back(std::move(cmd));
+        }
+        child.ready.notify_one();
+}
+
+void
+fanout_writer::queue_gap(child_t & child, string const & id, nframes_t frame, nframes_t nframes)
+{
+        // extend the last gap if it is contiguous with this one
+        for (auto it = child.queue.rbegin(); it != child.queue.rend(); ++it) {
+                if (it->op != command_t::GAP) break;
+                if (it->id == id && it->cause == OVERRUN && it->frame + it->nframes == frame) {
+                        it->nframes += nframes;
+                        return;
+                }
+        }
+        command_t cmd;
+        cmd.op = command_t::GAP;
+        cmd.id = id;
+        cmd.frame = frame;
+        cmd.nframes = nframes;
+        cmd.cause = OVERRUN;
+        child.queue.push_back(std::move(cmd));
+}
+
+void
+fanout_writer::run(child_t & child)
+{
+        util::configure_thread("fanout writer");
+        std::unique_lock<std::mutex> lck(child.lock);
+        while (true) {
+                if (child.queue.empty()) {
+                        if (child.dropped) {
+                                // queue has drained after an overrun
+                                LOG << "fanout queue overrun";
+                                child.dropped = false;
+                        }
+                        if (!child.running) break;
+                        // prepare the next entry when the load is light
+                        while (child.running && child.queue.empty()) {
+                                lck.unlock();
+                                bool more = child.writer->prepare_entry();
+                                lck.lock();
+                                if (!more) break;
+                        }
+                        child.ready.wait(lck, [&]{ return !child.running || !child.queue.empty(); });
+                        continue;
+                }
+                command_t cmd = std::move(child.queue.front());
+                child.queue.pop_front();
+                child.queued_bytes -= cmd.block.size();
+                // the writer is only accessed by this thread
+                lck.unlock();
+                switch (cmd.op) {
+                case command_t::NEW_ENTRY:
+                        child.writer->new_entry(cmd.frame);
+                        break;
+                case command_t::CLOSE_ENTRY:
+                        child.writer->close_entry();
+                        break;
+                case command_t::XRUN:
+                        child.writer->xrun();
+                        break;
+                case command_t::WRITE:
+                        child.writer->write(reinterpret_cast<data_block_t const *>(cmd.block.data()),
+                                            cmd.start, cmd.stop);
+                        break;
+                case command_t::GAP:
+                        child.writer->gap(cmd.id, cmd.frame, cmd.nframes, cmd.cause);
+                        break;
+                case command_t::SEGMENT:
+                        child.writer->segment(cmd.start, cmd.stop);
+                        break;
+                case command_t::MESSAGE:
+                        child.writer->log(cmd.time, cmd.source, cmd.message);
+                        break;
+                case command_t::FLUSH:
+                        child.writer->flush();
+                        break;
+                }
+                lck.lock();
+        }
+        child.writer->close_entry();
+}
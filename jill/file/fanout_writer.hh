@@ -0,0 +1,111 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _FANOUT_WRITER_HH
+#define _FANOUT_WRITER_HH
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "../data_writer.hh"
+
+namespace jill { namespace file {
+
+/**
+ * A composite data_writer that forwards data and entry boundaries to several
+ * child writers. This allows the same stream to be stored in more than one
+ * place without copying it out of the JACK buffers more than once.
+ *
+ * Each child is serviced by its own worker thread through a bounded queue.
+ * Calls to this object copy data into the queues and return immediately, so a
+ * slow child does not stall the caller or the other children. If a child's
+ * queue is full, the block is dropped for that child only, and the missing
+ * frames are reported to the child with gap().
+ *
+ * Calls to flush() are queued like the data, so each child flushes after
+ * writing everything that was passed to it before the call. Children prepare
+ * their next entries when their queues are empty.
+ */
+class fanout_writer : public data_writer {
+
+public:
+        /**
+         * Initialize the writer.
+         *
+         * @param children     the writers that will receive the data
+         * @param queue_size   the maximum number of bytes of data queued for
+         *                     each child
+         */
+        explicit fanout_writer(std::vector<std::unique_ptr<data_writer> > children,
+                               std::size_t queue_size=1 << 25);
+        ~fanout_writer() override;
+
+        /* data_writer overrides */
+        bool ready() const override;
+        void new_entry(nframes_t) override;
+        void close_entry() override;
+        void xrun() override;
+        void write(data_block_t const *, nframes_t, nframes_t) override;
+        void gap(std::string const &, nframes_t, nframes_t, gap_cause_t) override;
+        void segment(nframes_t, nframes_t) override;
+        void log(timestamp_t, std::string, std::string) override;
+        void flush() override;
+
+        /** @return the number of children */
+        std::size_t size() const { return _children.size(); }
+
+private:
+        struct command_t {
+                enum op_t { NEW_ENTRY, CLOSE_ENTRY, XRUN, WRITE, GAP, SEGMENT, MESSAGE, FLUSH };
+                op_t op;
+                nframes_t frame;        // NEW_ENTRY, GAP
+                std::vector<char> block; // WRITE: header and data
+                nframes_t start, stop;  // WRITE, SEGMENT: range of frames
+                std::string id;         // GAP
+                nframes_t nframes;
+                gap_cause_t cause;
+                timestamp_t time;       // MESSAGE
+                std::string source;
+                std::string message;
+        };
+
+        struct child_t {
+                std::unique_ptr<data_writer> writer;
+                std::deque<command_t> queue;
+                std::size_t queued_bytes;
+                bool dropped;           // block dropped since the queue was last empty
+                bool running;
+                std::mutex lock;
+                std::condition_variable ready;
+                std::thread thread;
+        };
+
+        /** add a command to a child's queue. Data are dropped if the queue is full */
+        void enqueue(child_t & child, command_t && cmd);
+        /** queue a record of dropped data, merging it with the previous one if possible */
+        void queue_gap(child_t & child, std::string const & id, nframes_t frame, nframes_t nframes);
+        /** add a command to all the children's queues */
+        void broadcast(command_t::op_t op, nframes_t frame=0);
+        /** worker thread */
+        void run(child_t & child);
+
+        std::vector<std::unique_ptr<child_t> > _children;
+        std::size_t const _queue_size;
+        bool _entry;            // whether an entry is open
+};
+
+}}
+
+#endif
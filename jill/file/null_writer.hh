@@ -12,6 +12,7 @@
 #ifndef _NULL_WRITER_HH
 #define _NULL_WRITER_HH
 
+#include <iostream>
 #include "../logging.hh"
 #include "../data_writer.hh"
 
@@ -19,27 +20,30 @@ namespace jill { namespace file {
 
 /**
  * A no-op implementation of jill::data_writer. This class prints useful log
- * messages but doesn't write any data. It's used primarily for testing.
+ * messages but doesn't write any data. It's used primarily for testing. If
+ * verbose is false, only entry and xrun messages are logged.
  */
-class null_writer : public data_writer {
+class null_writer final : public data_writer {
 
 public:
-        null_writer() : _entry(0), _last_entry(0) {}
-        void new_entry(nframes_t frame) {
+        explicit null_writer(bool verbose=true) : _entry(0), _last_entry(0), _verbose(verbose) {}
+        void new_entry(nframes_t frame) override {
                 _entry = ++_last_entry;
                 LOG << "new entry " << _entry << ", frame=" << frame;
         }
-        void close_entry() {
+        void close_entry() override {
+                if (!_entry) return;
                 LOG << "closed entry " <<  _entry;
                 _entry = 0;
         }
-        void xrun() {
+        void xrun() override {
                 LOG << "got xrun";
         }
-        bool ready() const { return _entry; }
+        bool ready() const override { return _entry; }
         bool aligned() const { return true; }
-        void write(data_block_t const * data, nframes_t start, nframes_t stop) {
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
                 if (!_entry) new_entry(data->time);
+                if (!_verbose) return;
                 std::cout << "\rgot period: time=" << data->time << ", id=" << data->id()
                           << ", type=" << data->dtype << ", nframes=" << data->nframes()
                           << ", start=" << start << ", stop=" << stop << ' ' << std::flush;
@@ -48,6 +52,7 @@ public:
 private:
         int _entry;
         int _last_entry;
+        bool _verbose;
 };
 
 }}
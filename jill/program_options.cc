@@ -16,6 +16,7 @@
 #include "logging.hh"
 #include "logger.hh"
 #include "program_options.hh"
+#include "util/thread_config.hh"
 
 using namespace jill;
 using std::string;
@@ -37,6 +38,24 @@ program_options::program_options(std::string program_name, bool remote_log_defau
         visible_opts.add(generic);
 }
 
+void
+program_options::add_thread_options()
+{
+        po::options_description thropts("Thread options");
+        thropts.add_options()
+                ("cpus", po::value<string>(),
+                 "run background threads on these cpus (e.g. 2,3 or 2-3)")
+                ("sched", po::value<string>(),
+                 "scheduling policy for background threads (other or fifo)")
+                ("sched-priority", po::value<int>()->default_value(10),
+                 "realtime priority for background threads (fifo only)")
+                ("nice", po::value<int>(),
+                 "nice level for background threads (other only)");
+        cmd_opts.add(thropts);
+        visible_opts.add(thropts);
+}
+
+
 void
 program_options::print_version()
 {
@@ -91,6 +110,26 @@ program_options::parse(int argc, char **argv)
         }
 
         po::notify(vmap);
+
+        // sched-priority has a default, so it's only missing if
+        // add_thread_options() wasn't called
+        if (vmap.count("sched-priority")) {
+                util::thread_config config;
+                try {
+                        if (vmap.count("cpus"))
+                                config.cpus = util::parse_cpu_list(get<string>("cpus"));
+                        if (vmap.count("sched"))
+                                config.policy = util::parse_sched_policy(get<string>("sched"));
+                }
+                catch (std::invalid_argument const & e) {
+                        throw po::invalid_option_value(e.what());
+                }
+                config.priority = get<int>("sched-priority");
+                if (vmap.count("nice"))
+                        config.nice = get<int>("nice");
+                util::set_thread_config(config);
+                LOG << "background threads: " << config.str();
+        }
         process_options();
 }
 
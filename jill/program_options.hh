@@ -135,6 +135,15 @@ public:
 protected:
         std::string _program_name;
 
+        /**
+         * Add options controlling the CPU affinity and scheduling of
+         * background threads (see util::thread_config). Programs that start
+         * threads should call this in their constructor. The settings are
+         * parsed and stored in the process-wide configuration before
+         * process_options() is called.
+         */
+        void add_thread_options();
+
         /**
          * This function is called once the options are parsed; its
          * job is to load data into the data members of the
@@ -16,6 +16,7 @@
 #include <iosfwd>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 
 /**
  * @file types.hh
@@ -34,6 +35,8 @@ using nframes_t = jack_nframes_t;
 using utime_t = jack_time_t;
 /** A data type holding extended position information. Inherited from JACK */
 using position_t = jack_position_t;
+/** A data type for comparing differences between frame counts */
+using framediff_t = std::make_signed<nframes_t>::type;
 
 /** The kinds of data moved through JILL. Corresponds to jack port types */
 enum dtype_t {
@@ -10,6 +10,7 @@
  */
 #include "../logging.hh"
 #include "readahead_stimqueue.hh"
+#include "thread_config.hh"
 
 using namespace jill::util;
 
@@ -57,6 +58,7 @@ void
 readahead_stimqueue::loop()
 {
         jill::stimulus_t * ptr;
+        configure_thread("stimulus loader");
         std::unique_lock<std::mutex> lck(_lock);
 
         while (_running) {
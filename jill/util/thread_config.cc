@@ -0,0 +1,152 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../logging.hh"
+#include "thread_config.hh"
+
+using namespace jill::util;
+using std::string;
+using std::vector;
+
+static thread_config _config;
+
+static char const *
+policy_name(int policy)
+{
+        switch (policy) {
+        case SCHED_OTHER: return "SCHED_OTHER";
+        case SCHED_FIFO: return "SCHED_FIFO";
+        case SCHED_RR: return "SCHED_RR";
+        default: return "unknown";
+        }
+}
+
+string
+thread_config::str() const
+{
+        std::ostringstream o;
+        if (empty()) return "default";
+        if (!cpus.empty()) {
+                o << "cpus=";
+                for (std::size_t i = 0; i < cpus.size(); ++i)
+                        o << (i ? "," : "") << cpus[i];
+                o << " ";
+        }
+        if (policy != unset) {
+                o << policy_name(policy);
+                if (policy == SCHED_FIFO) o << "(" << priority << ")";
+                o << " ";
+        }
+        if (nice != unset)
+                o << "nice=" << nice;
+        string s = o.str();
+        if (s.back() == ' ') s.pop_back();
+        return s;
+}
+
+vector<int>
+jill::util::parse_cpu_list(string const & list)
+{
+        vector<int> cpus;
+        std::istringstream in(list);
+        string item;
+        while (std::getline(in, item, ',')) {
+                std::size_t pos;
+                int first, last;
+                try {
+                        first = last = std::stoi(item, &pos);
+                        if (pos < item.size() && item[pos] == '-')
+                                last = std::stoi(item.substr(pos + 1), &pos);
+                        else if (pos < item.size())
+                                throw std::invalid_argument(item);
+                }
+                catch (std::logic_error const &) {
+                        throw std::invalid_argument("invalid cpu list: " + list);
+                }
+                if (first < 0 || last < first || last >= CPU_SETSIZE)
+                        throw std::invalid_argument("invalid cpu list: " + list);
+                for (int cpu = first; cpu <= last; ++cpu)
+                        cpus.push_back(cpu);
+        }
+        return cpus;
+}
+
+int
+jill::util::parse_sched_policy(string const & name)
+{
+        if (name == "other") return SCHED_OTHER;
+        if (name == "fifo") return SCHED_FIFO;
+        throw std::invalid_argument("invalid scheduling policy: " + name);
+}
+
+void
+jill::util::set_thread_config(thread_config const & config)
+{
+        _config = config;
+}
+
+thread_config const &
+jill::util::get_thread_config()
+{
+        return _config;
+}
+
+void
+jill::util::configure_thread(char const * name)
+{
+        thread_config const & config = _config;
+        thread_config applied;
+        std::ostringstream errors;
+        if (config.empty()) return;
+
+        if (!config.cpus.empty()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : config.cpus)
+                        CPU_SET(cpu, &set);
+                int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                if (ret == 0)
+                        applied.cpus = config.cpus;
+                else
+                        errors << "; unable to set affinity (" << strerror(ret) << ")";
+        }
+        if (config.policy != thread_config::unset) {
+                sched_param param;
+                param.sched_priority = (config.policy == SCHED_FIFO) ? config.priority : 0;
+                int ret = pthread_setschedparam(pthread_self(), config.policy, &param);
+                if (ret == 0) {
+                        applied.policy = config.policy;
+                        applied.priority = param.sched_priority;
+                }
+                else
+                        errors << "; unable to set " << policy_name(config.policy)
+                               << " (" << strerror(ret) << ")";
+        }
+        if (config.nice != thread_config::unset) {
+                // on linux, nice values apply to individual threads
+                pid_t tid = syscall(SYS_gettid);
+                if (setpriority(PRIO_PROCESS, tid, config.nice) == 0)
+                        applied.nice = config.nice;
+                else
+                        errors << "; unable to set nice level (" << strerror(errno) << ")";
+        }
+        LOG << name << " thread: " << applied.str() << errors.str();
+}
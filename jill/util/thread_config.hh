@@ -0,0 +1,85 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _UTIL_THREAD_CONFIG_HH
+#define _UTIL_THREAD_CONFIG_HH
+
+#include <string>
+#include <vector>
+
+namespace jill { namespace util {
+
+/**
+ * @ingroup miscgroup
+ * @brief CPU affinity and scheduling settings for background threads
+ *
+ * JILL programs run a number of threads besides the JACK realtime thread (disk
+ * writers, log receivers, stimulus loaders, etc). By default these are
+ * ordinary threads that the kernel may schedule on any core, including the one
+ * running the JACK thread. This structure describes how they should be
+ * scheduled instead. A single process-wide configuration is set (usually by
+ * program_options) before any threads are started, and each thread applies it
+ * by calling configure_thread() when it starts.
+ *
+ * Fields that are empty or equal to unset are left as inherited from the
+ * process.
+ */
+struct thread_config {
+        static const int unset = -1000;
+
+        std::vector<int> cpus;  // cpus the thread may run on
+        int policy;             // SCHED_OTHER or SCHED_FIFO
+        int priority;           // realtime priority (SCHED_FIFO only)
+        int nice;               // nice level (SCHED_OTHER only)
+
+        thread_config() : policy(unset), priority(unset), nice(unset) {}
+
+        /** @return true if no settings will be changed */
+        bool empty() const {
+                return cpus.empty() && policy == unset && nice == unset;
+        }
+
+        /** @return a description of the settings */
+        std::string str() const;
+};
+
+/**
+ * Parse a list of cpus, e.g. "1,3" or "2-3".
+ *
+ * @throws std::invalid_argument if the list can't be parsed
+ */
+std::vector<int> parse_cpu_list(std::string const & list);
+
+/**
+ * Parse the name of a scheduling policy ("other" or "fifo").
+ *
+ * @throws std::invalid_argument if the name is not recognized
+ */
+int parse_sched_policy(std::string const & name);
+
+/** Set the process-wide configuration. Call before starting any threads. */
+void set_thread_config(thread_config const & config);
+
+/** @return the process-wide configuration */
+thread_config const & get_thread_config();
+
+/**
+ * Apply the process-wide configuration to the calling thread and log what was
+ * actually applied. Failures (e.g. if the user lacks permission for realtime
+ * scheduling) are logged but are not fatal.
+ *
+ * @param name  a short description of the thread, for the log
+ */
+void configure_thread(char const * name);
+
+}} // namespace jill::util
+
+#endif
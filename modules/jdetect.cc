@@ -1,5 +1,5 @@
 /*
- * Simple crossing-based signal detector
+ * Simple crossing-based or spectral signal detector, for one or more channels
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -9,19 +9,30 @@
  * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
  */
 #include <iostream>
+#include <cmath>
 #include <csignal>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
 
+#include "jill/zmq.hh"
 #include "jill/logging.hh"
 #include "jill/jack_client.hh"
 #include "jill/program_options.hh"
 #include "jill/midi.hh"
 #include "jill/dsp/ringbuffer.hh"
-#include "jill/dsp/crossing_trigger.hh"
+#include "jill/dsp/crossing_trigger_bank.hh"
+#include "jill/dsp/spectral_trigger.hh"
+#include "jill/util/thread_config.hh"
 
 #define PROGRAM_NAME "jdetect"
 
 using namespace jill;
+namespace fs = boost::filesystem;
 using std::string;
+using params_type = dsp::crossing_trigger_bank<sample_t>::params_type;
 
 class jdetect_options : public program_options {
 
@@ -35,11 +46,18 @@ public:
         std::vector<string> input_ports;
         /** A vector of outputs to connect to the client */
         std::vector<string> output_ports;
-        /** The MIDI output channel */
-        midi::data_type output_chan;
-
-        float open_threshold;
-        float close_threshold;
+        /** The detection method (crossing or spectral) */
+        string method;
+        /** The number of input channels, each with its own gate */
+        int nchannels;
+        /** Whether each channel has its own output port */
+        bool split_outputs;
+        /** The MIDI output channel for each input (or the first, if only one) */
+        std::vector<int> output_chans;
+
+        /** Thresholds for each channel (or for all, if only one) */
+        std::vector<float> open_thresholds;
+        std::vector<float> close_thresholds;
 
         float open_crossing_rate;  // s^-1
         float close_crossing_rate;
@@ -47,61 +65,159 @@ public:
         float period_size_ms; // in ms
         float open_crossing_period_ms;
         float close_crossing_period_ms;
+        /** The longest integration time that can be set while running */
+        float max_crossing_period_ms;
+
+        /** Whether the thresholds are multiples of the noise floor */
+        bool adaptive;
+        float floor_time_s;
+
+        float band_low;  // Hz
+        float band_high;
+        float open_ratio;
+        float close_ratio;
+        float open_fraction;
+        float close_fraction;
+
+        bool spectral() const { return method == "spectral"; }
+
+        /** Get the value of a per-channel option for a channel */
+        template <typename T>
+        T channel_value(std::vector<T> const & values, int chan) const {
+                return (std::size_t(chan) < values.size()) ? values[chan] : values.back();
+        }
+
+        /** The MIDI channel for an input */
+        midi::data_type midi_channel(int chan) const {
+                if (output_chans.size() == 1) return (output_chans[0] + chan) & midi::chan_nib;
+                return channel_value(output_chans, chan) & midi::chan_nib;
+        }
 
 protected:
 
         void print_usage() override;
+        void process_options() override;
 
 }; // jdetect_options
 
 
 jdetect_options options(PROGRAM_NAME);
 std::unique_ptr<jack_client> client;
-std::unique_ptr<dsp::crossing_trigger<sample_t> > trigger;
-jack_port_t *port_in, *port_trig, *port_count;
+std::unique_ptr<dsp::crossing_trigger_bank<sample_t> > trigger;
+/* with the spectral method, a detector for each channel */
+std::vector<std::unique_ptr<dsp::spectral_trigger<sample_t> > > detectors;
+/* ports for each channel. The output ports may be shared */
+std::vector<jack_port_t *> ports_in, ports_trig, ports_count, ports_floor;
+/* buffers for each channel, filled in each period */
+std::vector<sample_t const *> buffers_in;
+std::vector<sample_t *> buffers_count, buffers_floor;
+std::vector<void *> buffers_trig;
 int stopping = 0;               // set to 1 to get process to clean up
 
+/*
+ * Parameter updates from the control socket. The control thread fills
+ * staged_params while update_state is 0 and then sets it to 1; the process
+ * callback hands the block to the bank (2), which copies it at the next period
+ * boundary, and then the callback sets update_state back to 0.
+ */
+std::vector<params_type> staged_params;
+int update_state = 0;
+
+/* state changes from the spectral detectors, which are sorted before sending */
+struct change_t {
+        nframes_t offset;
+        int channel;
+        bool open;
+};
+std::vector<change_t> changes;
+
 /* data storage for event times */
 struct event_t {
         nframes_t time;
+        int channel;
         int status;
 };
-dsp::ringbuffer<event_t> trig_times(128);
+dsp::ringbuffer<event_t> trig_times(1024);
 
-int
-process(jack_client *client, nframes_t nframes, nframes_t time)
+/* send a gate open or close event for a channel */
+void
+send_event(int chan, nframes_t offset, nframes_t time, bool open)
 {
-        sample_t *in = client->samples(port_in, nframes);
-        sample_t *out = (port_count) ? client->samples(port_count, nframes) : nullptr;
-        void *trig_buffer = client->events(port_trig, nframes);
-        jack_midi_data_t buf[] = { jack_midi_data_t(options.output_chan & midi::chan_nib),
+        jack_midi_data_t buf[] = { jack_midi_data_t(options.midi_channel(chan)),
                                    midi::default_pitch, midi::default_velocity };
-
-        if (stopping && trigger->open()) {
-                buf[0] += midi::note_off;
-                jack_midi_event_write(trig_buffer, 0, buf, 3);
-                __sync_add_and_fetch(&stopping, -1);
-                return 0;
+        buf[0] += (open) ? midi::note_on : midi::note_off;
+        event_t event = { time + offset, chan, buf[0] & midi::type_nib }; // data sent to logger
+        if (jack_midi_event_write(buffers_trig[chan], offset, buf, 3) != 0) {
+                // indicate error to logger function
+                event.status = midi::sysex;
         }
+        trig_times.push(event);
+}
 
-        // Step 1: Pass samples to window discriminator; its state may
-        // change, in which case the return value will be > -1 and
-        // indicate the frame in which the gate opened or closed. It
-        // also takes care of copying the current state of the buffer
-        // to the count monitor port (if not NULL)
-        int offset = trigger->push(in, nframes, out);
-        if (offset < 0) return 0;
+int
+process(jack_client *client, nframes_t nframes, nframes_t time)
+{
+        std::size_t const nchan = ports_in.size();
+        // output buffers are cleared when they're first retrieved, so
+        // shared ports are only retrieved once
+        for (std::size_t i = 0; i < nchan; ++i) {
+                buffers_in[i] = client->samples(ports_in[i], nframes);
+                if (!ports_count.empty())
+                        buffers_count[i] = client->samples(ports_count[i], nframes);
+                if (!ports_floor.empty())
+                        buffers_floor[i] = client->samples(ports_floor[i], nframes);
+                buffers_trig[i] = (i > 0 && ports_trig[i] == ports_trig[i-1]) ? buffers_trig[i-1]
+                        : client->events(ports_trig[i], nframes);
+        }
 
-        if (trigger->open()) buf[0] += midi::note_on;
-        else buf[0] += midi::note_off;
+        if (stopping) {
+                bool any = false;
+                for (std::size_t i = 0; i < nchan; ++i) {
+                        if (!(trigger ? trigger->open(i) : detectors[i]->open())) continue;
+                        send_event(i, 0, time, false);
+                        any = true;
+                }
+                if (any) {
+                        if (trigger) trigger->reset();
+                        for (auto & d : detectors) d->reset();
+                        __sync_add_and_fetch(&stopping, -1);
+                        return 0;
+                }
+        }
 
-        event_t event = { time + offset, buf[0] & midi::type_nib }; // data sent to logger
-        if (jack_midi_event_write(trig_buffer, offset, buf, 3) != 0) {
-                // indicate error to logger function
-                event.status = midi::sysex;
+        if (!trigger) {
+                // Each detector reports at most one change per block. Events
+                // on a shared output port have to be written in order of time.
+                changes.clear();
+                for (std::size_t i = 0; i < nchan; ++i) {
+                        int offset = detectors[i]->push(buffers_in[i], nframes,
+                                                        ports_count.empty() ? nullptr : buffers_count[i]);
+                        if (offset < 0) continue;
+                        change_t c = { nframes_t(offset), int(i), detectors[i]->open() };
+                        auto it = changes.end();
+                        while (it != changes.begin() && (it - 1)->offset > c.offset) --it;
+                        changes.insert(it, c);
+                }
+                for (auto const & c : changes)
+                        send_event(c.channel, c.offset, time, c.open);
+                return 0;
         }
-        trig_times.push(event);
 
+        if (__sync_bool_compare_and_swap(&update_state, 1, 2))
+                trigger->stage(staged_params.data());
+
+        // Pass samples to the window discriminators. The callback is
+        // invoked in order of time for each gate that opens or closes. The
+        // bank also copies the current state of each gate and the noise
+        // floor to the monitor ports (if any)
+        trigger->push(buffers_in.data(), nframes,
+                      [time](std::size_t chan, std::size_t offset, bool open) {
+                              send_event(chan, offset, time, open);
+                      },
+                      ports_count.empty() ? nullptr : buffers_count.data(),
+                      ports_floor.empty() ? nullptr : buffers_floor.data());
+        if (!trigger->staged())
+                __sync_bool_compare_and_swap(&update_state, 2, 0);
         return 0;
 }
 
@@ -119,6 +235,8 @@ std::size_t log_times(event_t const * events, std::size_t count)
                         msg << "signal off:";
                 else
                         msg << "WARNING: detected but couldn't send event: ";
+                if (ports_in.size() > 1)
+                        msg << " channel=" << e->channel << ",";
                 msg << " frames=" << e->time << ", us=" << client->time(e->time);
         }
         return i;
@@ -142,6 +260,32 @@ jack_shutdown(jack_status_t code, char const *)
         exit(-1);
 }
 
+/* the number of analysis periods in an integration time */
+int
+window_periods(float period_ms)
+{
+        return period_ms / options.period_size_ms;
+}
+
+/* the parameters for each gate of the crossing detector */
+std::vector<params_type>
+crossing_params(nframes_t samplerate)
+{
+        nframes_t period_size = options.period_size_ms * samplerate / 1000;
+        int open_crossing_periods = window_periods(options.open_crossing_period_ms);
+        int close_crossing_periods = window_periods(options.close_crossing_period_ms);
+        int open_count_thresh = options.open_crossing_rate * period_size / 1000 * open_crossing_periods;
+        int close_count_thresh = options.close_crossing_rate * period_size / 1000 * close_crossing_periods;
+        std::vector<params_type> params;
+        for (int i = 0; i < options.nchannels; ++i) {
+                params.push_back({ options.channel_value(options.open_thresholds, i),
+                                   open_count_thresh, std::size_t(open_crossing_periods),
+                                   options.channel_value(options.close_thresholds, i),
+                                   close_count_thresh, std::size_t(close_crossing_periods) });
+        }
+        return params;
+}
+
 /**
  * Callback for samplerate changes. This function is only called once.
  */
@@ -152,28 +296,188 @@ samplerate_callback(jack_client *client, nframes_t samplerate)
         nframes_t period_size = options.period_size_ms * samplerate / 1000;
         int open_crossing_periods = options.open_crossing_period_ms / options.period_size_ms;
         int close_crossing_periods  = options.close_crossing_period_ms / options.period_size_ms;
-        int open_count_thresh = options.open_crossing_rate * period_size / 1000 * open_crossing_periods;
-        int close_count_thresh = options.close_crossing_rate * period_size / 1000 * close_crossing_periods;
+        LOG << "period size: " << options.period_size_ms << " ms, " << period_size << " samples";
 
-        trigger.reset(new dsp::crossing_trigger<sample_t>(options.open_threshold,
-                                                         open_count_thresh,
-                                                         open_crossing_periods,
-                                                         options.close_threshold,
-                                                         close_count_thresh,
-                                                         close_crossing_periods,
-                                                         period_size));
+        if (options.spectral()) {
+                float band_high = std::min<float>(options.band_high, samplerate / 2);
+                int open_count_thresh = options.open_fraction * open_crossing_periods;
+                int close_count_thresh = options.close_fraction * close_crossing_periods;
+                detectors.clear();
+                for (int i = 0; i < options.nchannels; ++i) {
+                        detectors.emplace_back(new dsp::spectral_trigger<sample_t>(
+                                options.band_low / samplerate, band_high / samplerate,
+                                options.open_ratio, open_count_thresh, open_crossing_periods,
+                                options.close_ratio, close_count_thresh, close_crossing_periods,
+                                period_size));
+                        LOG << "channel " << i << ": MIDI channel: " << int(options.midi_channel(i));
+                }
+                changes.reserve(options.nchannels);
+                LOG << "frequency band: " << options.band_low << "-" << band_high << " Hz, FFT size: "
+                    << detectors[0]->fft_size();
+                LOG << "open band ratio: " << options.open_ratio << ", count thresh: " << open_count_thresh;
+                LOG << "open integration window: " << options.open_crossing_period_ms << " ms, " << open_crossing_periods << " periods ";
+                LOG << "close band ratio: " << options.close_ratio << ", count thresh: " << close_count_thresh;
+                LOG << "close integration window: " << options.close_crossing_period_ms << " ms, " << close_crossing_periods << " periods ";
+                return 0;
+        }
+
+        std::vector<params_type> params = crossing_params(samplerate);
+        int open_count_thresh = params[0].open_count;
+        int close_count_thresh = params[0].close_count;
+        trigger.reset(new dsp::crossing_trigger_bank<sample_t>(
+                              params, period_size, window_periods(options.max_crossing_period_ms)));
+        staged_params = params;
+        if (options.adaptive) {
+                double floor_periods = options.floor_time_s * 1000 / options.period_size_ms;
+                trigger->set_adaptive(floor_periods);
+                LOG << "adaptive thresholds: noise floor time constant: " << options.floor_time_s
+                    << " s, " << floor_periods << " periods";
+        }
 
         // Log parameters
-        LOG << "period size: " << options.period_size_ms << " ms, " << period_size << " samples";
-        LOG << "open threshold: " << options.open_threshold;
+        for (int i = 0; i < options.nchannels; ++i) {
+                LOG << "channel " << i << ": open threshold: " << params[i].open_thresh
+                    << ", close threshold: " << params[i].close_thresh
+                    << (options.adaptive ? " (x noise floor)" : "")
+                    << ", MIDI channel: " << int(options.midi_channel(i));
+        }
         LOG << "open count thresh: " << open_count_thresh;
         LOG << "open integration window: " << options.open_crossing_period_ms << " ms, " << open_crossing_periods << " periods ";
-        LOG << "close threshold: " << options.close_threshold;
         LOG << "close count thresh: " << close_count_thresh;
         LOG << "close integration window: " << options.close_crossing_period_ms << " ms, " << close_crossing_periods << " periods ";
         return 0;
 }
 
+constexpr char REQ_PARAMS[] = "PARAMS";
+constexpr char REQ_SET[] = "SET";
+constexpr char REP_BADCMD[] = "BADCMD";
+constexpr char REP_BADVALUE[] = "BADVALUE";
+constexpr char REP_BUSY[] = "BUSY";
+constexpr char REP_OK[] = "OK";
+
+/* the current values of the parameters that can be changed while running */
+string
+current_params()
+{
+        std::ostringstream os;
+        os << "period-size=" << options.period_size_ms;
+        for (auto const & v : { std::make_pair("open-thresh", &options.open_thresholds),
+                                std::make_pair("close-thresh", &options.close_thresholds) }) {
+                os << ' ' << v.first << '=';
+                for (std::size_t i = 0; i < v.second->size(); ++i)
+                        os << (i ? "," : "") << (*v.second)[i];
+        }
+        os << " open-rate=" << options.open_crossing_rate
+           << " open-period=" << options.open_crossing_period_ms
+           << " close-rate=" << options.close_crossing_rate
+           << " close-period=" << options.close_crossing_period_ms;
+        return os.str();
+}
+
+/*
+ * Parse a list of parameter updates (name=value, or name.channel=value for
+ * the thresholds), and if they're all valid, stage the new parameters for the
+ * process callback. Returns the reply to send to the client.
+ */
+char const *
+stage_params(string const & request)
+{
+        if (!trigger) return REP_BADCMD;
+        if (update_state != 0) return REP_BUSY;
+        std::vector<float> open_thresholds(options.nchannels), close_thresholds(options.nchannels);
+        for (int i = 0; i < options.nchannels; ++i) {
+                open_thresholds[i] = options.channel_value(options.open_thresholds, i);
+                close_thresholds[i] = options.channel_value(options.close_thresholds, i);
+        }
+        float open_rate = options.open_crossing_rate;
+        float close_rate = options.close_crossing_rate;
+        float open_period = options.open_crossing_period_ms;
+        float close_period = options.close_crossing_period_ms;
+
+        std::istringstream is(request);
+        string item;
+        while (is >> item) {
+                std::size_t eq = item.find('=');
+                if (eq == string::npos) return REP_BADCMD;
+                string name = item.substr(0, eq);
+                int chan = -1;
+                std::size_t dot = name.find('.');
+                float value;
+                try {
+                        if (dot != string::npos) {
+                                chan = std::stoi(name.substr(dot + 1));
+                                name.resize(dot);
+                                if (chan < 0 || chan >= options.nchannels) return REP_BADVALUE;
+                        }
+                        value = std::stof(item.substr(eq + 1));
+                }
+                catch (std::logic_error const &) {
+                        return REP_BADVALUE;
+                }
+                if (!std::isfinite(value)) return REP_BADVALUE;
+                if (name == "open-thresh" || name == "close-thresh") {
+                        std::vector<float> & v = (name[0] == 'o') ? open_thresholds : close_thresholds;
+                        if (chan < 0) std::fill(v.begin(), v.end(), value);
+                        else v[chan] = value;
+                        continue;
+                }
+                if (chan >= 0) return REP_BADCMD;
+                if (name == "open-rate" || name == "close-rate") {
+                        if (!(value >= 0)) return REP_BADVALUE;
+                        ((name[0] == 'o') ? open_rate : close_rate) = value;
+                }
+                else if (name == "open-period" || name == "close-period") {
+                        if (window_periods(value) < 1 || std::size_t(window_periods(value)) > trigger->max_periods())
+                                return REP_BADVALUE;
+                        ((name[0] == 'o') ? open_period : close_period) = value;
+                }
+                else
+                        return REP_BADCMD;
+        }
+        options.open_thresholds = open_thresholds;
+        options.close_thresholds = close_thresholds;
+        options.open_crossing_rate = open_rate;
+        options.close_crossing_rate = close_rate;
+        options.open_crossing_period_ms = open_period;
+        options.close_crossing_period_ms = close_period;
+        // same size as before, so nothing is allocated
+        staged_params = crossing_params(client->sampling_rate());
+        __sync_bool_compare_and_swap(&update_state, 0, 1);
+        LOG << "updated parameters: " << current_params();
+        return REP_OK;
+}
+
+/*
+ * This thread listens for requests to get or change the detector parameters,
+ * which are sent as "PARAMS" or "SET name=value ...".
+ */
+void
+control_thread(void * socket)
+{
+        util::configure_thread("control");
+        while (true) {
+                // blocking call to receive messages
+                std::vector<std::string> messages = zmq::recv(socket);
+                if (messages.empty())
+                        break;
+                auto data = messages.back();
+                if (data.compare(REQ_PARAMS) == 0) {
+                        messages.back() = current_params();
+                }
+                else if (data.compare(0, strlen(REQ_SET), REQ_SET) == 0) {
+                        messages.back() = stage_params(data.substr(strlen(REQ_SET)));
+                        if (messages.back() != REP_OK)
+                                LOG << "invalid parameter update (" << messages.back() << "): " << data;
+                }
+                else {
+                        LOG << "invalid client request";
+                        messages.back() = REP_BADCMD;
+                }
+                zmq::send_n(socket, messages.begin(), messages.size());
+        }
+        zmq_close(socket);
+}
+
 
 int
 main(int argc, char **argv)
@@ -183,14 +487,38 @@ main(int argc, char **argv)
                 options.parse(argc, argv);
                 client.reset(new jack_client(options.client_name, options.server_name));
 
-                port_in = client->register_port("in", JACK_DEFAULT_AUDIO_TYPE,
-                                               JackPortIsInput, 0);
-                port_trig = client->register_port("trig_out",JACK_DEFAULT_MIDI_TYPE,
-                                                JackPortIsOutput, 0);
-                if (options.count("count-port")) {
-                        port_count = client->register_port("count",JACK_DEFAULT_AUDIO_TYPE,
-                                                          JackPortIsOutput, 0);
+                // with one channel, the ports don't get suffixes
+                int nchan = options.nchannels;
+                auto port_name = [nchan](char const * base, int i) {
+                        return (nchan > 1) ? string(base) + "_" + std::to_string(i) : string(base);
+                };
+                for (int i = 0; i < nchan; ++i) {
+                        ports_in.push_back(client->register_port(port_name("in", i),
+                                                                 JACK_DEFAULT_AUDIO_TYPE,
+                                                                 JackPortIsInput, 0));
+                        if (options.split_outputs || i == 0) {
+                                ports_trig.push_back(client->register_port(
+                                        options.split_outputs ? port_name("trig_out", i) : "trig_out",
+                                        JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0));
+                        }
+                        else {
+                                ports_trig.push_back(ports_trig.front());
+                        }
+                        if (options.count("count-port")) {
+                                ports_count.push_back(client->register_port(port_name("count", i),
+                                                                            JACK_DEFAULT_AUDIO_TYPE,
+                                                                            JackPortIsOutput, 0));
+                        }
+                        if (options.count("count-port") && options.adaptive) {
+                                ports_floor.push_back(client->register_port(port_name("floor", i),
+                                                                            JACK_DEFAULT_AUDIO_TYPE,
+                                                                            JackPortIsOutput, 0));
+                        }
                 }
+                buffers_in.resize(nchan);
+                buffers_count.resize(nchan);
+                buffers_floor.resize(nchan);
+                buffers_trig.resize(nchan);
 
                 // register signal handlers
                 signal(SIGINT,  signal_handler);
@@ -202,8 +530,46 @@ main(int argc, char **argv)
                 client->set_process_callback(process);
                 client->activate();
 
-                client->connect_ports(options.input_ports.begin(), options.input_ports.end(), "in");
-                client->connect_ports("trig_out", options.output_ports.begin(), options.output_ports.end());
+                if (nchan == 1) {
+                        client->connect_ports(options.input_ports.begin(), options.input_ports.end(), "in");
+                }
+                else {
+                        // inputs are connected to channels in order
+                        for (std::size_t i = 0; i < options.input_ports.size() && int(i) < nchan; ++i)
+                                client->connect_port(options.input_ports[i], port_name("in", i));
+                }
+                if (options.split_outputs) {
+                        for (std::size_t i = 0; i < options.output_ports.size() && int(i) < nchan; ++i)
+                                client->connect_port(port_name("trig_out", i), options.output_ports[i]);
+                }
+                else {
+                        client->connect_ports("trig_out", options.output_ports.begin(),
+                                              options.output_ports.end());
+                }
+
+                // the crossing detector's parameters can be changed while
+                // running through a zeromq socket
+                if (!options.spectral()) {
+                        fs::path path("/tmp/org.meliza.jill");
+                        path /= options.server_name.empty() ? "default" : options.server_name;
+                        path /= options.client_name;
+                        if (!fs::exists(path)) {
+                                fs::create_directories(path);
+                        }
+                        path /= "req";
+                        std::ostringstream endpoint;
+                        endpoint << "ipc://" << path.string();
+                        void * req_socket = zmq::context::socket(ZMQ_ROUTER);
+                        if (zmq_bind(req_socket, endpoint.str().c_str()) < 0) {
+                                LOG << "unable to bind to endpoint " << endpoint.str()
+                                    << "; parameters can't be changed while running";
+                                zmq_close(req_socket);
+                        }
+                        else {
+                                INFO << "listening for requests at " << endpoint.str();
+                                std::thread(control_thread, req_socket).detach();
+                        }
+                }
 
                 while(true) {
                         sleep(1);
@@ -233,32 +599,63 @@ jdetect_options::jdetect_options(string const &program_name)
                 ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
                 ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
                  "set client name")
-                ("in,i",      po::value<vector<string> >(&input_ports), "add connection to input port")
-                ("out,o",     po::value<vector<string> >(&output_ports), "add connection to output port")
-                ("chan,c",    po::value<midi::data_type>(&output_chan)->default_value(0),
-                 "set MIDI channel for output messages (0-16)");
+                ("in,i",      po::value<vector<string> >(&input_ports),
+                 "add connection to input port (with several channels, to each channel in turn)")
+                ("out,o",     po::value<vector<string> >(&output_ports),
+                 "add connection to output port (with --split-outputs, to each channel in turn)")
+                ("channels,N", po::value<int>(&nchannels)->default_value(1),
+                 "set number of input channels, each with its own gate")
+                ("split-outputs", po::bool_switch(&split_outputs),
+                 "create an output port for each channel")
+                ("chan,c",    po::value<vector<int> >(&output_chans)->default_value(vector<int>(1, 0), "0"),
+                 "set MIDI channel for output messages (0-15). Specify once per input, or once "
+                 "for consecutive channels starting at this value")
+                ("method",    po::value<string>(&method)->default_value("crossing"),
+                 "set detection method (crossing or spectral)");
 
         // tropts is a group of options
         po::options_description tropts("Trigger options");
         tropts.add_options()
-                ("count-port", "create port to output integrator state")
+                ("count-port", "create port to output integrator state (and noise floor, with --adaptive)")
                 ("period-size", po::value<float>(&period_size_ms)->default_value(20),
                  "set analysis period size (ms)")
-                ("open-thresh", po::value<float>(&open_threshold)->default_value(0.01),
-                 "set sample threshold for open gate (0-1.0)")
+                ("open-thresh", po::value<vector<float> >(&open_thresholds)->default_value(vector<float>(1, 0.01), "0.01"),
+                 "set sample threshold for open gate (0-1.0). Specify once per input, or once for all")
                 ("open-rate", po::value<float>(&open_crossing_rate)->default_value(20),
                  "set crossing rate thresh for open gate (s^-1)")
                 ("open-period", po::value<float>(&open_crossing_period_ms)->default_value(500),
                  "set integration time for open gate (ms)")
-                ("close-thresh", po::value<float>(&close_threshold)->default_value(0.01),
-                 "set sample threshold for close gate")
+                ("close-thresh", po::value<vector<float> >(&close_thresholds)->default_value(vector<float>(1, 0.01), "0.01"),
+                 "set sample threshold for close gate. Specify once per input, or once for all")
                 ("close-rate", po::value<float>(&close_crossing_rate)->default_value(2),
                  "set crossing rate thresh for close gate (s^-1)")
                 ("close-period", po::value<float>(&close_crossing_period_ms)->default_value(5000),
-                 "set integration time for close gate (ms)");
-
-        cmd_opts.add(jillopts).add(tropts);
-        visible_opts.add(jillopts).add(tropts);
+                 "set integration time for close gate (ms)")
+                ("max-period", po::value<float>(&max_crossing_period_ms)->default_value(10000),
+                 "set longest integration time that can be set while running (ms)")
+                ("adaptive", po::bool_switch(&adaptive),
+                 "set thresholds as multiples of the noise floor (default open 5, close 3)")
+                ("floor-time", po::value<float>(&floor_time_s)->default_value(30),
+                 "set time constant for increases in the noise floor (s)");
+
+        po::options_description specopts("Spectral options (with --method=spectral)");
+        specopts.add_options()
+                ("band-low", po::value<float>(&band_low)->default_value(1500),
+                 "set lower edge of detection band (Hz)")
+                ("band-high", po::value<float>(&band_high)->default_value(8000),
+                 "set upper edge of detection band (Hz)")
+                ("open-ratio", po::value<float>(&open_ratio)->default_value(0.5),
+                 "set fraction of power in band for a period to count toward opening (0-1.0)")
+                ("open-fraction", po::value<float>(&open_fraction)->default_value(0.5),
+                 "open gate if more than this fraction of periods in the open window count")
+                ("close-ratio", po::value<float>(&close_ratio)->default_value(0.3),
+                 "set fraction of power in band for a period to count toward staying open")
+                ("close-fraction", po::value<float>(&close_fraction)->default_value(0.1),
+                 "close gate if fewer than this fraction of periods in the close window count");
+
+        cmd_opts.add(jillopts).add(tropts).add(specopts);
+        visible_opts.add(jillopts).add(tropts).add(specopts);
+        add_thread_options();
 }
 
 void
@@ -266,9 +663,58 @@ jdetect_options::print_usage()
 {
         std::cout << "Usage: " << _program_name << " [options]\n"
                   << visible_opts << std::endl
-                  << "Ports:\n"
+                  << "Ports (with more than one channel, in, count, and trig_out with\n"
+                  << "--split-outputs are numbered by channel, as in_0, in_1, ...):\n"
                   << " * in:       for input of the signal(s) to be monitored\n"
                   << " * trig_out:  MIDI port producing gate open and close events\n"
-                  << " * count:    (optional) the current estimate of signal power"
+                  << " * count:    (optional) the current estimate of signal power\n"
+                  << " * floor:    (optional, with --adaptive) the estimated noise floor\n\n"
+                  << "With --method=spectral, a period counts toward opening (or staying open)\n"
+                  << "if the fraction of its power in the detection band is at least --open-ratio\n"
+                  << "(or --close-ratio). The sample thresholds and crossing rates are not used.\n\n"
+                  << "With the crossing method, the parameters can be changed while running by\n"
+                  << "sending requests to ipc:///tmp/org.meliza.jill/<server>/<client>/req:\n"
+                  << " * PARAMS:   reply with the current values\n"
+                  << " * SET name=value ...: change open-thresh, close-thresh, open-rate,\n"
+                  << "             close-rate, open-period, or close-period. Thresholds for a\n"
+                  << "             single channel are set with name.channel=value. The new values\n"
+                  << "             take effect at the start of the next analysis period.\n"
+                  << "             Replies OK, BUSY (previous update not applied), BADVALUE, or BADCMD"
                   << std::endl;
 }
+
+void
+jdetect_options::process_options()
+{
+        program_options::process_options();
+        if (nchannels < 1) {
+                LOG << "ERROR: number of channels must be positive";
+                throw Exit(EXIT_FAILURE);
+        }
+        for (auto const * v : { &open_thresholds, &close_thresholds }) {
+                if (v->size() != 1 && int(v->size()) != nchannels) {
+                        LOG << "ERROR: thresholds must be given once, or once per channel";
+                        throw Exit(EXIT_FAILURE);
+                }
+        }
+        if (method != "crossing" && method != "spectral") {
+                LOG << "ERROR: unknown detection method '" << method << "'";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (adaptive) {
+                if (spectral()) {
+                        LOG << "ERROR: adaptive thresholds require the crossing method";
+                        throw Exit(EXIT_FAILURE);
+                }
+                if (vmap["open-thresh"].defaulted()) open_thresholds.assign(1, 5.0);
+                if (vmap["close-thresh"].defaulted()) close_thresholds.assign(1, 3.0);
+        }
+        if (spectral() && !(band_low >= 0 && band_low < band_high)) {
+                LOG << "ERROR: invalid frequency band";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (output_chans.size() != 1 && int(output_chans.size()) != nchannels) {
+                LOG << "ERROR: MIDI channels must be given once, or once per channel";
+                throw Exit(EXIT_FAILURE);
+        }
+}
@@ -0,0 +1,738 @@
+/*
+ * Runs the jdetect signal detector over recorded files, as fast as possible,
+ * and optionally scores a grid of parameters against labelled signals
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ */
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <sndfile.h>
+#include <arf.hpp>
+
+#include "jill/types.hh"
+#include "jill/logging.hh"
+#include "jill/program_options.hh"
+#include "jill/util/thread_config.hh"
+#include "jill/dsp/crossing_trigger_bank.hh"
+#include "jill/dsp/event_score.hh"
+
+#define PROGRAM_NAME "jdetect_offline"
+
+using namespace jill;
+using std::string;
+namespace fs = boost::filesystem;
+using bank_type = dsp::crossing_trigger_bank<float>;
+
+/* a set of detector parameters, in the units of the jdetect options */
+struct param_set_t {
+        float period_size_ms;
+        float open_thresh;
+        float open_rate;        // s^-1
+        float open_period_ms;
+        float close_thresh;
+        float close_rate;
+        float close_period_ms;
+
+        /* the period size in samples */
+        nframes_t period_size(nframes_t samplerate) const {
+                return period_size_ms * samplerate / 1000;
+        }
+
+        /* the parameters for a gate (converted as in jdetect) */
+        bank_type::params_type params(nframes_t samplerate) const {
+                nframes_t period = period_size(samplerate);
+                int open_periods = open_period_ms / period_size_ms;
+                int close_periods = close_period_ms / period_size_ms;
+                return { open_thresh, int(open_rate * period / 1000 * open_periods), std::size_t(open_periods),
+                         close_thresh, int(close_rate * period / 1000 * close_periods), std::size_t(close_periods) };
+        }
+};
+
+class jdetect_offline_options : public program_options {
+
+public:
+        jdetect_offline_options(string const &program_name);
+
+        /** The files to analyze */
+        std::vector<string> input_files;
+        /** The output file (csv or arf) */
+        string output_file;
+        /** The number of worker threads */
+        int nthreads;
+        /** The number of samples passed to the detector at a time */
+        int block_size;
+        /** Labelled signals to score the detector against (csv) */
+        string labels_file;
+        float tolerance_ms;
+
+        /** Values for each parameter; the grid includes every combination */
+        std::vector<float> open_thresholds;
+        std::vector<float> close_thresholds;
+        std::vector<float> open_crossing_rates;  // s^-1
+        std::vector<float> close_crossing_rates;
+        std::vector<float> period_sizes_ms;
+        std::vector<float> open_crossing_periods_ms;
+        std::vector<float> close_crossing_periods_ms;
+
+        bool adaptive;
+        float floor_time_s;
+
+        /** The parameter sets to evaluate */
+        std::vector<param_set_t> grid;
+
+protected:
+
+        void print_usage() override;
+        void process_options() override;
+
+}; // jdetect_offline_options
+
+
+jdetect_offline_options options(PROGRAM_NAME);
+
+/* the HDF5 library is not thread-safe, so only one thread can use it at a time */
+std::mutex hdf5_lock;
+
+/* whether a path names an ARF file */
+bool
+is_arf(string const & path)
+{
+        string ext = fs::path(path).extension().string();
+        return ext == ".arf" || ext == ".h5" || ext == ".hdf5";
+}
+
+/* a signal to analyze: all the channels in a sound file, or an ARF dataset */
+struct source_t {
+        string path;
+        string dataset;         // empty for sound files
+
+        string name() const { return dataset.empty() ? path : path + ":" + dataset; }
+};
+
+/* a signal detected in a channel (in samples from the start of the source) */
+struct interval_t {
+        std::uint64_t start;
+        std::uint64_t stop;
+        int channel;
+};
+
+/* the results of analyzing a source */
+struct result_t {
+        nframes_t samplerate = 0;
+        int nchannels = 0;
+        std::uint64_t nframes = 0;
+        std::vector<std::vector<interval_t> > intervals;  // for each parameter set
+        bool ok = false;
+};
+
+/* reads blocks of interleaved samples from a source */
+class sample_reader {
+public:
+        virtual ~sample_reader() = default;
+        virtual int channels() const = 0;
+        virtual nframes_t samplerate() const = 0;
+        /** Read up to nframes frames. @return the number read (0 at the end) */
+        virtual std::size_t read(float * buf, std::size_t nframes) = 0;
+};
+
+class sndfile_reader : public sample_reader {
+public:
+        sndfile_reader(string const & path) {
+                _sndfile = sf_open(path.c_str(), SFM_READ, &_sfinfo);
+                if (!_sndfile) throw FileError(sf_strerror(_sndfile));
+        }
+        ~sndfile_reader() override { sf_close(_sndfile); }
+        int channels() const override { return _sfinfo.channels; }
+        nframes_t samplerate() const override { return _sfinfo.samplerate; }
+        std::size_t read(float * buf, std::size_t nframes) override {
+                return sf_readf_float(_sndfile, buf, nframes);
+        }
+private:
+        SF_INFO _sfinfo;
+        SNDFILE * _sndfile;
+};
+
+/*
+ * Reads a one-dimensional sampled dataset from an ARF file. Integer samples
+ * are scaled to the range of the floating point samples used by JACK.
+ */
+class arf_reader : public sample_reader {
+public:
+        arf_reader(string const & path, string const & dataset)
+                : _file(-1), _dset(-1), _space(-1), _pos(0), _samplerate(0), _scale(1) {
+                std::lock_guard<std::mutex> lock(hdf5_lock);
+                _file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+                if (_file < 0) throw FileError("unable to open " + path);
+                _dset = H5Dopen2(_file, dataset.c_str(), H5P_DEFAULT);
+                if (_dset < 0) {
+                        close();
+                        throw FileError("unable to open dataset " + dataset);
+                }
+                _space = H5Dget_space(_dset);
+                hsize_t dims;
+                if (H5Sget_simple_extent_ndims(_space) != 1) {
+                        close();
+                        throw FileError(dataset + " is not a one-dimensional dataset");
+                }
+                H5Sget_simple_extent_dims(_space, &dims, nullptr);
+                _size = dims;
+                hid_t attr = H5Aopen(_dset, "sampling_rate", H5P_DEFAULT);
+                H5Aread(attr, H5T_NATIVE_UINT, &_samplerate);
+                H5Aclose(attr);
+                hid_t type = H5Dget_type(_dset);
+                if (H5Tget_class(type) == H5T_INTEGER)
+                        _scale = 1.0f / (1UL << (8 * H5Tget_size(type) - 1));
+                H5Tclose(type);
+        }
+        ~arf_reader() override {
+                std::lock_guard<std::mutex> lock(hdf5_lock);
+                close();
+        }
+        int channels() const override { return 1; }
+        nframes_t samplerate() const override { return _samplerate; }
+        std::size_t read(float * buf, std::size_t nframes) override {
+                hsize_t count = std::min<hsize_t>(nframes, _size - _pos);
+                if (count == 0) return 0;
+                {
+                        std::lock_guard<std::mutex> lock(hdf5_lock);
+                        hsize_t start = _pos;
+                        H5Sselect_hyperslab(_space, H5S_SELECT_SET, &start, nullptr, &count, nullptr);
+                        hid_t mem = H5Screate_simple(1, &count, nullptr);
+                        herr_t ret = H5Dread(_dset, H5T_NATIVE_FLOAT, mem, _space, H5P_DEFAULT, buf);
+                        H5Sclose(mem);
+                        if (ret < 0) throw FileError("error reading dataset");
+                }
+                if (_scale != 1)
+                        std::transform(buf, buf + count, buf, [this](float x) { return x * _scale; });
+                _pos += count;
+                return count;
+        }
+private:
+        void close() {
+                if (_space >= 0) H5Sclose(_space);
+                if (_dset >= 0) H5Dclose(_dset);
+                if (_file >= 0) H5Fclose(_file);
+        }
+        hid_t _file, _dset, _space;
+        hsize_t _size, _pos;
+        nframes_t _samplerate;
+        float _scale;
+};
+
+/* the names of the links in a group, in order */
+std::vector<string>
+child_names(hid_t group)
+{
+        std::vector<string> names;
+        H5G_info_t info;
+        H5Gget_info(group, &info);
+        for (hsize_t i = 0; i < info.nlinks; ++i) {
+                ssize_t len = H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, i,
+                                                 nullptr, 0, H5P_DEFAULT);
+                std::vector<char> name(len + 1);
+                H5Lget_name_by_idx(group, ".", H5_INDEX_NAME, H5_ITER_INC, i, name.data(), len + 1,
+                                   H5P_DEFAULT);
+                names.push_back(name.data());
+        }
+        return names;
+}
+
+/* the sampled (numeric, one-dimensional) datasets in the entries of an ARF file */
+std::vector<string>
+sampled_datasets(string const & path)
+{
+        std::lock_guard<std::mutex> lock(hdf5_lock);
+        std::vector<string> out;
+        hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file < 0) throw FileError("unable to open " + path);
+        for (string const & entry : child_names(file)) {
+                hid_t group = H5Oopen(file, entry.c_str(), H5P_DEFAULT);
+                if (group < 0) continue;
+                if (H5Iget_type(group) != H5I_GROUP) {
+                        H5Oclose(group);
+                        continue;
+                }
+                for (string const & name : child_names(group)) {
+                        hid_t d = H5Oopen(group, name.c_str(), H5P_DEFAULT);
+                        if (d < 0) continue;
+                        if (H5Iget_type(d) == H5I_DATASET) {
+                                hid_t type = H5Dget_type(d);
+                                hid_t space = H5Dget_space(d);
+                                H5T_class_t cls = H5Tget_class(type);
+                                if ((cls == H5T_FLOAT || cls == H5T_INTEGER) &&
+                                    H5Sget_simple_extent_ndims(space) == 1 &&
+                                    H5Aexists(d, "sampling_rate") > 0)
+                                        out.push_back(entry + "/" + name);
+                                H5Sclose(space);
+                                H5Tclose(type);
+                        }
+                        H5Oclose(d);
+                }
+                H5Oclose(group);
+        }
+        H5Fclose(file);
+        return out;
+}
+
+/*
+ * Run the detector over a source with each set of parameters. The parameters
+ * are converted to samples in the same way as in jdetect, and the samples are
+ * passed to the detector in blocks the size of a JACK period.
+ *
+ * The sets with the same period size are evaluated in one bank. The gates are
+ * ordered by channel and then by parameter set, so the gates that analyze the
+ * same input with the same threshold are next to each other and share their
+ * crossing counts.
+ */
+result_t
+scan(source_t const & source)
+{
+        std::unique_ptr<sample_reader> reader;
+        if (source.dataset.empty())
+                reader.reset(new sndfile_reader(source.path));
+        else
+                reader.reset(new arf_reader(source.path, source.dataset));
+
+        result_t result;
+        result.samplerate = reader->samplerate();
+        result.nchannels = reader->channels();
+        result.intervals.resize(options.grid.size());
+        std::size_t const nchan = result.nchannels;
+
+        struct bank_t {
+                std::vector<std::size_t> sets;          // parameter set of each column
+                std::unique_ptr<bank_type> bank;
+                std::vector<float const *> inputs;
+                std::vector<std::int64_t> onsets;       // for each gate
+        };
+        std::vector<bank_t> banks;
+        std::map<nframes_t, std::size_t> periods;
+        for (std::size_t s = 0; s < options.grid.size(); ++s) {
+                nframes_t period_size = options.grid[s].period_size(result.samplerate);
+                if (periods.find(period_size) == periods.end()) {
+                        periods[period_size] = banks.size();
+                        banks.emplace_back();
+                }
+                banks[periods[period_size]].sets.push_back(s);
+        }
+        for (auto & b : banks) {
+                param_set_t const & ps = options.grid[b.sets.front()];
+                std::vector<bank_type::params_type> params;
+                for (std::size_t k = 0; k < nchan; ++k)
+                        for (std::size_t s : b.sets)
+                                params.push_back(options.grid[s].params(result.samplerate));
+                b.bank.reset(new bank_type(params, ps.period_size(result.samplerate)));
+                if (options.adaptive)
+                        b.bank->set_adaptive(options.floor_time_s * 1000 / ps.period_size_ms);
+                b.inputs.resize(params.size());
+                b.onsets.assign(params.size(), -1);
+        }
+
+        // read in large chunks, which are split into blocks for the detector
+        std::size_t const block_size = options.block_size;
+        std::size_t const chunk_size = std::max<std::size_t>(1 << 16, block_size) / block_size * block_size;
+        std::vector<float> buf(chunk_size * nchan);
+        std::vector<std::vector<float> > channels(nchan, std::vector<float>(chunk_size));
+        std::size_t nframes;
+        while ((nframes = reader->read(buf.data(), chunk_size)) > 0) {
+                for (std::size_t k = 0; k < nchan && nchan > 1; ++k) {
+                        for (std::size_t i = 0; i < nframes; ++i)
+                                channels[k][i] = buf[i * nchan + k];
+                }
+                for (std::size_t i = 0; i < nframes; i += block_size) {
+                        std::uint64_t time = result.nframes + i;
+                        for (auto & b : banks) {
+                                std::size_t nsets = b.sets.size();
+                                for (std::size_t g = 0; g < b.inputs.size(); ++g)
+                                        b.inputs[g] = ((nchan > 1) ? channels[g / nsets].data() : buf.data()) + i;
+                                b.bank->push(b.inputs.data(), std::min(block_size, nframes - i),
+                                             [&](std::size_t g, std::size_t offset, bool open) {
+                                                     std::int64_t & onset = b.onsets[g];
+                                                     if (open)
+                                                             onset = time + offset;
+                                                     else if (onset >= 0) {
+                                                             result.intervals[b.sets[g % nsets]].push_back(
+                                                                     { std::uint64_t(onset), time + offset,
+                                                                       int(g / nsets) });
+                                                             onset = -1;
+                                                     }
+                                             });
+                        }
+                }
+                result.nframes += nframes;
+        }
+        // signals that are still going at the end of the file
+        for (auto & b : banks) {
+                std::size_t nsets = b.sets.size();
+                for (std::size_t g = 0; g < b.onsets.size(); ++g) {
+                        if (b.onsets[g] >= 0)
+                                result.intervals[b.sets[g % nsets]].push_back(
+                                        { std::uint64_t(b.onsets[g]), result.nframes, int(g / nsets) });
+                }
+        }
+        for (auto & intervals : result.intervals)
+                std::stable_sort(intervals.begin(), intervals.end(),
+                                 [](interval_t const & a, interval_t const & b) { return a.start < b.start; });
+        result.ok = true;
+        return result;
+}
+
+/* take sources from the list until there are none left */
+void
+worker(std::vector<source_t> const & sources, std::vector<result_t> & results, std::size_t * next)
+{
+        util::configure_thread("detector");
+        std::size_t i;
+        while ((i = __sync_fetch_and_add(next, 1)) < sources.size()) {
+                try {
+                        results[i] = scan(sources[i]);
+                        LOG << sources[i].name() << ": " << results[i].intervals[0].size() << " signals in "
+                            << double(results[i].nframes) / results[i].samplerate << " s"
+                            << ((options.grid.size() > 1) ? " (first parameter set)" : "");
+                }
+                catch (std::exception const & e) {
+                        LOG << "ERROR: " << sources[i].name() << ": " << e.what();
+                }
+        }
+}
+
+void
+write_csv(std::ostream & os, std::vector<source_t> const & sources, std::vector<result_t> const & results)
+{
+        os << "file,dataset,channel,start,stop,start_s,stop_s\n";
+        for (std::size_t i = 0; i < sources.size(); ++i) {
+                double sr = results[i].samplerate;
+                if (!results[i].ok) continue;
+                for (auto const & v : results[i].intervals[0]) {
+                        os << sources[i].path << ',' << sources[i].dataset << ',' << v.channel << ','
+                           << v.start << ',' << v.stop << ',' << v.start / sr << ',' << v.stop / sr << '\n';
+                }
+        }
+}
+
+/* Storage format for detected signals in ARF files */
+struct arf_interval_t {
+        std::uint64_t start;
+        std::uint64_t stop;
+};
+
+namespace arf { namespace h5t { namespace detail {
+
+template<>
+struct datatype_traits<arf_interval_t> {
+        static hid_t value() {
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(arf_interval_t));
+                H5Tinsert(ret, "start", HOFFSET(arf_interval_t, start), H5T_NATIVE_UINT64);
+                H5Tinsert(ret, "stop", HOFFSET(arf_interval_t, stop), H5T_NATIVE_UINT64);
+                return ret;
+        }
+};
+
+}}}
+
+/*
+ * Store the results in an ARF file, with an entry for each source and an
+ * interval dataset for each channel
+ */
+void
+write_arf(string const & path, std::vector<source_t> const & sources, std::vector<result_t> const & results)
+{
+        using namespace boost::posix_time;
+        arf::file file(path, "a");
+        time_duration now = microsec_clock::universal_time() - ptime(boost::gregorian::date(1970,1,1));
+        for (std::size_t i = 0; i < sources.size(); ++i) {
+                if (!results[i].ok) continue;
+                string name = sources[i].name();
+                std::replace(name.begin(), name.end(), '/', '_');
+                arf::entry entry(file, name, now.total_seconds(), now.fractional_seconds());
+                arf::h5a::node::attr_writer a = entry.write_attribute();
+                a("source_file", sources[i].path);
+                a("source_dataset", sources[i].dataset);
+                for (int k = 0; k < results[i].nchannels; ++k) {
+                        std::vector<arf_interval_t> records;
+                        for (auto const & v : results[i].intervals[0])
+                                if (v.channel == k) records.push_back({ v.start, v.stop });
+                        arf::packet_table_ptr pt =
+                                entry.create_packet_table<arf_interval_t>("signals_" + std::to_string(k),
+                                                                          "samples", arf::INTERVAL,
+                                                                          false, 1024, 0);
+                        pt->write_attribute("sampling_rate", results[i].samplerate);
+                        if (!records.empty())
+                                pt->write(records.data(), records.size());
+                }
+        }
+        file.flush();
+}
+
+/* labelled signals, in seconds, for each source and channel */
+using label_map = std::map<std::pair<string, int>, std::vector<std::pair<double, double> > >;
+
+/*
+ * Read labelled signals from a csv file with the same columns as the output
+ * (file, dataset, channel, start_s, and stop_s are used).
+ */
+label_map
+read_labels(string const & path)
+{
+        std::ifstream is(path);
+        if (!is) throw FileError("unable to open " + path);
+        auto split = [](string const & line) {
+                std::vector<string> fields;
+                std::stringstream ss(line);
+                string field;
+                while (std::getline(ss, field, ','))
+                        fields.push_back(field);
+                return fields;
+        };
+        string line;
+        std::getline(is, line);
+        std::vector<string> header = split(line);
+        std::vector<std::size_t> cols;
+        for (char const * name : { "file", "dataset", "channel", "start_s", "stop_s" }) {
+                auto it = std::find(header.begin(), header.end(), name);
+                if (it == header.end())
+                        throw FileError(path + " is missing column " + name);
+                cols.push_back(it - header.begin());
+        }
+        label_map labels;
+        while (std::getline(is, line)) {
+                if (line.empty()) continue;
+                std::vector<string> f = split(line);
+                f.resize(header.size());
+                source_t source = { f[cols[0]], f[cols[1]] };
+                try {
+                        labels[std::make_pair(source.name(), std::stoi(f[cols[2]]))].push_back(
+                                std::make_pair(std::stod(f[cols[3]]), std::stod(f[cols[4]])));
+                }
+                catch (std::logic_error const &) {
+                        throw FileError("invalid line in " + path + ": " + line);
+                }
+        }
+        for (auto & kv : labels)
+                std::sort(kv.second.begin(), kv.second.end());
+        return labels;
+}
+
+/*
+ * Score each parameter set against the labels, and write a line for each set.
+ * Channels without labels are assumed to have no signals.
+ */
+void
+write_scores(std::ostream & os, std::vector<source_t> const & sources,
+             std::vector<result_t> const & results, label_map const & labels)
+{
+        os << "period_size,open_thresh,open_rate,open_period,close_thresh,close_rate,close_period,"
+           << "hits,misses,false_alarms,latency_s\n";
+        for (std::size_t s = 0; s < options.grid.size(); ++s) {
+                dsp::event_score total;
+                for (std::size_t i = 0; i < sources.size(); ++i) {
+                        result_t const & r = results[i];
+                        if (!r.ok) continue;
+                        for (int k = 0; k < r.nchannels; ++k) {
+                                std::vector<dsp::interval_t> detected, labelled;
+                                for (auto const & v : r.intervals[s])
+                                        if (v.channel == k) detected.push_back({ v.start, v.stop });
+                                auto it = labels.find(std::make_pair(sources[i].name(), k));
+                                if (it != labels.end()) {
+                                        for (auto const & l : it->second)
+                                                labelled.push_back({ std::uint64_t(l.first * r.samplerate),
+                                                                     std::uint64_t(l.second * r.samplerate) });
+                                }
+                                dsp::event_score score =
+                                        dsp::score_events(detected, labelled,
+                                                          options.tolerance_ms * r.samplerate / 1000);
+                                score.latency /= r.samplerate;
+                                total += score;
+                        }
+                }
+                param_set_t const & p = options.grid[s];
+                os << p.period_size_ms << ',' << p.open_thresh << ',' << p.open_rate << ','
+                   << p.open_period_ms << ',' << p.close_thresh << ',' << p.close_rate << ','
+                   << p.close_period_ms << ',' << total.hits << ',' << total.misses << ','
+                   << total.false_alarms << ',' << total.mean_latency() << '\n';
+        }
+}
+
+
+int
+main(int argc, char **argv)
+{
+        using namespace boost::posix_time;
+        try {
+                options.parse(argc, argv);
+
+                std::vector<source_t> sources;
+                for (string const & path : options.input_files) {
+                        if (is_arf(path)) {
+                                for (string const & dset : sampled_datasets(path))
+                                        sources.push_back({ path, dset });
+                        }
+                        else
+                                sources.push_back({ path, "" });
+                }
+                label_map labels;
+                if (!options.labels_file.empty())
+                        labels = read_labels(options.labels_file);
+                LOG << "analyzing " << sources.size() << " sources with " << options.nthreads << " threads";
+                if (options.grid.size() > 1)
+                        LOG << "evaluating " << options.grid.size() << " parameter sets";
+
+                std::vector<result_t> results(sources.size());
+                std::vector<std::thread> threads;
+                std::size_t next = 0;
+                ptime t0 = microsec_clock::universal_time();
+                for (int i = 0; i < options.nthreads; ++i)
+                        threads.emplace_back(worker, std::cref(sources), std::ref(results), &next);
+                for (auto & t : threads)
+                        t.join();
+                double elapsed = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+
+                double total = 0;
+                int failed = 0;
+                for (auto const & r : results) {
+                        if (r.ok) total += double(r.nframes) * r.nchannels / r.samplerate;
+                        else failed += 1;
+                }
+                LOG << "analyzed " << total / 3600 << " hours of audio in " << elapsed << " s ("
+                    << total / 3600 / (elapsed / 60) << " hours/minute)";
+
+                if (!options.labels_file.empty()) {
+                        if (options.output_file == "-")
+                                write_scores(std::cout, sources, results, labels);
+                        else {
+                                std::ofstream os(options.output_file);
+                                if (!os) throw FileError("unable to open " + options.output_file);
+                                write_scores(os, sources, results, labels);
+                        }
+                }
+                else if (options.output_file == "-")
+                        write_csv(std::cout, sources, results);
+                else if (is_arf(options.output_file))
+                        write_arf(options.output_file, sources, results);
+                else {
+                        std::ofstream os(options.output_file);
+                        if (!os) throw FileError("unable to open " + options.output_file);
+                        write_csv(os, sources, results);
+                }
+                return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        catch (Exit const &e) {
+                return e.status();
+        }
+        catch (std::exception const &e) {
+                LOG << "ERROR: " << e.what();
+                return EXIT_FAILURE;
+        }
+}
+
+
+jdetect_offline_options::jdetect_offline_options(string const &program_name)
+        : program_options(program_name, false)
+{
+        po::options_description jillopts("JILL options");
+        jillopts.add_options()
+                ("output,o", po::value<string>(&output_file)->default_value("-"),
+                 "write detected signals to this file (.arf for ARF, otherwise csv; - for stdout)")
+                ("threads,j", po::value<int>(&nthreads)->default_value(std::max(1U, std::thread::hardware_concurrency())),
+                 "set number of worker threads (each analyzes one file or dataset at a time)")
+                ("block-size", po::value<int>(&block_size)->default_value(1024),
+                 "set number of samples passed to the detector at a time (as in the JACK period)")
+                ("labels", po::value<string>(&labels_file),
+                 "score the detector against the signals in this file (csv, same columns as output)")
+                ("tolerance", po::value<float>(&tolerance_ms)->default_value(0),
+                 "extend each labelled signal by this much on either side when scoring (ms)");
+
+        // same as jdetect, but each option can be given more than once to
+        // evaluate a grid of values
+        using fvec = std::vector<float>;
+        po::options_description tropts("Trigger options (see jdetect; give more than once for a grid)");
+        tropts.add_options()
+                ("period-size", po::value<fvec>(&period_sizes_ms)->default_value(fvec(1, 20), "20"),
+                 "set analysis period size (ms)")
+                ("open-thresh", po::value<fvec>(&open_thresholds)->default_value(fvec(1, 0.01), "0.01"),
+                 "set sample threshold for open gate (0-1.0)")
+                ("open-rate", po::value<fvec>(&open_crossing_rates)->default_value(fvec(1, 20), "20"),
+                 "set crossing rate thresh for open gate (s^-1)")
+                ("open-period", po::value<fvec>(&open_crossing_periods_ms)->default_value(fvec(1, 500), "500"),
+                 "set integration time for open gate (ms)")
+                ("close-thresh", po::value<fvec>(&close_thresholds)->default_value(fvec(1, 0.01), "0.01"),
+                 "set sample threshold for close gate")
+                ("close-rate", po::value<fvec>(&close_crossing_rates)->default_value(fvec(1, 2), "2"),
+                 "set crossing rate thresh for close gate (s^-1)")
+                ("close-period", po::value<fvec>(&close_crossing_periods_ms)->default_value(fvec(1, 5000), "5000"),
+                 "set integration time for close gate (ms)")
+                ("adaptive", po::bool_switch(&adaptive),
+                 "set thresholds as multiples of the noise floor (default open 5, close 3)")
+                ("floor-time", po::value<float>(&floor_time_s)->default_value(30),
+                 "set time constant for increases in the noise floor (s)");
+
+        cmd_opts.add(jillopts).add(tropts);
+        cmd_opts.add_options()
+                ("input", po::value<std::vector<string> >(&input_files), "input file");
+        pos_opts.add("input", -1);
+        visible_opts.add(jillopts).add(tropts);
+        add_thread_options();
+}
+
+void
+jdetect_offline_options::print_usage()
+{
+        std::cout << "Usage: " << _program_name << " [options] input-file [input-file ...]\n"
+                  << visible_opts << std::endl
+                  << "Inputs:\n"
+                  << " * .arf, .h5:  every sampled dataset in every entry\n"
+                  << " * otherwise:  sound file (every channel)\n"
+                  << "The CSV output has one line for each detected signal, with the start and\n"
+                  << "stop in samples and seconds relative to the start of the file or dataset.\n"
+                  << "With --labels, the output has one line for each combination of parameters,\n"
+                  << "with the number of labelled signals that were detected (hits) and missed,\n"
+                  << "the number of detections that don't match a label (false alarms), and the\n"
+                  << "mean delay from the labelled onsets to the detections."
+                  << std::endl;
+}
+
+void
+jdetect_offline_options::process_options()
+{
+        program_options::process_options();
+        if (input_files.empty()) {
+                LOG << "ERROR: no input files";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (nthreads < 1 || block_size < 1) {
+                LOG << "ERROR: number of threads and block size must be positive";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (adaptive) {
+                if (vmap["open-thresh"].defaulted()) open_thresholds.assign(1, 5.0);
+                if (vmap["close-thresh"].defaulted()) close_thresholds.assign(1, 3.0);
+        }
+        // the thresholds vary slowest, so that gates with the same
+        // threshold are next to each other in the detector banks
+        for (float period : period_sizes_ms)
+        for (float othresh : open_thresholds)
+        for (float cthresh : close_thresholds)
+        for (float orate : open_crossing_rates)
+        for (float operiod : open_crossing_periods_ms)
+        for (float crate : close_crossing_rates)
+        for (float cperiod : close_crossing_periods_ms)
+                grid.push_back({ period, othresh, orate, operiod, cthresh, crate, cperiod });
+        if (grid.size() > 1 && labels_file.empty()) {
+                LOG << "ERROR: evaluating more than one set of parameters requires --labels";
+                throw Exit(EXIT_FAILURE);
+        }
+}
@@ -12,14 +12,21 @@
  */
 #include <iostream>
 #include <csignal>
+#include <algorithm>
+#include <sstream>
 
 #include "jill/logging.hh"
 #include "jill/jack_client.hh"
 #include "jill/program_options.hh"
 #include "jill/midi.hh"
 #include "jill/file/arf_writer.hh"
+#include "jill/file/null_writer.hh"
+#include "jill/file/fanout_writer.hh"
+#include "jill/file/block_trace.hh"
 #include "jill/dsp/buffered_data_writer.hh"
 #include "jill/dsp/triggered_data_writer.hh"
+#include "jill/dsp/gated_data_writer.hh"
+#include "jill/dsp/crossing_trigger.hh"
 
 #define PROGRAM_NAME "jrecord"
 
@@ -39,12 +46,49 @@ public:
         /** key-value pairs to store as attributes in created entries */
         std::map<string, string> additional_options;
 
-        string output_file;
+        /** priorities for ports (port=priority); the default is never to shed */
+        std::map<string, string> port_priorities;
+        float shed_threshold;
+        /** decimation factors for sampled ports (port=factor) */
+        std::map<string, string> port_decimation;
+        int flush_interval_ms;
+        float flush_size_mb;
+
+        /**
+         * output specs; ports are split among them in contiguous groups. Each
+         * spec is a comma-separated list of sinks that get the same data.
+         */
+        svec output_files;
+        int group_size;
+        /** in triggered mode, trigger each output file separately */
+        bool trigger_groups;
         float pretrigger_size_s;
+        /** threshold for gating channels in continuous mode (0 to disable) */
+        float gate_threshold;
+        int gate_crossings;
+        svec ungated_ports;
         float posttrigger_size_s;
+        /** in triggered mode, merge onsets this soon after an offset into one entry */
+        float merge_holdoff_s;
+        bool pack_segments;
         float buffer_size_s;
         int max_size_mb;
         int compression;
+        string trace_file;
+
+        /** sampled ports to trigger recording from with in-process detectors */
+        svec detect_ports;
+        /** detector parameters (as in jdetect) */
+        float open_threshold;
+        float close_threshold;
+        float open_crossing_rate;  // s^-1
+        float close_crossing_rate;
+        float period_size_ms;
+        float open_crossing_period_ms;
+        float close_crossing_period_ms;
+
+        /** whether recording is triggered by events or detectors */
+        bool triggered() const { return vmap.count("trig") || !detect_ports.empty(); }
 
 protected:
 
@@ -55,8 +99,95 @@ protected:
 
 jrecord_options options(PROGRAM_NAME);
 std::unique_ptr<jack_client> client;
-std::unique_ptr<dsp::buffered_data_writer> arf_thread;
+/* one writer thread (and output file) per group of ports */
+std::vector<std::unique_ptr<dsp::buffered_data_writer> > arf_threads;
+/* the writer for each port in client->ports(), or -1 to send to all writers */
+std::vector<int> port_groups;
 jack_port_t * port_trig = nullptr;
+/* trigger ports and writers for additional trigger groups (--trig-groups) */
+std::vector<jack_port_t *> group_trigs;
+std::vector<std::unique_ptr<data_writer> > group_writers;
+int reset_pending = 0;
+/* optional record of all the calls to the writers */
+std::unique_ptr<file::block_trace_recorder> trace;
+
+
+/*
+ * Create the data_writer for an output spec. A spec is a comma-separated list
+ * of sinks, each of which is either an ARF file name (optionally prefixed with
+ * "arf:") or "null:" to discard the data. If there's more than one sink, the
+ * data are fanned out to all of them.
+ */
+std::unique_ptr<data_writer>
+make_writer(string const & spec, jack_client const & client)
+{
+        std::vector<std::unique_ptr<data_writer> > sinks;
+        std::istringstream ss(spec);
+        string sink;
+        while (std::getline(ss, sink, ',')) {
+                if (sink.empty()) continue;
+                if (sink.compare(0, 5, "null:") == 0) {
+                        sinks.emplace_back(new file::null_writer(false));
+                }
+                else {
+                        if (sink.compare(0, 4, "arf:") == 0) sink.erase(0, 4);
+                        auto * writer = new file::arf_writer(sink, client,
+                                                             options.additional_options,
+                                                             options.compression);
+                        sinks.emplace_back(writer);
+                        for (auto const & kv : options.port_decimation)
+                                writer->set_decimation(kv.first, std::stoi(kv.second));
+                }
+        }
+        if (sinks.empty())
+                throw std::runtime_error("invalid output spec: " + spec);
+        else if (sinks.size() == 1)
+                return std::move(sinks.front());
+        LOG << "writing " << spec << " to " << sinks.size() << " sinks";
+        return std::unique_ptr<data_writer>(new file::fanout_writer(std::move(sinks)));
+}
+
+
+/*
+ * Create a detector for triggering recordings, with the same parameters as
+ * jdetect
+ */
+std::unique_ptr<dsp::signal_detector<sample_t> >
+make_detector(nframes_t samplerate)
+{
+        nframes_t period_size = options.period_size_ms * samplerate / 1000;
+        int open_crossing_periods = options.open_crossing_period_ms / options.period_size_ms;
+        int close_crossing_periods  = options.close_crossing_period_ms / options.period_size_ms;
+        int open_count_thresh = options.open_crossing_rate * period_size / 1000 * open_crossing_periods;
+        int close_count_thresh = options.close_crossing_rate * period_size / 1000 * close_crossing_periods;
+        return std::unique_ptr<dsp::signal_detector<sample_t> >(
+                new dsp::crossing_trigger<sample_t>(options.open_threshold, open_count_thresh,
+                                                    open_crossing_periods,
+                                                    options.close_threshold, close_count_thresh,
+                                                    close_crossing_periods, period_size));
+}
+
+
+/* request that all writers start a new entry at the same period */
+void
+reset_writers()
+{
+        __sync_bool_compare_and_swap(&reset_pending, 0, 1);
+}
+
+
+inline void
+push(int group, nframes_t time, dtype_t dtype, char const * id, std::size_t size, void const * data)
+{
+        if (group < 0) {
+                for (auto & t : arf_threads)
+                        t->push(time, dtype, id, size, data);
+        }
+        else {
+                arf_threads[group]->push(time, dtype, id, size, data);
+        }
+        if (trace) trace->push(time, dtype, id, size, data);
+}
 
 
 int
@@ -65,13 +196,22 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
         jack_port_t *port;
         void *buffer;
 
-        for (auto it = client->ports().begin(); it != client->ports().end(); ++it) {
+        // reset all the writers before any data for this period is pushed, so
+        // that the entry boundaries are the same in every file
+        if (__sync_bool_compare_and_swap(&reset_pending, 1, 0)) {
+                for (auto & t : arf_threads)
+                        t->reset();
+                if (trace) trace->reset();
+        }
+
+        auto group = port_groups.begin();
+        for (auto it = client->ports().begin(); it != client->ports().end(); ++it, ++group) {
                 port = *it;
                 buffer = jack_port_get_buffer(port, nframes);
                 if (buffer == nullptr) continue;
                 if (strcmp(jack_port_type(port), JACK_DEFAULT_AUDIO_TYPE) == 0) {
-                        arf_thread->push(time, SAMPLED, jack_port_short_name(port),
-                                         nframes * sizeof(sample_t), buffer);
+                        push(*group, time, SAMPLED, jack_port_short_name(port),
+                             nframes * sizeof(sample_t), buffer);
                 }
                 else {
                         jack_midi_event_t event;
@@ -79,13 +219,15 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
                         for (nframes_t j = 0; j < nevents; ++j) {
                                 jack_midi_event_get(&event, buffer, j);
                                 if (event.size == 0) continue;
-                                arf_thread->push(time + event.time,
-                                                 EVENT, jack_port_short_name(port),
-                                                 event.size, event.buffer);
+                                push(*group, time + event.time,
+                                     EVENT, jack_port_short_name(port),
+                                     event.size, event.buffer);
                         }
                 }
         }
-        arf_thread->data_ready();
+        for (auto & t : arf_threads)
+                t->data_ready();
+        if (trace) trace->data_ready();
 
         return 0;
 }
@@ -95,7 +237,9 @@ int
 jack_xrun(jack_client *client, float delay)
 {
         // increment xrun counter
-        arf_thread->xrun();
+        for (auto & t : arf_threads)
+                t->xrun();
+        if (trace) trace->xrun();
         return 0;
 }
 
@@ -103,13 +247,20 @@ jack_xrun(jack_client *client, float delay)
 int
 jack_bufsize(jack_client *client, nframes_t nframes)
 {
-        std::size_t bytes = client->sampling_rate() * options.buffer_size_s * client->nports();
-        if (port_trig != nullptr)
-                bytes += client->sampling_rate() * options.pretrigger_size_s * client->nports();
-        // will block until buffer is empty (with any current implementation, anyway)
-        bytes = arf_thread->request_buffer_size(bytes * sizeof(sample_t));
-        arf_thread->reset();
-        LOG << "ringbuffer size (bytes): " << bytes;
+        for (std::size_t i = 0; i < arf_threads.size(); ++i) {
+                std::size_t nports = std::count_if(port_groups.begin(), port_groups.end(),
+                                                   [i](int g) { return g < 0 || g == int(i); });
+                std::size_t bytes = client->sampling_rate() * options.buffer_size_s * nports;
+                if (options.triggered() || options.gate_threshold > 0)
+                        bytes += client->sampling_rate() * options.pretrigger_size_s * nports;
+                // will block until buffer is empty (with any current implementation, anyway)
+                bytes = arf_threads[i]->request_buffer_size(bytes * sizeof(sample_t));
+                LOG << "ringbuffer size for " << options.output_files[i] << " (bytes): " << bytes;
+        }
+        if (trace)
+                trace->request_buffer_size(client->sampling_rate() * options.buffer_size_s *
+                                           client->nports() * sizeof(sample_t));
+        reset_writers();
         return 0;
 }
 
@@ -130,7 +281,7 @@ jack_portcon(jack_client *client, jack_port_t* port1, jack_port_t* port2, int co
                 INFO << "last input to trigger port disconnected";
                 // may not satisfy condition that a complete period was written
                 // by the consumer thread
-                arf_thread->reset();
+                reset_writers();
         }
 }
 
@@ -139,8 +290,9 @@ void
 jack_shutdown(jack_status_t code, char const * msg)
 {
         LOG << "jackd shut the client down (" << msg << ")";
-        if (arf_thread)
-                arf_thread->stop();
+        for (auto & t : arf_threads)
+                t->stop();
+        if (trace) trace->stop();
 }
 
 
@@ -148,8 +300,9 @@ void
 signal_handler(int sig)
 {
         DBG << "shutting down on signal";
-        if (arf_thread)
-                arf_thread->stop();
+        for (auto & t : arf_threads)
+                t->stop();
+        if (trace) trace->stop();
 }
 
 
@@ -157,34 +310,88 @@ int
 main(int argc, char **argv)
 {
         using namespace std;
-        using jill::file::arf_writer;
         int ret = 0;
         map<string,string> port_connections;
         try {
                 options.parse(argc,argv);
                 client.reset(new jack_client(options.client_name, options.server_name));
-                auto writer = std::make_unique<arf_writer>(options.output_file,
-                                                           *client,
-                                                           options.additional_options,
-                                                           options.compression);
 
                 /* create ports: one for trigger, and one for each input */
                 if (options.count("trig")) {
                         LOG << "recordings will be triggered";
                         port_trig = client->register_port("trig_in",JACK_DEFAULT_MIDI_TYPE,
                                                           JackPortIsInput | JackPortIsTerminal, 0);
-                        arf_thread.reset(new dsp::triggered_data_writer(
-                                                 std::move(writer),
-                                                 jack_port_short_name(port_trig),
-                                                 options.pretrigger_size_s * client->sampling_rate(),
-                                                 options.posttrigger_size_s * client->sampling_rate()));
+                        for (std::size_t i = 1; options.trigger_groups && i < options.output_files.size(); ++i) {
+                                string name = "trig_in_" + std::to_string(i);
+                                group_trigs.push_back(client->register_port(name, JACK_DEFAULT_MIDI_TYPE,
+                                                                            JackPortIsInput | JackPortIsTerminal, 0));
+                                LOG << "trigger port for " << options.output_files[i] << ": " << name;
+                        }
                 }
-                else {
+                if (!options.detect_ports.empty()) {
+                        LOG << "recordings will be triggered by signal detectors "
+                            << "(open threshold=" << options.open_threshold
+                            << ", close threshold=" << options.close_threshold << ")";
+                }
+                else if (!options.triggered() && options.gate_threshold > 0) {
+                        LOG << "recording will be continuous, gated by channel activity "
+                            << "(threshold=" << options.gate_threshold
+                            << ", crossings=" << options.gate_crossings << ")";
+                }
+                else if (!options.triggered()) {
                         LOG << "recording will be continuous";
-                        arf_thread.reset(new dsp::buffered_data_writer(std::move(writer)));
                 }
-                /* bind socket for storing messages in arf file */
-                arf_thread->bind_logger(options.server_name);
+                /* one writer per output file */
+                for (auto const & output_file : options.output_files) {
+                        auto writer = make_writer(output_file, *client);
+                        if (port_trig && !arf_threads.empty() && options.trigger_groups) {
+                                // added to the first writer once ports are assigned
+                                group_writers.push_back(std::move(writer));
+                        }
+                        else if (options.triggered()) {
+                                auto * t = new dsp::triggered_data_writer(
+                                        std::move(writer),
+                                        port_trig ? jack_port_short_name(port_trig) : "",
+                                        options.pretrigger_size_s * client->sampling_rate(),
+                                        options.posttrigger_size_s * client->sampling_rate());
+                                t->set_merge_holdoff(options.merge_holdoff_s * client->sampling_rate());
+                                t->set_pack_segments(options.pack_segments);
+                                arf_threads.emplace_back(t);
+                        }
+                        else if (options.gate_threshold > 0) {
+                                auto * t = new dsp::gated_data_writer(
+                                        std::move(writer),
+                                        options.gate_threshold, options.gate_crossings,
+                                        options.pretrigger_size_s * client->sampling_rate(),
+                                        options.posttrigger_size_s * client->sampling_rate());
+                                for (auto const & port : options.ungated_ports)
+                                        t->set_ungated(port);
+                                arf_threads.emplace_back(t);
+                        }
+                        else {
+                                arf_threads.emplace_back(new dsp::buffered_data_writer(std::move(writer)));
+                        }
+                }
+                /* set load-shedding parameters */
+                for (auto & t : arf_threads) {
+                        t->set_flush_policy(options.flush_interval_ms,
+                                            options.flush_size_mb * 1024 * 1024);
+                        t->set_shed_threshold(options.shed_threshold);
+                        for (auto const & kv : options.port_priorities) {
+                                t->set_priority(kv.first, std::stoi(kv.second));
+                        }
+                }
+                for (auto const & kv : options.port_priorities)
+                        LOG << "priority for " << kv.first << ": " << kv.second;
+
+                if (!options.trace_file.empty()) {
+                        trace.reset(new file::block_trace_recorder(options.trace_file,
+                                                                   client->sampling_rate(),
+                                                                   client->buffer_size()));
+                }
+
+                /* bind socket for storing messages in the first arf file */
+                arf_threads.front()->bind_logger(options.server_name);
 
                 /* register input ports */
                 if (options.count("in")) {
@@ -229,6 +436,57 @@ main(int argc, char **argv)
                                                JackPortIsInput | JackPortIsTerminal, 0);
                 }
 
+                /* assign input ports to writers in contiguous groups. The
+                 * trigger port goes to all writers. */
+                std::size_t nfiles = options.output_files.size();
+                std::size_t ninputs = client->nports() - (port_trig ? 1 : 0) - group_trigs.size();
+                std::size_t group_size = options.group_size;
+                if (group_size == 0)
+                        group_size = (ninputs + nfiles - 1) / nfiles;
+                std::size_t input_idx = 0;
+                std::vector<svec> group_channels(nfiles);
+                for (auto port : client->ports()) {
+                        if (port == port_trig ||
+                            std::find(group_trigs.begin(), group_trigs.end(), port) != group_trigs.end()) {
+                                port_groups.push_back(-1);
+                                continue;
+                        }
+                        std::size_t group = std::min(input_idx++ / std::max<std::size_t>(group_size, 1),
+                                                     nfiles - 1);
+                        group_channels[group].push_back(jack_port_short_name(port));
+                        // with trigger groups, all the files share a writer thread
+                        port_groups.push_back(group_writers.empty() ? group : 0);
+                        if (nfiles > 1)
+                                LOG << jack_port_short_name(port) << " -> " << options.output_files[group];
+                }
+                for (std::size_t i = 0; i < group_writers.size(); ++i) {
+                        auto * t = static_cast<dsp::triggered_data_writer *>(arf_threads.front().get());
+                        t->add_trigger_group(std::move(group_writers[i]),
+                                             jack_port_short_name(group_trigs[i]),
+                                             group_channels[i + 1],
+                                             options.pretrigger_size_s * client->sampling_rate(),
+                                             options.posttrigger_size_s * client->sampling_rate());
+                }
+                /* add detectors to the threads that receive the ports */
+                for (auto const & name : options.detect_ports) {
+                        auto it = std::find_if(client->ports().begin(), client->ports().end(),
+                                               [&name](jack_port_t const * p) {
+                                                       return name == jack_port_short_name(p);
+                                               });
+                        if (it == client->ports().end() ||
+                            strcmp(jack_port_type(*it), JACK_DEFAULT_AUDIO_TYPE) != 0) {
+                                LOG << "ERROR: no sampled input port " << name << " to detect signals on";
+                                throw Exit(EXIT_FAILURE);
+                        }
+                        int group = port_groups[std::distance(client->ports().begin(), it)];
+                        for (std::size_t i = 0; i < arf_threads.size(); ++i) {
+                                if (group >= 0 && int(i) != group) continue;
+                                auto * t = static_cast<dsp::triggered_data_writer *>(arf_threads[i].get());
+                                t->add_detector(name, make_detector(client->sampling_rate()));
+                        }
+                        LOG << "detecting signals on " << name;
+                }
+
                 // register signal handlers
                 signal(SIGINT,  signal_handler);
                 signal(SIGTERM, signal_handler);
@@ -243,7 +501,9 @@ main(int argc, char **argv)
 
                 // start disk thread and activate process callback
                 client->activate();
-                arf_thread->start();
+                for (auto & t : arf_threads)
+                        t->start();
+                if (trace) trace->start();
 
                 /* connect ports */
                 if (options.count("trig")) {
@@ -255,7 +515,9 @@ main(int argc, char **argv)
                         if (!it->second.empty()) client->connect_port(it->second, it->first);
                 }
 
-                arf_thread->join();
+                for (auto & t : arf_threads)
+                        t->join();
+                if (trace) trace->join();
 
         }
         catch (Exit const &e) {
@@ -268,9 +530,10 @@ main(int argc, char **argv)
 
         // manually deactivating the client ensures shutdown events get logged
         if (client) client->deactivate();
-        // force arf thread to destroy its socket; otherwise it happens
+        // force arf threads to destroy their sockets; otherwise it happens
         // very late and zmq complains about a dangling socket.
-        arf_thread.reset();
+        arf_threads.clear();
+        trace.reset();
         return ret;
 }
 
@@ -294,37 +557,93 @@ jrecord_options::jrecord_options(string const &program_name)
                 ("trig,t",    po::value<svec>()->multitoken()->zero_tokens(),
                  "record in triggered mode (optionally specify inputs)")
                 ("buffer",     po::value<float>(&buffer_size_s)->default_value(2.0),
-                 "minimum ringbuffer size (s)");
+                 "minimum ringbuffer size (s)")
+                ("group-size", po::value<int>(&group_size)->default_value(0),
+                 "number of input ports per output file (default: split evenly)")
+                ("trig-groups", po::bool_switch(&trigger_groups),
+                 "in triggered mode, trigger each output file from its own port (trig_in, "
+                 "trig_in_1, ...) and write all the files from one thread")
+                ("priority",   po::value<svec>(),
+                 "set priority of a port under load (port=0-9; lower is dropped first)")
+                ("shed-threshold", po::value<float>(&shed_threshold)->default_value(0.5),
+                 "fraction of free ringbuffer below which ports start to be dropped");
 
         po::options_description tropts("Capture options");
         tropts.add_options()
                 ("attr,a",     po::value<svec>(),
                  "set additional attributes for recorded entries (key=value)")
                 ("pretrigger", po::value<float>(&pretrigger_size_s)->default_value(1.0),
-                 "duration to record before onset trigger (s)")
+                 "duration to record before onset trigger or channel activity (s)")
                 ("posttrigger", po::value<float>(&posttrigger_size_s)->default_value(0.5),
-                 "duration to record after offset trigger (s)")
+                 "duration to record after offset trigger or channel activity (s)")
+                ("merge-holdoff", po::value<float>(&merge_holdoff_s)->default_value(0),
+                 "in triggered mode, extend the current entry if an onset arrives this soon "
+                 "after an offset (s)")
+                ("pack-segments", po::bool_switch(&pack_segments),
+                 "in triggered mode, store all triggered segments in one entry until reset")
+                ("gate",       po::value<float>(&gate_threshold)->default_value(0),
+                 "in continuous mode, only write sampled ports while the signal crosses this threshold")
+                ("gate-crossings", po::value<int>(&gate_crossings)->default_value(1),
+                 "number of threshold crossings in a period for a port to be active")
+                ("no-gate",    po::value<svec>(&ungated_ports),
+                 "always write this port when gating")
                 ("compression", po::value<int>(&compression)->default_value(0),
-                 "set compression in output file (0-9)");
+                 "set compression in output file (0-9)")
+                ("decimate",   po::value<svec>(),
+                 "store a sampled port at a reduced rate (port=factor)")
+                ("flush-interval", po::value<int>(&flush_interval_ms)->default_value(1000),
+                 "flush to disk when idle and this long since last flush (ms; 0 to disable)")
+                ("flush-size", po::value<float>(&flush_size_mb)->default_value(0),
+                 "flush to disk after this much data (MB; 0 to disable)")
+                ("trace", po::value<string>(&trace_file),
+                 "record a block trace of the session to this file (see test_replay)");
+
+        po::options_description detopts("Detector options (see jdetect)");
+        detopts.add_options()
+                ("detect",     po::value<svec>(&detect_ports),
+                 "trigger recording with a signal detector on this sampled port "
+                 "(with more than one output file, requires --trig-groups)")
+                ("period-size", po::value<float>(&period_size_ms)->default_value(20),
+                 "set analysis period size (ms)")
+                ("open-thresh", po::value<float>(&open_threshold)->default_value(0.01),
+                 "set sample threshold for open gate (0-1.0)")
+                ("open-rate", po::value<float>(&open_crossing_rate)->default_value(20),
+                 "set crossing rate thresh for open gate (s^-1)")
+                ("open-period", po::value<float>(&open_crossing_period_ms)->default_value(500),
+                 "set integration time for open gate (ms)")
+                ("close-thresh", po::value<float>(&close_threshold)->default_value(0.01),
+                 "set sample threshold for close gate")
+                ("close-rate", po::value<float>(&close_crossing_rate)->default_value(2),
+                 "set crossing rate thresh for close gate (s^-1)")
+                ("close-period", po::value<float>(&close_crossing_period_ms)->default_value(5000),
+                 "set integration time for close gate (ms)");
 
         // command-line options
-        cmd_opts.add(jillopts).add(tropts);
+        cmd_opts.add(jillopts).add(tropts).add(detopts);
         cmd_opts.add_options()
-                ("output-file,f", po::value<string>(), "output filename");
+                ("output-file,f", po::value<svec>(&output_files),
+                 "output file (specify more than once to split ports across files; "
+                 "use file1,file2 to write the same ports to several files)");
         pos_opts.add("output-file", -1);
-        visible_opts.add(jillopts).add(tropts);
+        visible_opts.add(jillopts).add(tropts).add(detopts);
+        add_thread_options();
 }
 
 
 void
 jrecord_options::print_usage()
 {
-        std::cout << "Usage: " << _program_name << " [options] [output-file]\n"
+        std::cout << "Usage: " << _program_name << " [options] [output-file] [output-file ...]\n"
                   << visible_opts << std::endl
                   << "Ports (all are recorded):\n"
                   << " * pcm_NNN:    sampled input ports\n"
                   << " * evt_NNN:    event input ports\n"
-                  << " * trig_in:    MIDI port to receive events triggering recording"
+                  << " * trig_in:    MIDI port to receive events triggering recording\n"
+                  << " * trig_in_N:  with --trig-groups, triggers recording to output file N\n"
+                  << "Outputs:\n"
+                  << " * FILE or arf:FILE  ARF file\n"
+                  << " * null:             discard data\n"
+                  << " * SINK,SINK,...     send the same data to several sinks"
                   << std::endl;
 }
 
@@ -333,9 +652,78 @@ void
 jrecord_options::process_options()
 {
         program_options::process_options();
-        if (!assign(output_file, "output-file")) {
+        if (output_files.empty()) {
                 LOG << "ERROR: missing required output file name " << std::endl;
                 throw Exit(EXIT_FAILURE);
         }
+        if (group_size < 0) {
+                LOG << "ERROR: group size must be non-negative";
+                throw Exit(EXIT_FAILURE);
+        }
+        /* every output file needs at least one input, or it will be created empty */
+        std::size_t nfiles = output_files.size();
+        std::size_t ninputs = 0;
+        for (char const * name : { "in", "in-pcm", "in-evt" })
+                if (count(name)) ninputs += vmap[name].as<svec>().size();
+        std::size_t size = (group_size > 0) ? group_size : (ninputs + nfiles - 1) / nfiles;
+        if (nfiles > 1 && size * (nfiles - 1) >= ninputs) {
+                LOG << "ERROR: " << ninputs << " inputs in groups of " << size
+                    << " leave some of the " << nfiles << " output files empty";
+                throw Exit(EXIT_FAILURE);
+        }
         parse_keyvals(additional_options, "attr");
+        if (flush_interval_ms < 0 || flush_size_mb < 0) {
+                LOG << "ERROR: flush interval and size must be non-negative";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (flush_interval_ms == 0 && flush_size_mb == 0)
+                LOG << "data will only be flushed to disk when entries are closed";
+        parse_keyvals(port_priorities, "priority");
+        for (auto const & kv : port_priorities) {
+                try {
+                        std::stoi(kv.second);
+                }
+                catch (std::logic_error const &) {
+                        LOG << "ERROR: invalid priority for " << kv.first << ": " << kv.second;
+                        throw Exit(EXIT_FAILURE);
+                }
+        }
+        if (gate_threshold < 0 || gate_crossings < 1) {
+                LOG << "ERROR: gate threshold must be non-negative and gate crossings positive";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (trigger_groups && !count("trig")) {
+                LOG << "ERROR: trigger groups only apply to triggered recording";
+                throw Exit(EXIT_FAILURE);
+        }
+        // a detector only sees the ports of one writer thread, so without
+        // trigger groups it would open entries in just one of the files
+        if (!detect_ports.empty() && output_files.size() > 1 && !trigger_groups) {
+                LOG << "ERROR: detecting signals with more than one output file requires --trig-groups";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (merge_holdoff_s < 0) {
+                LOG << "ERROR: merge hold-off must be non-negative";
+                throw Exit(EXIT_FAILURE);
+        }
+        if ((merge_holdoff_s > 0 || pack_segments) && !triggered()) {
+                LOG << "ERROR: merging segments only applies to triggered recording";
+                throw Exit(EXIT_FAILURE);
+        }
+        if (gate_threshold > 0 && triggered()) {
+                LOG << "ERROR: gating only applies to continuous recording";
+                throw Exit(EXIT_FAILURE);
+        }
+        parse_keyvals(port_decimation, "decimate");
+        for (auto const & kv : port_decimation) {
+                int factor = 0;
+                try {
+                        factor = std::stoi(kv.second);
+                }
+                catch (std::logic_error const &) {}
+                if (factor < 1) {
+                        LOG << "ERROR: invalid decimation factor for " << kv.first << ": " << kv.second;
+                        throw Exit(EXIT_FAILURE);
+                }
+        }
 }
@@ -356,6 +356,7 @@ jstim_options::jstim_options(string const &program_name)
                 ("stim", po::value<vector<string> >(&stimuli)->multitoken(), "stimulus file");
         pos_opts.add("stim", -1);
         visible_opts.add(jillopts).add(opts);
+        add_thread_options();
 }
 
 void
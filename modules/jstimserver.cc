@@ -26,6 +26,7 @@
 #include "jill/midi.hh"
 #include "jill/file/stimfile.hh"
 #include "jill/dsp/ringbuffer.hh"
+#include "jill/util/thread_config.hh"
 
 constexpr char PROGRAM_NAME[] = "jstimserver";
 
@@ -201,6 +202,7 @@ init_stimset(std::vector<string> const & stims, nframes_t sampling_rate)
 void
 stim_monitor()
 {
+        util::configure_thread("stimulus monitor");
         // set up zeromq socket
         fs::path path{"/tmp/org.meliza.jill"};
         path /= options.server_name;
@@ -407,6 +409,7 @@ jstim_options::jstim_options(string const &program_name)
                 ("_stim", po::value<vector<string> >(&stimuli)->multitoken(), "stimulus file");
         pos_opts.add("_stim", -1);
         visible_opts.add(jillopts).add(opts);
+        add_thread_options();
 }
 
 void
@@ -1,10 +1,13 @@
 #include <iostream>
 #include <cassert>
+#include <cstdio>
 #include <map>
 #include <string>
 #include <boost/shared_ptr.hpp>
 #include <boost/assign/list_of.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <hdf5.h>
+#include <hdf5_hl.h>
 
 #include "jill/data_writer.hh"
 #include "jill/data_source.hh"
@@ -62,7 +65,7 @@ private:
 };
 
 void
-test_entry()
+test_entry(int nchannels = 2)
 {
         int nperiods = 10;
         nframes_t start = -3000; // test overflow
@@ -83,7 +86,7 @@ test_entry()
         assert(writer->ready());
 
         for (int i = 0; i < nperiods; ++i) {
-                for (int j = 0; j < 2; ++j ) {
+                for (int j = 0; j < nchannels; ++j ) {
                         // set name
                         sprintf((char *)(period + 1), pattern, j);
                         writer->write(period, 0, 0);
@@ -95,6 +98,29 @@ test_entry()
         assert(!writer->ready());
         free(buf);
 }
+/* a gated channel: the first half of every period is inactive */
+void
+test_gaps(int nperiods)
+{
+        nframes_t nframes = 1024;
+        void * buf = malloc(sizeof(data_block_t) + 7 + nframes * sizeof(sample_t));
+        data_block_t * period = reinterpret_cast<data_block_t*>(buf);
+
+        period->time = 0;
+        period->dtype = SAMPLED;
+        period->sz_id = 7;
+        period->sz_data = nframes * sizeof(sample_t);
+        sprintf((char *)(period + 1), "pcm_000");
+
+        writer->new_entry(period->time);
+        for (int i = 0; i < nperiods; ++i) {
+                writer->gap("pcm_000", period->time, nframes / 2, INACTIVE);
+                writer->write(period, nframes / 2, nframes);
+                period->time += nframes;
+        }
+        writer->close_entry();
+        free(buf);
+}
 
 int
 main(int argc, char** argv)
@@ -103,7 +129,34 @@ main(int argc, char** argv)
                 ("experiment","write stuff");
 
         null_source source("test", 20000);
+        std::remove("test.arf");
         writer.reset(new file::arf_writer("test.arf", source, attrs, 0));
         writer->log(microsec_clock::universal_time(), "test", "a log message");
         test_entry();
+
+        // the next entry and its datasets can be created ahead of time
+        int steps = 0;
+        while (writer->prepare_entry()) ++steps;
+        assert(steps == 3);     // entry and two channels
+        // only one channel gets data, so the other prepared dataset is removed
+        test_entry(1);
+
+        // reopen the file; entry numbering should resume from the index
+        writer.reset(new file::arf_writer("test.arf", source, attrs, 0));
+        test_entry();
+        // every gap is kept, however many there are in an entry
+        test_gaps(5000);
+        writer.reset();
+
+        hid_t file = H5Fopen("test.arf", H5F_ACC_RDONLY, H5P_DEFAULT);
+        assert(file >= 0);
+        assert(H5Lexists(file, "test_0002", H5P_DEFAULT) > 0);
+        assert(H5Lexists(file, "test_0001/pcm_000", H5P_DEFAULT) > 0);
+        assert(H5Lexists(file, "test_0001/pcm_001", H5P_DEFAULT) == 0);
+        hid_t gaps = H5PTopen(file, "test_0003/jill_gaps");
+        hsize_t ngaps = 0;
+        H5PTget_num_packets(gaps, &ngaps);
+        assert(ngaps == 5000);
+        H5PTclose(gaps);
+        H5Fclose(file);
 }
@@ -1,5 +1,14 @@
 #include <iostream>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <vector>
+#include <boost/circular_buffer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 
 #include "jill/dsp/crossing_trigger.hh"
@@ -7,10 +16,28 @@
 using namespace std;
 using namespace jill;
 
-void test_counter(size_t size)
+/* the original running counter, based on a circular buffer, for comparison */
+class boost_counter {
+public:
+        explicit boost_counter(size_t size) : _counts(size), _running_count(0) {}
+        void push(int count) {
+                if (_counts.full())
+                        _running_count -= _counts.front();
+                _counts.push_back(count);
+                _running_count += count;
+        }
+        bool full() const { return _counts.full(); }
+        int running_count() const { return _running_count; }
+private:
+        boost::circular_buffer<int> _counts;
+        int _running_count;
+};
+
+template <typename Counter>
+void test_counter(Counter & counter, size_t size)
 {
         int count = 0;
-        dsp::running_counter<int> counter(size);
+        assert(counter.capacity() == size);
         for (size_t i = 0; i < size; ++i) {
                 assert(!counter.full());
                 count += i;
@@ -25,26 +52,205 @@ void test_counter(size_t size)
         }
         counter.reset();
         assert(!counter.full());
+        assert(counter.running_count() == 0);
+}
+
+/* the running counter matches the circular buffer for random values */
+template <typename Counter>
+void test_against_boost(Counter & counter, size_t size)
+{
+        boost_counter ref(size);
+        for (size_t i = 0; i < 1000; ++i) {
+                int v = rand() % 100 - 20;
+                counter.push(v);
+                ref.push(v);
+                assert(counter.full() == ref.full());
+                assert(counter.running_count() == ref.running_count());
+        }
+        std::ostringstream os;
+        counter.reset();
+        counter.push(3);
+        counter.push(4);
+        os << counter;
+        assert(os.str() == "7 [2/" + to_string(size) + "] (3 4 )");
 }
 
-void test_crossing_counter(size_t thresh, size_t period_size, size_t period_count, size_t nblocks)
+/* throughput of the running counter's push */
+template <typename Counter>
+void benchmark_running(char const * name, Counter & counter)
 {
+        using namespace boost::posix_time;
+        size_t const n = 1 << 26;
+        int ret = 0;
+        ptime t0 = microsec_clock::universal_time();
+        for (size_t i = 0; i < n; ++i) {
+                counter.push(i & 7);
+                ret += counter.full() && counter.running_count() > 100;
+        }
+        double secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+        printf("  %s: %.1f Mpushes/s (%d)\n", name, n / secs * 1e-6, ret);
+}
+
+/* the original sample-by-sample crossing counter, for comparison */
+class reference_counter {
+public:
+        reference_counter(float thresh, size_t period_size, size_t period_count)
+                : _counter(period_count), _thresh(thresh), _period_size(period_size),
+                  _period_crossings(0), _period_nsamples(0),
+                  _max_crossings(period_count * period_size / 2) {}
+
+        int push(float const * samples, size_t size, int count_thresh, float * state) {
+                int ret = -1;
+                float last = *samples;
+                // where the crossings in the current period occurred (-1 for earlier blocks)
+                vector<int> crossings(_period_crossings, -1);
+                size_t start = 1;
+                if (state)
+                        state[0] = float(_counter.running_count()) / _max_crossings;
+                for (size_t i = 1; i < size; ++i) {
+                        if (last < _thresh && samples[i] >= _thresh) {
+                                _period_crossings += 1;
+                                crossings.push_back(i);
+                        }
+                        last = samples[i];
+                        _period_nsamples += 1;
+                        if (_period_nsamples >= _period_size) {
+                                _counter.push(_period_crossings);
+                                if (_counter.full() && ret < 0) {
+                                        if (count_thresh > 0 && _counter.running_count() > count_thresh) {
+                                                // the crossing that put the count over the threshold
+                                                int base = _counter.running_count() - _period_crossings;
+                                                int k = count_thresh - base;
+                                                ret = (k < 0) ? start : std::max<int>(crossings[k], start);
+                                        }
+                                        else if (count_thresh < 0 && _counter.running_count() < -count_thresh)
+                                                ret = i;
+                                }
+                                start = i + 1;
+                                crossings.clear();
+                                _period_nsamples = 0;
+                                _period_crossings = 0;
+                        }
+                        if (state)
+                                state[i] = float(_counter.running_count()) / _max_crossings;
+                }
+                return ret;
+        }
+        int count() const { return _counter.running_count(); }
+
+private:
+        dsp::running_counter<int> _counter;
+        float _thresh;
+        size_t _period_size;
+        int _period_crossings;
+        size_t _period_nsamples;
+        int _max_crossings;
+};
+
+/* a noisy signal with bursts, exact threshold values, and NaNs */
+vector<float> make_signal(size_t n, float thresh)
+{
+        vector<float> x(n);
+        for (size_t i = 0; i < n; ++i) {
+                float amp = ((i / 1000) % 3 == 0) ? 1.0f : 0.05f;
+                x[i] = amp * (float(rand()) / RAND_MAX - 0.5f);
+                if (rand() % 50 == 0) x[i] = thresh;
+                if (rand() % 500 == 0) x[i] = std::numeric_limits<float>::quiet_NaN();
+        }
+        return x;
+}
+
+/* the crossing counter gives the same results as the reference in any blocking */
+void test_crossing_counter(float thresh, size_t period_size, size_t period_count, size_t max_block)
+{
+        vector<float> x = make_signal(50000, thresh);
+        vector<float> state(x.size()), ref_state(x.size());
         dsp::crossing_counter<float> counter(thresh, period_size, period_count);
+        reference_counter ref(thresh, period_size, period_count);
         assert(counter.count() == 0);
         assert(counter.thresh() == thresh);
 
-        for (size_t block = 0; block < nblocks; ++block) {
-                // generate a chunk of data
-                // push it to counter
-                // verify return value
+        int count_thresh = std::max<int>(period_count * period_size / 20, 1);
+        int ndetect = 0;
+        for (size_t i = 0; i + 2 <= x.size();) {
+                size_t n = std::min<size_t>(2 + rand() % max_block, x.size() - i);
+                int c = (i / 5000) % 2 ? -count_thresh : count_thresh;
+                int r1 = counter.push(x.data() + i, n, c, state.data() + i);
+                int r2 = ref.push(x.data() + i, n, c, ref_state.data() + i);
+                assert(r1 == r2);
+                assert(counter.count() == ref.count());
+                ndetect += (r1 >= 0);
+                i += n;
         }
+        // bit for bit
+        assert(memcmp(state.data(), ref_state.data(), state.size() * sizeof(float)) == 0);
+        printf("  period=%zu x %zu, block<=%zu: %d threshold crossings\n", period_size, period_count,
+               max_block + 1, ndetect);
 }
 
-int main(int, char**)
+/* throughput of a crossing counter (on one core), with and without the state output */
+template <typename Counter>
+void benchmark(size_t block_size, bool with_state, char const * label="")
 {
+        using namespace boost::posix_time;
+        vector<float> x = make_signal(block_size, 0.1f), state(block_size);
+        Counter counter(0.1f, 441, 25);
+        size_t nblocks = (1 << 26) / block_size;
+        int ret = 0;
+        ptime t0 = microsec_clock::universal_time();
+        for (size_t i = 0; i < nblocks; ++i)
+                ret += counter.push(x.data(), x.size(), 1000, with_state ? state.data() : nullptr);
+        double secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+        printf("  %sblock=%zu, state=%d: %.1f Msamples/s (%d)\n", label, block_size, with_state,
+               nblocks * block_size / secs * 1e-6, ret);
+}
 
-        test_counter(10);
+int main(int, char**)
+{
 
-}
+        {
+                dsp::running_counter<int> c10(10), c8(8), c1(1), c25(25);
+                dsp::running_counter<int, 10> f10;
+                dsp::running_counter<int, 25> f25;
+                test_counter(c10, 10);
+                test_counter(c8, 8);
+                test_counter(c1, 1);
+                test_counter(f10, 10);
+                test_against_boost(c25, 25);
+                test_against_boost(f25, 25);
+                test_against_boost(c8, 8);
+                bool thrown = false;
+                try { dsp::running_counter<int, 10> bad(9); }
+                catch (std::invalid_argument const &) { thrown = true; }
+                assert(thrown);
 
+                printf("running counters (window=25):\n");
+                boost_counter b25(25);
+                benchmark_running("circular_buffer", b25);
+                benchmark_running("ring", c25);
+                benchmark_running("fixed ring", f25);
+        }
 
+        printf("reference:\n");
+        benchmark<reference_counter>(1024, false);
+        benchmark<reference_counter>(1024, true);
+        for (char const * kernel : { "scalar", "sse2", "avx2", "avx512" }) {
+                if (!dsp::set_crossing_kernel(kernel)) {
+                        printf("%s kernel not supported\n", kernel);
+                        continue;
+                }
+                printf("%s kernel:\n", dsp::crossing_kernel());
+                srand(1);
+                test_crossing_counter(0.1f, 441, 25, 1024);
+                test_crossing_counter(0.1f, 64, 4, 64);
+                test_crossing_counter(0.0f, 7, 3, 5);
+                test_crossing_counter(-0.2f, 1, 10, 300);
+                benchmark<dsp::crossing_counter<float> >(1024, false);
+                benchmark<dsp::crossing_counter<float> >(1024, true);
+                benchmark<dsp::crossing_counter<float> >(64, false);
+                benchmark<dsp::crossing_counter<float, 441, 25> >(64, false, "fixed, ");
+        }
+        dsp::set_crossing_kernel("auto");
+        printf("default kernel: %s\n", dsp::crossing_kernel());
+        printf("passed tests\n");
+}
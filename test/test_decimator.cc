@@ -0,0 +1,127 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "jill/dsp/fir_decimator.hh"
+
+using namespace jill;
+using namespace jill::dsp;
+using std::vector;
+
+/* direct-form reference: output at frame t, treating frames outside x as zero */
+static double
+reference(vector<float> const & h, vector<float> const & x, nframes_t start, nframes_t t)
+{
+        framediff_t delay = (h.size() - 1) / 2;
+        double y = 0;
+        for (std::size_t j = 0; j < h.size(); ++j) {
+                framediff_t i = framediff_t(t) - delay + framediff_t(j) - framediff_t(start);
+                if (i >= 0 && i < framediff_t(x.size()))
+                        y += double(h[j]) * x[i];
+        }
+        return y;
+}
+
+/* run the decimator over x in blocks of random size, collecting the output */
+static nframes_t
+run(fir_decimator & dec, vector<float> const & x, nframes_t start, vector<float> & out,
+    std::size_t max_block)
+{
+        vector<float> buf;
+        nframes_t first = 0, frame;
+        dec.reset(start);
+        out.clear();
+        for (std::size_t i = 0; i < x.size();) {
+                std::size_t n = std::min<std::size_t>(1 + rand() % max_block, x.size() - i);
+                dec.process(x.data() + i, n, buf, frame);
+                if (out.empty() && !buf.empty()) first = frame;
+                else if (!buf.empty())
+                        assert(frame == first + out.size() * dec.factor());
+                out.insert(out.end(), buf.begin(), buf.end());
+                i += n;
+        }
+        return first;
+}
+
+static void
+test_reference(unsigned int factor, nframes_t start)
+{
+        vector<float> x(20000), out, tail;
+        for (auto & v : x) v = float(rand()) / RAND_MAX - 0.5f;
+        fir_decimator dec(factor);
+        nframes_t first = run(dec, x, start, out, 1024);
+        assert(first % factor == 0 && first - start < factor);
+        // outputs wait for delay() frames of future input
+        assert(dec.next_frame() == start + x.size());
+        nframes_t frame;
+        dec.flush(tail, frame);
+        assert(frame == first + out.size() * factor);
+        out.insert(out.end(), tail.begin(), tail.end());
+        assert(out.size() == (x.size() - (first - start) + factor - 1) / factor);
+        double maxerr = 0;
+        for (std::size_t k = 0; k < out.size(); ++k)
+                maxerr = std::max(maxerr, std::fabs(out[k] - reference(dec.taps(), x, start,
+                                                                       first + k * factor)));
+        printf("factor=%u start=%u: %zu taps, %zu outputs, max error=%g\n",
+               factor, start, dec.taps().size(), out.size(), maxerr);
+        assert(maxerr < 1e-5);
+
+        // same output regardless of block boundaries
+        vector<float> out2;
+        run(dec, x, start, out2, 7);
+        for (std::size_t k = 0; k < out2.size(); ++k)
+                assert(out2[k] == out[k]);
+}
+
+/* gain for a sinusoid of frequency f (relative to the input rate) */
+static double
+gain(unsigned int factor, double f)
+{
+        vector<float> x(40000), out;
+        for (std::size_t i = 0; i < x.size(); ++i) x[i] = std::sin(2 * M_PI * f * i);
+        fir_decimator dec(factor);
+        run(dec, x, 0, out, 512);
+        double power = 0;
+        std::size_t k0 = out.size() / 4, k1 = out.size() * 3 / 4;
+        for (std::size_t k = k0; k < k1; ++k)
+                power += double(out[k]) * out[k];
+        return std::sqrt(2 * power / (k1 - k0));
+}
+
+int
+main(int, char **)
+{
+        using namespace boost::posix_time;
+        for (unsigned int factor : { 1, 2, 3, 8, 10 }) {
+                test_reference(factor, 0);
+                test_reference(factor, 12345);
+        }
+
+        // passband and stopband of the anti-aliasing filter
+        for (unsigned int factor : { 2, 4, 10 }) {
+                double pass = gain(factor, 0.21 / factor);
+                double stop = gain(factor, 0.75 / factor);
+                printf("factor=%u: passband gain=%.4f, stopband gain=%.2g dB\n",
+                       factor, pass, 20 * std::log10(stop));
+                assert(std::fabs(pass - 1) < 0.01);
+                assert(stop < 0.01);
+        }
+
+        // throughput, in blocks of 1024 samples
+        vector<float> x(1024), out;
+        for (auto & v : x) v = float(rand()) / RAND_MAX - 0.5f;
+        for (unsigned int factor : { 2, 10 }) {
+                fir_decimator dec(factor);
+                nframes_t frame;
+                std::size_t nblocks = 20000;
+                ptime t0 = microsec_clock::universal_time();
+                for (std::size_t i = 0; i < nblocks; ++i)
+                        dec.process(x.data(), x.size(), out, frame);
+                double secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+                printf("factor=%u: %.1f Msamples/s\n", factor, nblocks * x.size() / secs * 1e-6);
+        }
+        printf("passed tests\n");
+}
@@ -0,0 +1,83 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jill/dsp/triggered_data_writer.hh"
+#include "jill/dsp/crossing_trigger.hh"
+
+using namespace jill;
+
+/* records the entries and the frames written to them */
+class entry_writer : public data_writer {
+public:
+        struct entry_t {
+                nframes_t start;
+                std::map<std::string, std::vector<nframes_t> > frames;
+        };
+
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t frame) override {
+                close_entry();
+                entries.push_back({frame, {}});
+                _open = true;
+        }
+        void close_entry() override { _open = false; }
+        void xrun() override {}
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                assert(_open);
+                stop = (stop > 0) ? std::min(stop, data->nframes()) : data->nframes();
+                for (nframes_t i = start; i < stop; ++i)
+                        entries.back().frames[data->id()].push_back(data->time + i);
+        }
+
+        std::vector<entry_t> entries;
+private:
+        bool _open = false;
+};
+
+int
+main(int, char **)
+{
+        const nframes_t nframes = 64;
+        const nframes_t pretrigger = 512;
+        const nframes_t posttrigger = 256;
+        const nframes_t burst_on = 40, burst_off = 60;
+        std::vector<sample_t> quiet(nframes, 0.0f), loud(nframes);
+        for (nframes_t i = 0; i < nframes; ++i)
+                loud[i] = std::sin(2 * M_PI * i / 8);
+
+        entry_writer * writer = new entry_writer;
+        dsp::basic_triggered_data_writer<entry_writer> thread((std::unique_ptr<entry_writer>(writer)),
+                                                              "", pretrigger, posttrigger);
+        // opens after more than 10 crossings in 4 periods; closes after
+        // fewer than 2 in 4 periods
+        thread.add_detector("pcm_a", std::unique_ptr<dsp::signal_detector<sample_t> >(
+                                    new dsp::crossing_trigger<sample_t>(0.5, 10, 4, 0.5, 2, 4, nframes)));
+        thread.request_buffer_size(1 << 20);
+
+        for (nframes_t i = 0; i < 100; ++i) {
+                std::vector<sample_t> const & a = (i >= burst_on && i < burst_off) ? loud : quiet;
+                thread.push(i * nframes, SAMPLED, "pcm_a", nframes * sizeof(sample_t), a.data());
+                thread.push(i * nframes, SAMPLED, "pcm_b", nframes * sizeof(sample_t), quiet.data());
+        }
+        thread.start();
+        thread.stop();
+        thread.join();
+
+        // one entry that covers the burst, with the same frames in each channel
+        assert(writer->entries.size() == 1);
+        auto const & entry = writer->entries[0];
+        auto const & a = entry.frames.at("pcm_a");
+        printf("entry: start=%u, frames=%u--%u (signal %u--%u)\n", entry.start, a.front(),
+               a.back() + 1, burst_on * nframes, burst_off * nframes);
+        assert(a.front() == entry.start);
+        assert(a.front() <= burst_on * nframes);
+        assert(a.back() + 1 >= burst_off * nframes + posttrigger);
+        for (std::size_t i = 0; i < a.size(); ++i)
+                assert(a[i] == a.front() + i);
+        assert(entry.frames.at("pcm_b") == a);
+        printf("passed tests\n");
+}
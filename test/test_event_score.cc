@@ -0,0 +1,51 @@
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include "jill/dsp/event_score.hh"
+
+using namespace jill::dsp;
+using std::vector;
+
+int
+main(int, char **)
+{
+        vector<interval_t> labels = { { 100, 200 }, { 500, 600 }, { 1000, 1100 } };
+
+        // perfect detection
+        event_score s = score_events(labels, labels);
+        assert(s.hits == 3 && s.misses == 0 && s.false_alarms == 0 && s.latency == 0);
+
+        // nothing detected, or nothing labelled
+        s = score_events(vector<interval_t>(), labels);
+        assert(s.hits == 0 && s.misses == 3 && s.false_alarms == 0);
+        s = score_events(labels, vector<interval_t>());
+        assert(s.hits == 0 && s.misses == 0 && s.false_alarms == 3);
+
+        // late, early, split, and spurious detections
+        vector<interval_t> detected = { { 20, 40 }, { 150, 250 }, { 480, 520 }, { 540, 700 },
+                                        { 800, 900 } };
+        s = score_events(detected, labels);
+        assert(s.hits == 2 && s.misses == 1 && s.false_alarms == 2);
+        assert(s.latency == 50 - 20);
+        assert(s.mean_latency() == 15);
+
+        // the tolerance extends the labels
+        detected = { { 205, 300 }, { 1105, 1200 } };
+        s = score_events(detected, labels);
+        assert(s.hits == 0 && s.misses == 3 && s.false_alarms == 2);
+        s = score_events(detected, labels, 10);
+        assert(s.hits == 2 && s.misses == 1 && s.false_alarms == 0);
+        assert(s.latency == 105 + 105);
+
+        // one detection spanning two labels hits both
+        detected = { { 150, 550 } };
+        s = score_events(detected, labels);
+        assert(s.hits == 2 && s.misses == 1 && s.false_alarms == 0);
+
+        event_score total;
+        total += s;
+        total += s;
+        assert(total.hits == 4 && total.misses == 2);
+        printf("passed tests\n");
+}
@@ -0,0 +1,88 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "jill/file/fanout_writer.hh"
+
+using namespace jill;
+
+/* counts calls; optionally sleeps on every write to simulate a slow disk */
+class counting_writer : public data_writer {
+public:
+        counting_writer(int & entries, int & frames, int & xruns, int & missing, int & flushes,
+                        int delay_ms=0)
+                : _open(false), _entries(entries), _frames(frames), _xruns(xruns), _missing(missing),
+                  _flushes(flushes), _delay(delay_ms) {}
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t) override { _open = true; _entries += 1; }
+        void close_entry() override { _open = false; }
+        void xrun() override { _xruns += 1; }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                if (_delay) std::this_thread::sleep_for(std::chrono::milliseconds(_delay));
+                stop = (stop > 0) ? std::min(stop, data->nframes()) : data->nframes();
+                _frames += stop - start;
+        }
+        void gap(std::string const &, nframes_t, nframes_t nframes, gap_cause_t cause) override {
+                assert(cause == OVERRUN);
+                _missing += nframes;
+        }
+        void flush() override { _flushes += 1; }
+private:
+        bool _open;
+        int & _entries;
+        int & _frames;
+        int & _xruns;
+        int & _missing;
+        int & _flushes;
+        int _delay;
+};
+
+int
+main(int, char **)
+{
+        const nframes_t nframes = 64;
+        const int nblocks = 100;
+        int entries[2] = {0}, frames[2] = {0}, xruns[2] = {0}, missing[2] = {0}, flushes[2] = {0};
+
+        std::vector<char> buf(sizeof(data_block_t) + 7 + nframes * sizeof(sample_t));
+        data_block_t * block = reinterpret_cast<data_block_t *>(buf.data());
+        block->time = 0;
+        block->dtype = SAMPLED;
+        block->sz_id = 7;
+        block->sz_data = nframes * sizeof(sample_t);
+        memcpy(block + 1, "pcm_000", 7);
+
+        {
+                std::vector<std::unique_ptr<data_writer> > children;
+                children.emplace_back(new counting_writer(entries[0], frames[0], xruns[0], missing[0], flushes[0]));
+                children.emplace_back(new counting_writer(entries[1], frames[1], xruns[1], missing[1], flushes[1], 2));
+                // the queue only holds a few blocks, so the slow child will overrun
+                file::fanout_writer writer(std::move(children), 10 * block->size());
+                assert(writer.size() == 2);
+                assert(!writer.ready());
+                for (int i = 0; i < nblocks; ++i) {
+                        writer.write(block, 0, 0);
+                        block->time += nframes;
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                assert(writer.ready());
+                writer.flush();
+                writer.close_entry();
+                assert(!writer.ready());
+        }
+        printf("fast child: entries=%d, frames=%d, missing=%d\n", entries[0], frames[0], missing[0]);
+        printf("slow child: entries=%d, frames=%d, missing=%d\n", entries[1], frames[1], missing[1]);
+        assert(entries[0] == 1 && entries[1] == 1);
+        assert(frames[0] == int(nblocks * nframes));
+        assert(frames[1] < int(nblocks * nframes));
+        // dropped frames are accounted for exactly
+        assert(frames[1] + missing[1] == int(nblocks * nframes));
+        assert(missing[0] == 0);
+        assert(xruns[0] == 0 && xruns[1] == 0);
+        // children only flush when asked
+        assert(flushes[0] == 1 && flushes[1] == 1);
+        printf("passed tests\n");
+}
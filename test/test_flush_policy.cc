@@ -0,0 +1,113 @@
+/*
+ * Measures the throughput of the buffered writer thread under different flush
+ * policies. The sink appends blocks to a temporary file and calls fdatasync()
+ * when flushed, which approximates the cost of flushing an ARF file. Periods
+ * are pushed with data_ready() after each one, as in a JACK process callback.
+ *
+ * usage: test_flush_policy [nperiods] [period_size] [nchannels]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+
+#include "jill/data_writer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+
+using namespace jill;
+
+/* writes to a temporary file and syncs it on flush */
+class file_writer final : public data_writer {
+public:
+        file_writer() : _fp(tmpfile()), _open(false), flushes(0) {}
+        ~file_writer() { fclose(_fp); }
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t) override { _open = true; }
+        void close_entry() override { _open = false; }
+        void xrun() override {}
+        void write(data_block_t const * data, nframes_t, nframes_t) override {
+                if (!_open) new_entry(data->time);
+                fwrite(data, data->size(), 1, _fp);
+        }
+        void flush() override {
+                fflush(_fp);
+                fdatasync(fileno(_fp));
+                flushes += 1;
+        }
+private:
+        FILE * _fp;
+        bool _open;
+public:
+        int flushes;
+};
+
+struct result_t {
+        double mb_per_s;
+        int flushes;
+        std::uint64_t dropped;
+};
+
+result_t
+run(std::size_t nperiods, nframes_t period_size, std::size_t nchannels,
+    unsigned int interval_ms, std::size_t flush_bytes)
+{
+        std::vector<sample_t> samples(period_size, 0.5f);
+        std::size_t block_bytes = sizeof(data_block_t) + 8 + period_size * sizeof(sample_t);
+        file_writer * writer = new file_writer;
+        // the buffer holds all the data, so nothing is dropped and the time
+        // to drain it measures the throughput of the writer thread
+        dsp::basic_buffered_data_writer<file_writer> thread((std::unique_ptr<file_writer>(writer)),
+                                                            block_bytes * nchannels * (nperiods + 1));
+        thread.set_flush_policy(interval_ms, flush_bytes);
+
+        char id[16];
+        auto start = std::chrono::steady_clock::now();
+        thread.start();
+        for (std::size_t i = 0; i < nperiods; ++i) {
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        snprintf(id, sizeof(id), "pcm_%03zu", c);
+                        thread.push(i * period_size, SAMPLED, id, period_size * sizeof(sample_t),
+                                    samples.data());
+                }
+                thread.data_ready();
+        }
+        thread.stop();
+        thread.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        result_t ret;
+        ret.mb_per_s = block_bytes * nchannels * nperiods / elapsed.count() / (1 << 20);
+        ret.flushes = writer->flushes;
+        ret.dropped = 0;
+        for (std::size_t c = 0; c < nchannels; ++c) {
+                snprintf(id, sizeof(id), "pcm_%03zu", c);
+                ret.dropped += thread.dropped_frames(id);
+        }
+        return ret;
+}
+
+int
+main(int argc, char ** argv)
+{
+        std::size_t nperiods = (argc > 1) ? atol(argv[1]) : 20000;
+        nframes_t period_size = (argc > 2) ? atol(argv[2]) : 32;
+        std::size_t nchannels = (argc > 3) ? atol(argv[3]) : 16;
+        std::size_t period_bytes = (sizeof(data_block_t) + 8 + period_size * sizeof(sample_t)) * nchannels;
+
+        struct { char const * name; unsigned int interval_ms; std::size_t bytes; } policies[] = {
+                { "every period", 0, period_bytes },
+                { "every 10 ms", 10, 0 },
+                { "every 1000 ms", 1000, 0 },
+                { "every 4 MB", 0, 4 << 20 },
+                { "on entry close", 0, 0 },
+        };
+
+        printf("periods=%zu, period=%u, channels=%zu\n", nperiods, period_size, nchannels);
+        for (auto const & p : policies) {
+                result_t r = run(nperiods, period_size, nchannels, p.interval_ms, p.bytes);
+                printf("%-16s %8.1f MB/s  flushes=%-6d dropped=%lu\n", p.name, r.mb_per_s, r.flushes,
+                       (unsigned long)r.dropped);
+        }
+        return 0;
+}
@@ -0,0 +1,103 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jill/dsp/gated_data_writer.hh"
+
+using namespace jill;
+
+/* records the frames written and the frames reported inactive for each channel */
+class interval_writer : public data_writer {
+public:
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t) override { _open = true; entries += 1; }
+        void close_entry() override { _open = false; }
+        void xrun() override { xruns += 1; }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                assert(_open);
+                if (data->dtype == EVENT) {
+                        events += 1;
+                        return;
+                }
+                stop = (stop > 0) ? std::min(stop, data->nframes()) : data->nframes();
+                auto const * samples = static_cast<sample_t const *>(data->data());
+                for (nframes_t i = start; i < stop; ++i)
+                        written[data->id()][data->time + i] = samples[i];
+        }
+        void gap(std::string const & id, nframes_t frame, nframes_t nframes, gap_cause_t cause) override {
+                assert(cause == INACTIVE);
+                for (nframes_t i = 0; i < nframes; ++i)
+                        inactive[id].push_back(frame + i);
+        }
+
+        std::map<std::string, std::map<nframes_t, sample_t> > written;
+        std::map<std::string, std::vector<nframes_t> > inactive;
+        int entries = 0;
+        int events = 0;
+        int xruns = 0;
+private:
+        bool _open = false;
+};
+
+int
+main(int, char **)
+{
+        const nframes_t nframes = 64;
+        const nframes_t prepad = 100;
+        const nframes_t postpad = 200;
+        const int nperiods = 200;
+        const int active_period = 50;
+        std::vector<sample_t> quiet(nframes, 0.0f), loud(nframes);
+        for (nframes_t i = 0; i < nframes; ++i)
+                loud[i] = std::sin(2 * M_PI * i / 16) + 0.001f * i;
+
+        interval_writer * writer = new interval_writer;
+        dsp::basic_gated_data_writer<interval_writer> thread((std::unique_ptr<interval_writer>(writer)),
+                                                             0.5, 2, prepad, postpad);
+        thread.request_buffer_size(1 << 20);
+        thread.set_ungated("pcm_c");
+
+        for (int i = 0; i < nperiods; ++i) {
+                nframes_t time = i * nframes;
+                std::vector<sample_t> const & a = (i == active_period) ? loud : quiet;
+                thread.push(time, SAMPLED, "pcm_a", nframes * sizeof(sample_t), a.data());
+                thread.push(time, SAMPLED, "pcm_b", nframes * sizeof(sample_t), quiet.data());
+                thread.push(time, SAMPLED, "pcm_c", nframes * sizeof(sample_t), quiet.data());
+                if (i % 50 == 0) {
+                        char msg[] = { char(0x90), 60, 64 };
+                        thread.push(time, EVENT, "evt", sizeof(msg), msg);
+                }
+        }
+        thread.start();
+        thread.stop();
+        thread.join();
+
+        // the active channel is written from prepad frames before the active
+        // period to postpad frames after it, with the original samples
+        nframes_t onset = active_period * nframes - prepad;
+        nframes_t offset = (active_period + 1) * nframes + postpad;
+        auto const & a = writer->written["pcm_a"];
+        printf("pcm_a: written=%zu (%u--%u), inactive=%zu\n", a.size(), a.begin()->first,
+               a.rbegin()->first + 1, writer->inactive["pcm_a"].size());
+        assert(a.size() == offset - onset);
+        assert(a.begin()->first == onset && a.rbegin()->first == offset - 1);
+        for (nframes_t i = 0; i < nframes; ++i)
+                assert(a.at(active_period * nframes + i) == loud[i]);
+        // and everything else is reported inactive
+        assert(writer->inactive["pcm_a"].size() + a.size() == nperiods * nframes);
+        for (nframes_t t : writer->inactive["pcm_a"])
+                assert(a.count(t) == 0);
+
+        // quiet channels are not written; ungated channels and events always are
+        assert(writer->written["pcm_b"].empty());
+        assert(writer->inactive["pcm_b"].size() == nperiods * nframes);
+        assert(writer->written["pcm_c"].size() == nperiods * nframes);
+        assert(writer->inactive["pcm_c"].empty());
+        assert(writer->events == nperiods / 50);
+        assert(writer->entries == 1);
+        assert(writer->xruns == 0);
+        printf("passed tests\n");
+}
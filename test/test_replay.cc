@@ -0,0 +1,372 @@
+/*
+ * Replays a block trace (recorded with jrecord --trace) or a synthetic session
+ * into a buffered or triggered writer as fast as possible, and reports
+ * throughput, the latency between push() and the sink's write(), and the peak
+ * occupancy of the ringbuffer.
+ *
+ * When built as test_replay_arf, data can also be written to an ARF file.
+ *
+ * usage: test_replay [options]; see --help
+ */
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "jill/midi.hh"
+#include "jill/file/block_trace.hh"
+#include "jill/file/null_writer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+#include "jill/dsp/triggered_data_writer.hh"
+#ifdef JILL_REPLAY_ARF
+#include "jill/data_source.hh"
+#include "jill/file/arf_writer.hh"
+#endif
+
+using namespace jill;
+using std::string;
+namespace po = boost::program_options;
+using clock_type = std::chrono::steady_clock;
+
+/* a call to the data_thread, with its data in a shared buffer */
+struct op_t {
+        file::trace_op_t op;
+        nframes_t time;
+        dtype_t dtype;
+        std::size_t chan;        // index into channel names
+        std::size_t offset;      // offset of data in buffer
+        std::size_t size;
+};
+
+/* the session to replay, loaded into memory */
+struct session_t {
+        nframes_t sampling_rate;
+        std::vector<string> channels;
+        std::vector<op_t> ops;
+        std::vector<char> data;
+        std::size_t nblocks = 0;
+        std::size_t nbytes = 0;
+
+        std::size_t channel(string const & id) {
+                auto it = std::find(channels.begin(), channels.end(), id);
+                if (it != channels.end()) return it - channels.begin();
+                channels.push_back(id);
+                return channels.size() - 1;
+        }
+
+        void push(nframes_t time, dtype_t dtype, string const & id, void const * ptr, std::size_t size) {
+                op_t op = { file::TRACE_PUSH, time, dtype, channel(id), data.size(), size };
+                char const * p = static_cast<char const *>(ptr);
+                data.insert(data.end(), p, p + size);
+                ops.push_back(op);
+                nblocks += 1;
+                nbytes += size;
+        }
+
+        void call(file::trace_op_t o, nframes_t time) {
+                op_t op = { o, time, SAMPLED, 0, 0, 0 };
+                ops.push_back(op);
+        }
+};
+
+/* a sampled block written by the sink */
+struct write_t {
+        clock_type::time_point when;
+        nframes_t time;
+        std::size_t chan;
+};
+
+/* passes data to another writer and records when each block is written */
+class timing_writer final : public data_writer {
+public:
+        timing_writer(std::unique_ptr<data_writer> writer, session_t const & session)
+                : _writer(std::move(writer)) {
+                for (std::size_t i = 0; i < session.channels.size(); ++i)
+                        _channels[session.channels[i]] = i;
+                writes.reserve(session.nblocks);
+        }
+        bool ready() const override { return _writer->ready(); }
+        void new_entry(nframes_t frame) override { _writer->new_entry(frame); }
+        void close_entry() override { _writer->close_entry(); }
+        void xrun() override { _writer->xrun(); }
+        void gap(string const & id, nframes_t frame, nframes_t nframes, gap_cause_t cause) override {
+                _writer->gap(id, frame, nframes, cause);
+        }
+        void segment(nframes_t onset, nframes_t offset) override { _writer->segment(onset, offset); }
+        void flush() override { _writer->flush(); }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                _writer->write(data, start, stop);
+                writes.push_back({clock_type::now(), data->time, _channels[data->id()]});
+        }
+
+        std::vector<write_t> writes;
+private:
+        std::unique_ptr<data_writer> _writer;
+        std::unordered_map<string, std::size_t> _channels;
+};
+
+#ifdef JILL_REPLAY_ARF
+/* a data source with a fixed sampling rate and no clock */
+class replay_source : public data_source {
+public:
+        replay_source(nframes_t sampling_rate) : _sampling_rate(sampling_rate) {}
+        char const * name() const override { return "test_replay"; }
+        nframes_t sampling_rate() const override { return _sampling_rate; }
+        nframes_t frame() const override { return 0; }
+        nframes_t frame(utime_t t) const override { return t * _sampling_rate / 1000000; }
+        utime_t time(nframes_t t) const override { return utime_t(t) * 1000000 / _sampling_rate; }
+        utime_t time() const override { return 0; }
+private:
+        nframes_t _sampling_rate;
+};
+#endif
+
+void
+load_trace(session_t & session, string const & path)
+{
+        file::block_trace_reader reader(path);
+        file::trace_record_t rec;
+        string id;
+        std::vector<char> data;
+        session.sampling_rate = reader.sampling_rate();
+        while (reader.next(rec, id, data)) {
+                if (rec.op == file::TRACE_PUSH)
+                        session.push(rec.time, dtype_t(rec.dtype), id, data.data(), data.size());
+                else
+                        session.call(file::trace_op_t(rec.op), rec.time);
+        }
+}
+
+/*
+ * Generate a session with nchannels sampled channels. If trigger_on is nonzero,
+ * a trigger channel turns on for trigger_on periods out of every
+ * trigger_on + trigger_off.
+ */
+void
+make_session(session_t & session, nframes_t sampling_rate, std::size_t nchannels,
+             nframes_t period_size, std::size_t nperiods,
+             std::size_t trigger_on, std::size_t trigger_off)
+{
+        char id[16];
+        std::vector<sample_t> samples(period_size);
+        midi::data_type onset[] = { midi::note_on, midi::default_pitch, midi::default_velocity };
+        midi::data_type offset[] = { midi::note_off, midi::default_pitch, 0 };
+        session.sampling_rate = sampling_rate;
+        for (std::size_t i = 0; i < nperiods; ++i) {
+                nframes_t time = i * period_size;
+                // as in jrecord, the trigger port comes first
+                if (trigger_on > 0) {
+                        std::size_t phase = i % (trigger_on + trigger_off);
+                        if (phase == 0)
+                                session.push(time, EVENT, "trig_in", onset, sizeof(onset));
+                        else if (phase == trigger_on)
+                                session.push(time, EVENT, "trig_in", offset, sizeof(offset));
+                }
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        for (nframes_t j = 0; j < period_size; ++j)
+                                samples[j] = 0.1 * ((time + j + c) % 100);
+                        snprintf(id, sizeof(id), "pcm_%03zu", c);
+                        session.push(time, SAMPLED, id, samples.data(), period_size * sizeof(sample_t));
+                }
+                session.call(file::TRACE_DATA_READY, time);
+        }
+}
+
+void
+save_session(session_t const & session, string const & path, nframes_t period_size)
+{
+        file::block_trace_recorder recorder(path, session.sampling_rate, period_size);
+        recorder.request_buffer_size(session.data.size() + session.ops.size() * 64);
+        recorder.start();
+        for (auto const & op : session.ops) {
+                switch (op.op) {
+                case file::TRACE_PUSH:
+                        recorder.push(op.time, op.dtype, session.channels[op.chan].c_str(), op.size,
+                                      session.data.data() + op.offset);
+                        break;
+                case file::TRACE_DATA_READY:
+                        recorder.data_ready();
+                        break;
+                case file::TRACE_XRUN:
+                        recorder.xrun();
+                        break;
+                case file::TRACE_RESET:
+                        recorder.reset();
+                        break;
+                }
+        }
+        recorder.stop();
+        recorder.join();
+        assert(recorder.dropped() == 0);
+}
+
+std::unique_ptr<data_writer>
+make_writer(string const & spec, session_t const & session)
+{
+        if (spec == "null:")
+                return std::unique_ptr<data_writer>(new file::null_writer(false));
+#ifdef JILL_REPLAY_ARF
+        static std::unique_ptr<replay_source> source;
+        if (spec.compare(0, 4, "arf:") == 0) {
+                source.reset(new replay_source(session.sampling_rate));
+                return std::unique_ptr<data_writer>(
+                        new file::arf_writer(spec.substr(4), *source, {}, 0));
+        }
+#endif
+        throw std::invalid_argument("unsupported writer: " + spec);
+}
+
+int
+main(int argc, char ** argv)
+{
+        string trace_file, save_file, writer_spec, trigger;
+        nframes_t sampling_rate, period_size;
+        std::size_t nchannels, nperiods, buffer_size;
+        float pretrigger_ms, posttrigger_ms;
+        po::options_description opts("Options");
+        opts.add_options()
+                ("help,h", "print help message")
+                ("trace", po::value<string>(&trace_file), "replay a block trace")
+                ("save", po::value<string>(&save_file), "save the session as a block trace")
+                ("channels", po::value<std::size_t>(&nchannels)->default_value(16),
+                 "synthetic session: number of channels")
+                ("period", po::value<nframes_t>(&period_size)->default_value(32),
+                 "synthetic session: period size (frames)")
+                ("periods", po::value<std::size_t>(&nperiods)->default_value(20000),
+                 "synthetic session: number of periods")
+                ("rate", po::value<nframes_t>(&sampling_rate)->default_value(48000),
+                 "synthetic session: sampling rate")
+                ("trigger", po::value<string>(&trigger),
+                 "synthetic session: trigger pattern ON/OFF (periods)")
+                ("writer", po::value<string>(&writer_spec)->default_value("null:"),
+                 "sink: null:"
+#ifdef JILL_REPLAY_ARF
+                 " or arf:FILE"
+#endif
+                        )
+                ("triggered", "use a triggered writer (default if there's a trigger pattern)")
+                ("pretrigger", po::value<float>(&pretrigger_ms)->default_value(100),
+                 "pretrigger duration (ms)")
+                ("posttrigger", po::value<float>(&posttrigger_ms)->default_value(50),
+                 "posttrigger duration (ms)")
+                ("buffer", po::value<std::size_t>(&buffer_size)->default_value(1 << 26),
+                 "ringbuffer size (bytes)");
+        po::variables_map vmap;
+        po::store(po::parse_command_line(argc, argv, opts), vmap);
+        po::notify(vmap);
+        if (vmap.count("help")) {
+                std::cout << "Usage: " << argv[0] << " [options]\n" << opts << std::endl;
+                return 0;
+        }
+
+        session_t session;
+        std::size_t trigger_on = 0, trigger_off = 0;
+        if (!trace_file.empty()) {
+                load_trace(session, trace_file);
+                printf("trace: %s (%zu ops, %zu channels)\n", trace_file.c_str(), session.ops.size(),
+                       session.channels.size());
+        }
+        else {
+                if (!trigger.empty() && sscanf(trigger.c_str(), "%zu/%zu", &trigger_on, &trigger_off) != 2) {
+                        fprintf(stderr, "invalid trigger pattern: %s\n", trigger.c_str());
+                        return 1;
+                }
+                make_session(session, sampling_rate, nchannels, period_size, nperiods,
+                             trigger_on, trigger_off);
+                printf("synthetic: %zu channels, %u frames/period, %zu periods, trigger=%zu/%zu\n",
+                       nchannels, period_size, nperiods, trigger_on, trigger_off);
+        }
+        if (!save_file.empty()) {
+                save_session(session, save_file, period_size);
+                printf("saved session to %s\n", save_file.c_str());
+        }
+        bool triggered = vmap.count("triggered") || trigger_on > 0 ||
+                std::find(session.channels.begin(), session.channels.end(), "trig_in")
+                != session.channels.end();
+
+        timing_writer * writer = new timing_writer(make_writer(writer_spec, session), session);
+        std::unique_ptr<timing_writer> writer_ptr(writer);
+        std::unique_ptr<dsp::basic_buffered_data_writer<timing_writer> > thread;
+        if (triggered)
+                thread.reset(new dsp::basic_triggered_data_writer<timing_writer>(
+                                     std::move(writer_ptr), "trig_in",
+                                     pretrigger_ms * session.sampling_rate / 1000,
+                                     posttrigger_ms * session.sampling_rate / 1000));
+        else
+                thread.reset(new dsp::basic_buffered_data_writer<timing_writer>(std::move(writer_ptr)));
+        buffer_size = thread->request_buffer_size(buffer_size);
+
+        // record when each sampled block is pushed
+        std::vector<clock_type::time_point> pushed(session.ops.size());
+        std::size_t peak;
+        auto start = clock_type::now();
+        thread->start();
+        {
+                auto & t = *thread;
+                peak = 0;
+                for (std::size_t i = 0; i < session.ops.size(); ++i) {
+                        op_t const & op = session.ops[i];
+                        switch (op.op) {
+                        case file::TRACE_PUSH:
+                                pushed[i] = clock_type::now();
+                                t.push(op.time, op.dtype, session.channels[op.chan].c_str(), op.size,
+                                       session.data.data() + op.offset);
+                                peak = std::max(peak, t.buffer_occupancy());
+                                break;
+                        case file::TRACE_DATA_READY:
+                                t.data_ready();
+                                break;
+                        case file::TRACE_XRUN:
+                                t.xrun();
+                                break;
+                        case file::TRACE_RESET:
+                                t.reset();
+                                break;
+                        }
+                }
+        }
+        thread->stop();
+        thread->join();
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+        // match written blocks to push times
+        std::unordered_map<std::uint64_t, clock_type::time_point> push_times;
+        for (std::size_t i = 0; i < session.ops.size(); ++i) {
+                op_t const & op = session.ops[i];
+                if (op.op == file::TRACE_PUSH)
+                        push_times[(std::uint64_t(op.chan) << 32) | op.time] = pushed[i];
+        }
+        std::vector<double> latencies;
+        latencies.reserve(writer->writes.size());
+        for (auto const & w : writer->writes) {
+                auto it = push_times.find((std::uint64_t(w.chan) << 32) | w.time);
+                if (it == push_times.end()) continue;
+                latencies.push_back(std::chrono::duration<double, std::micro>(w.when - it->second).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        std::uint64_t dropped = 0;
+        for (auto const & id : session.channels)
+                dropped += thread->dropped_frames(id);
+
+        printf("writer: %s (%s)\n", writer_spec.c_str(), triggered ? "triggered" : "continuous");
+        printf("blocks: %zu pushed, %zu written, %lu frames dropped\n", session.nblocks,
+               writer->writes.size(), (unsigned long)dropped);
+        printf("elapsed: %.3f s\n", elapsed.count());
+        printf("throughput: %.0f blocks/s, %.1f MB/s\n", session.nblocks / elapsed.count(),
+               session.nbytes / elapsed.count() / (1 << 20));
+        if (!latencies.empty()) {
+                printf("latency (us): ");
+                for (double p : { 50.0, 90.0, 99.0, 99.9 })
+                        printf("p%g=%.1f ", p, latencies[std::size_t(p / 100 * (latencies.size() - 1))]);
+                printf("max=%.1f\n", latencies.back());
+        }
+        printf("peak ringbuffer occupancy: %zu bytes (%.1f%% of %zu)\n", peak,
+               100.0 * peak / buffer_size, buffer_size);
+        return 0;
+}
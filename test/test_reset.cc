@@ -0,0 +1,63 @@
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "jill/data_writer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+
+using namespace jill;
+
+/* records the first frame of each entry; stalls on the first write */
+class entry_writer : public data_writer {
+public:
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t frame) override {
+                entries.push_back(frame);
+                _open = true;
+        }
+        void close_entry() override { _open = false; }
+        void xrun() override { xruns += 1; }
+        void write(data_block_t const * data, nframes_t, nframes_t) override {
+                if (!_stalled) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                        _stalled = true;
+                }
+                if (!_open) new_entry(data->time);
+        }
+
+        std::vector<nframes_t> entries;
+        int xruns = 0;
+private:
+        bool _open = false;
+        bool _stalled = false;
+};
+
+int
+main(int, char **)
+{
+        const nframes_t nframes = 64;
+        std::vector<sample_t> samples(nframes, 0.0f);
+        char event[] = { 0, 0, 0 };
+        entry_writer * writer = new entry_writer;
+        dsp::basic_buffered_data_writer<entry_writer> thread((std::unique_ptr<entry_writer>(writer)),
+                                                             1 << 20);
+        thread.start();
+        // resets in consecutive periods, requested while the consumer is
+        // still busy with the first block, are latched to the first sampled
+        // block of those periods
+        for (nframes_t i = 0; i < 10; ++i) {
+                if (i == 3 || i == 4 || i == 8) thread.reset();
+                thread.push(i * nframes, EVENT, "trig", sizeof(event), event);
+                thread.push(i * nframes, SAMPLED, "pcm", nframes * sizeof(sample_t), samples.data());
+                thread.data_ready();
+        }
+        thread.stop();
+        thread.join();
+        for (auto e : writer->entries)
+                printf("entry: %u\n", e);
+        assert((writer->entries == std::vector<nframes_t>{ 0, 3 * nframes, 4 * nframes, 8 * nframes }));
+        assert(writer->xruns == 0);
+        printf("passed tests\n");
+}
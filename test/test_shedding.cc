@@ -0,0 +1,81 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jill/dsp/buffered_data_writer.hh"
+
+using namespace jill;
+
+/* tallies the frames written and the frames reported missing for each channel */
+class tally_writer : public data_writer {
+public:
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t) override { _open = true; }
+        void close_entry() override { _open = false; }
+        void xrun() override { xruns += 1; }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                if (!_open) new_entry(data->time);
+                stop = (stop > 0) ? std::min(stop, data->nframes()) : data->nframes();
+                frames[data->id()] += stop - start;
+        }
+        void gap(std::string const & id, nframes_t, nframes_t nframes, gap_cause_t cause) override {
+                if (cause == SHED)
+                        shed[id] += nframes;
+                else
+                        overrun[id] += nframes;
+        }
+
+        std::map<std::string, nframes_t> frames;
+        std::map<std::string, nframes_t> shed;
+        std::map<std::string, nframes_t> overrun;
+        int xruns = 0;
+private:
+        bool _open = false;
+};
+
+int
+main(int, char **)
+{
+        const nframes_t nframes = 64;
+        char const * ids[] = { "pcm_low", "pcm_mid", "pcm_high" };
+        std::vector<sample_t> samples(nframes, 0.5f);
+
+        tally_writer * writer = new tally_writer;
+        dsp::basic_buffered_data_writer<tally_writer> thread((std::unique_ptr<tally_writer>(writer)), 1 << 16);
+        thread.set_priority("pcm_low", 0);
+        thread.set_priority("pcm_mid", 5);
+        thread.set_shed_threshold(0.5);
+
+        // the writer thread isn't running, so the buffer fills up
+        const int nperiods = 200;
+        std::map<std::string, nframes_t> pushed;
+        for (int i = 0; i < nperiods; ++i) {
+                for (auto id : ids) {
+                        thread.push(i * nframes, SAMPLED, id, nframes * sizeof(sample_t), samples.data());
+                        pushed[id] += nframes;
+                }
+        }
+        thread.start();
+        thread.stop();
+        thread.join();
+
+        for (auto id : ids) {
+                printf("%s: pushed=%u, written=%u, shed=%u, overrun=%u\n", id, pushed[id],
+                       writer->frames[id], writer->shed[id], writer->overrun[id]);
+                // every frame is accounted for
+                assert(writer->frames[id] + writer->shed[id] + writer->overrun[id] == pushed[id]);
+                assert(thread.dropped_frames(id) == writer->shed[id] + writer->overrun[id]);
+        }
+        assert(writer->xruns == 0);
+        // low priority channels are shed first; highest priority is never shed
+        assert(writer->shed["pcm_low"] > writer->shed["pcm_mid"]);
+        assert(writer->shed["pcm_mid"] > 0);
+        assert(writer->shed["pcm_high"] == 0);
+        assert(writer->overrun["pcm_high"] > 0);
+        assert(writer->frames["pcm_high"] > writer->frames["pcm_mid"]);
+        assert(writer->frames["pcm_mid"] > writer->frames["pcm_low"]);
+        printf("passed tests\n");
+}
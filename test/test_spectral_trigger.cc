@@ -0,0 +1,156 @@
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "jill/dsp/real_fft.hh"
+#include "jill/dsp/spectral_trigger.hh"
+#include "jill/dsp/crossing_trigger.hh"
+
+using namespace jill;
+using std::vector;
+
+typedef std::pair<std::size_t, bool> event_t;  // frame, state
+
+/* the FFT matches a direct evaluation of the DFT */
+static void
+test_fft(std::size_t n)
+{
+        vector<float> x(n), power(n / 2 + 1);
+        vector<std::complex<float> > X(n / 2 + 1);
+        for (auto & v : x)
+                v = float(rand()) / RAND_MAX - 0.5f;
+        dsp::real_fft<float> fft(n);
+        assert(fft.size() == n && fft.nbins() == n / 2 + 1);
+        fft.transform(x.data(), X.data());
+        fft.power(x.data(), power.data());
+        double err = 0, scale = 0;
+        for (std::size_t k = 0; k <= n / 2; ++k) {
+                std::complex<double> ref = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                        ref += double(x[i]) * std::polar(1.0, -2 * M_PI * double(k * i % n) / n);
+                err = std::max(err, std::abs(ref - std::complex<double>(X[k])));
+                scale = std::max(scale, std::abs(ref));
+                assert(std::abs(power[k] - std::norm(X[k])) <= 1e-5 * (1 + std::norm(X[k])));
+        }
+        printf("fft size=%zu: max error %.2g\n", n, err / scale);
+        assert(err <= 1e-5 * scale);
+}
+
+/*
+ * Background noise, with loud bursts of low-frequency hum and of a tone in
+ * the detection band (0.1--0.2 of the sampling rate).
+ */
+static vector<float>
+make_signal(std::size_t n, std::size_t burst)
+{
+        vector<float> x(n);
+        for (std::size_t i = 0; i < n; ++i) {
+                x[i] = 0.3f * (float(rand()) / RAND_MAX - 0.5f);
+                switch ((i / burst) % 4) {
+                case 1:
+                        x[i] += 0.8f * std::sin(2 * M_PI * 0.01 * i);
+                        break;
+                case 3:
+                        x[i] += 0.5f * std::sin(2 * M_PI * 0.15 * i);
+                        break;
+                }
+        }
+        return x;
+}
+
+/* run a detector over the signal in random-sized blocks */
+template <typename Detector>
+static vector<event_t>
+run(Detector & detector, vector<float> const & x, std::size_t max_block, vector<float> * counts=0)
+{
+        vector<event_t> events;
+        for (std::size_t i = 0; i < x.size();) {
+                std::size_t len = std::min<std::size_t>(1 + rand() % max_block, x.size() - i);
+                int offset = detector.push(x.data() + i, len, counts ? counts->data() + i : 0);
+                if (offset >= 0) {
+                        assert(std::size_t(offset) < len);
+                        events.push_back(event_t(i + offset, detector.open()));
+                }
+                i += len;
+        }
+        return events;
+}
+
+/* the detector opens for in-band signals but ignores the hum */
+static void
+test_trigger(std::size_t period_size)
+{
+        std::size_t const burst = 20000, n = burst * 9;
+        vector<float> x = make_signal(n, burst);
+        auto make = [period_size]() {
+                return new dsp::spectral_trigger<float>(0.1, 0.2, 0.6, 4, 8, 0.4, 2, 8, period_size);
+        };
+        std::unique_ptr<dsp::spectral_trigger<float> > trigger(make());
+        vector<float> counts(n);
+        vector<event_t> events = run(*trigger, x, 1024, &counts);
+        printf("period=%zu, fft=%zu:", period_size, trigger->fft_size());
+        for (auto const & e : events)
+                printf(" %zu(%d)", e.first, e.second);
+        printf("\n");
+
+        // opens and closes once for each tone burst, at the end of a period
+        assert(events.size() == 4);
+        for (std::size_t j = 0; j < events.size(); ++j) {
+                std::size_t onset = (4 * (j / 2) + 3) * burst;
+                assert(events[j].second == (j % 2 == 0));
+                assert((events[j].first + 1) % period_size == 0);
+                std::size_t edge = (j % 2) ? onset + burst : onset;
+                assert(events[j].first >= edge && events[j].first < edge + 10 * period_size);
+                assert(counts[events[j].first] == 0);
+        }
+
+        // same result when the signal is pushed in small blocks
+        std::unique_ptr<dsp::spectral_trigger<float> > other(make());
+        assert(run(*other, x, 64) == events);
+
+        // a crossing detector is set off by the hum
+        dsp::crossing_trigger<float> crossings(0.2f, 4, 8, 0.2f, 2, 8, period_size);
+        vector<event_t> crossing_events = run(crossings, x, 1024);
+        assert(!crossing_events.empty() && crossing_events[0].first < 2 * burst);
+
+        trigger->reset();
+        assert(!trigger->open());
+}
+
+/* throughput with typical jdetect settings (20 ms periods at 44.1 kHz) */
+static void
+benchmark(std::size_t block_size)
+{
+        using namespace boost::posix_time;
+        std::size_t const period_size = 882;
+        vector<float> x = make_signal(block_size, 100);
+        dsp::spectral_trigger<float> trigger(1500. / 44100, 8000. / 44100, 0.5, 12, 25,
+                                             0.3, 25, 250, period_size);
+        std::size_t nblocks = (1 << 24) / block_size;
+        int ret = 0;
+        ptime t0 = microsec_clock::universal_time();
+        for (std::size_t i = 0; i < nblocks; ++i)
+                ret += trigger.push(x.data(), x.size()) >= 0;
+        double secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+        printf("block=%zu: %.1f Msamples/s (%d)\n", block_size, nblocks * block_size / secs * 1e-6, ret);
+}
+
+int
+main(int, char **)
+{
+        for (std::size_t n = 2; n <= 4096; n *= 2)
+                test_fft(n);
+
+        test_trigger(256);
+        test_trigger(441);
+
+        benchmark(1024);
+        benchmark(64);
+        printf("passed tests\n");
+}
@@ -0,0 +1,42 @@
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <sched.h>
+
+#include "jill/util/thread_config.hh"
+
+using namespace jill::util;
+
+int
+main(int, char **)
+{
+        std::vector<int> cpus = parse_cpu_list("0,2-4");
+        assert(cpus.size() == 4);
+        assert(cpus[0] == 0 && cpus[1] == 2 && cpus[3] == 4);
+        for (char const * bad : { "a", "1-", "3-1", "-1", "1,x" }) {
+                try {
+                        parse_cpu_list(bad);
+                        assert(false);
+                }
+                catch (std::invalid_argument const &) {}
+        }
+        assert(parse_sched_policy("fifo") == SCHED_FIFO);
+        assert(parse_sched_policy("other") == SCHED_OTHER);
+
+        thread_config config;
+        assert(config.empty());
+        assert(config.str() == "default");
+        config.cpus.push_back(0);
+        config.policy = SCHED_OTHER;
+        config.nice = 5;
+        printf("config: %s\n", config.str().c_str());
+        set_thread_config(config);
+
+        // the settings apply only to threads that ask for them
+        int cpu = -1;
+        std::thread t([&cpu]{ configure_thread("test"); cpu = sched_getcpu(); });
+        t.join();
+        assert(cpu == 0);
+        printf("passed tests\n");
+}
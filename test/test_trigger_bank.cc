@@ -0,0 +1,367 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "jill/dsp/crossing_trigger_bank.hh"
+#include "jill/dsp/crossing_trigger.hh"
+
+using namespace jill;
+using std::vector;
+
+typedef dsp::crossing_trigger_bank<float> bank_type;
+typedef std::pair<std::size_t, bool> event_t;  // frame, state
+
+/*
+ * Sample-by-sample implementation of one gate, for comparison. Gates open at
+ * the crossing that puts the count over the threshold, and close at the end
+ * of the period.
+ */
+static vector<event_t>
+reference(vector<float> const & x, bank_type::params_type const & p, std::size_t period_size)
+{
+        vector<event_t> events;
+        vector<int> counts;
+        vector<std::size_t> crossings;  // in the current period
+        bool open = false;
+        for (std::size_t i = 0; i < x.size(); ++i) {
+                float thresh = open ? p.close_thresh : p.open_thresh;
+                if (i > 0 && x[i-1] < thresh && x[i] >= thresh)
+                        crossings.push_back(i);
+                if ((i + 1) % period_size) continue;
+                int period = crossings.size();
+                counts.push_back(period);
+                std::size_t window = open ? p.close_periods : p.open_periods;
+                if (counts.size() >= window) {
+                        int sum = 0;
+                        for (std::size_t j = counts.size() - window; j < counts.size(); ++j)
+                                sum += counts[j];
+                        if (!open && sum > p.open_count) {
+                                int k = p.open_count - (sum - period);
+                                events.push_back(event_t((k < 0) ? i + 1 - period_size : crossings[k], true));
+                                open = true;
+                                counts.clear();
+                        }
+                        else if (open && sum < p.close_count) {
+                                events.push_back(event_t(i, false));
+                                open = false;
+                                counts.clear();
+                        }
+                }
+                crossings.clear();
+        }
+        return events;
+}
+
+/* a signal with bursts of activity */
+static vector<float>
+make_signal(std::size_t n, std::size_t burst)
+{
+        vector<float> x(n);
+        for (std::size_t i = 0; i < n; ++i) {
+                float amp = ((i / burst) % 3 == 1) ? 0.5f : 0.02f;
+                x[i] = amp * std::sin(0.3f * i) + 0.01f * (float(rand()) / RAND_MAX - 0.5f);
+        }
+        return x;
+}
+
+/* each gate in the bank matches the reference, regardless of blocking */
+static void
+test_bank(std::size_t nchannels, std::size_t period_size, std::size_t max_block)
+{
+        std::size_t const n = 100000;
+        vector<vector<float> > signals;
+        vector<bank_type::params_type> params;
+        for (std::size_t k = 0; k < nchannels; ++k) {
+                signals.push_back(make_signal(n, 3000 + 1000 * k));
+                // alternate between two sets of windows
+                std::size_t ow = (k % 2) ? 4 : 8, cw = (k % 2) ? 10 : 6;
+                params.push_back({ 0.1f + 0.02f * k, int(ow * period_size / 30), ow,
+                                   0.05f, int(cw * period_size / 100), cw });
+        }
+        bank_type bank(params, period_size);
+        vector<vector<event_t> > events(nchannels);
+        vector<vector<std::size_t> > blocks(nchannels);  // start of the block for each event
+        vector<vector<float> > counts(nchannels, vector<float>(n));
+        vector<float const *> inputs(nchannels);
+        vector<float *> outputs(nchannels);
+        std::size_t last = 0;
+        for (std::size_t i = 0; i < n;) {
+                std::size_t len = std::min<std::size_t>(1 + rand() % max_block, n - i);
+                for (std::size_t k = 0; k < nchannels; ++k) {
+                        inputs[k] = signals[k].data() + i;
+                        outputs[k] = counts[k].data() + i;
+                }
+                bank.push(inputs.data(), len, [&](std::size_t k, std::size_t offset, bool open) {
+                                assert(offset < len);
+                                assert(bank.open(k) == open);
+                                assert(i + offset >= last);
+                                last = i + offset;
+                                events[k].push_back(event_t(i + offset, open));
+                                blocks[k].push_back(i);
+                        }, outputs.data());
+                i += len;
+        }
+        std::size_t total = 0;
+        for (std::size_t k = 0; k < nchannels; ++k) {
+                vector<event_t> ref = reference(signals[k], params[k], period_size);
+                assert(events[k].size() == ref.size());
+                for (std::size_t j = 0; j < ref.size(); ++j) {
+                        // onsets in an earlier block are reported at the start of the block
+                        assert(events[k][j].second == ref[j].second);
+                        assert(events[k][j].first == std::max(ref[j].first, blocks[k][j]));
+                        // the count output reflects the state at the end of each period
+                        std::size_t end = (ref[j].first / period_size + 1) * period_size - 1;
+                        assert(counts[k][end] == 0);
+                }
+                total += ref.size();
+        }
+        printf("channels=%zu, period=%zu, block<=%zu: %zu events\n", nchannels, period_size,
+               max_block, total);
+        assert(total > 0);
+}
+
+/*
+ * A grid of parameter sets applied to the same input. The gates with the same
+ * threshold share crossing counts, and each must still match the reference.
+ */
+static void
+test_grid(std::size_t period_size, std::size_t max_block)
+{
+        std::size_t const n = 100000;
+        vector<float> x = make_signal(n, 2500);
+        vector<bank_type::params_type> params;
+        for (float othresh : { 0.05f, 0.1f, 0.2f })
+                for (std::size_t ow : { 4, 8 })
+                        for (int ocount : { 1, 3, 6 })
+                                params.push_back({ othresh, int(ocount * ow * period_size / 100), ow,
+                                                   0.05f, int(period_size / 30), 6 });
+        bank_type bank(params, period_size);
+        vector<vector<event_t> > events(params.size());
+        vector<vector<std::size_t> > blocks(params.size());
+        vector<float const *> inputs(params.size());
+        for (std::size_t i = 0; i < n;) {
+                std::size_t len = std::min<std::size_t>(1 + rand() % max_block, n - i);
+                std::fill(inputs.begin(), inputs.end(), x.data() + i);
+                bank.push(inputs.data(), len, [&](std::size_t k, std::size_t offset, bool open) {
+                                events[k].push_back(event_t(i + offset, open));
+                                blocks[k].push_back(i);
+                        });
+                i += len;
+        }
+        std::size_t total = 0;
+        for (std::size_t k = 0; k < params.size(); ++k) {
+                vector<event_t> ref = reference(x, params[k], period_size);
+                assert(events[k].size() == ref.size());
+                for (std::size_t j = 0; j < ref.size(); ++j) {
+                        assert(events[k][j].second == ref[j].second);
+                        assert(events[k][j].first == std::max(ref[j].first, blocks[k][j]));
+                }
+                total += ref.size();
+        }
+        printf("grid of %zu, period=%zu, block<=%zu: %zu events\n", params.size(), period_size,
+               max_block, total);
+        assert(total > 0);
+}
+
+/*
+ * Staged parameters take effect at the next period boundary. Changing only the
+ * count thresholds doesn't disturb the gate; changing a sample threshold
+ * clears its count.
+ */
+static void
+test_stage()
+{
+        std::size_t const period_size = 100, n = 60000;
+        vector<float> x = make_signal(n, 5000);
+        bank_type::params_type p = { 0.1f, 10, 4, 0.05f, 5, 6 };
+        bank_type bank(vector<bank_type::params_type>(1, p), period_size, 20);
+        bank_type ref(vector<bank_type::params_type>(1, p), period_size);
+        assert(bank.max_periods() == 20 && ref.max_periods() == 6);
+        vector<event_t> events, ref_events;
+        auto run = [&](bank_type & b, vector<event_t> & ev, std::size_t i, std::size_t len) {
+                float const * in = x.data() + i;
+                b.push(&in, len, [&](std::size_t, std::size_t offset, bool open) {
+                                ev.push_back(event_t(i + offset, open));
+                        });
+        };
+        // staging the same parameters has no effect
+        run(bank, events, 0, 1050);
+        run(ref, ref_events, 0, 1050);
+        bank.stage(&p);
+        assert(bank.staged());
+        run(bank, events, 1050, 30);
+        assert(bank.staged());
+        run(bank, events, 1080, 30);
+        assert(!bank.staged());
+        run(ref, ref_events, 1050, 60);
+        run(bank, events, 1110, 20000 - 1110);
+        run(ref, ref_events, 1110, 20000 - 1110);
+        assert(events == ref_events && !events.empty());
+
+        // a new sample threshold and window apply at the period boundary
+        bank_type::params_type q = { 0.2f, 10, 50, 0.1f, 5, 8 };
+        run(bank, events, 20000, 30);
+        bank.stage(&q);
+        run(bank, events, 20030, 50);
+        assert(bank.staged());
+        assert(bank.thresh(0) == (bank.open(0) ? p.close_thresh : p.open_thresh));
+        run(bank, events, 20080, 50);
+        assert(!bank.staged());
+        assert(bank.thresh(0) == (bank.open(0) ? q.close_thresh : q.open_thresh));
+        assert(bank.count(0) == 0);
+        assert(bank.params(0).open_periods == 20 && bank.params(0).close_periods == 8);
+        std::size_t before = events.size();
+        run(bank, events, 20130, n - 20130);
+        assert(events.size() > before);
+        printf("staged parameters: %zu events\n", events.size());
+}
+
+/*
+ * With adaptive thresholds, the gates follow a step in the background noise.
+ * Tone bursts at a fixed signal-to-noise ratio are detected before and after
+ * the step; a gate with fixed thresholds stays open in the louder noise.
+ */
+static void
+test_adaptive()
+{
+        std::size_t const n = 1000000, period_size = 256, step = 300000, settle = 450000;
+        std::size_t const interval = 50000, burst = 5000;
+        vector<float> x(n);
+        for (std::size_t i = 0; i < n; ++i) {
+                float sd = (i < step) ? 0.003f : 0.03f;
+                // uniform noise peaks at 1.7 SD, so it doesn't cross 2 SD
+                x[i] = sd * 3.46f * (float(rand()) / RAND_MAX - 0.5f);
+                if (i % interval >= interval / 2 && i % interval < interval / 2 + burst)
+                        x[i] += 10 * sd * std::sin(0.3f * i);
+        }
+        // the tone crosses about 12 times per period
+        bank_type::params_type adaptive = { 3.0f, 20, 4, 2.0f, 10, 8 };
+        bank_type::params_type fixed = { 0.009f, 20, 4, 0.006f, 10, 8 };
+        bank_type bank({ adaptive }, period_size);
+        bank.set_adaptive(500);
+        assert(bank.adaptive());
+        bank_type fixed_bank({ fixed }, period_size);
+        assert(!fixed_bank.adaptive() && fixed_bank.floor(0) == 1);
+        vector<vector<event_t> > events(2);
+        vector<float> floors(n);
+        for (std::size_t i = 0; i < n; i += 1024) {
+                std::size_t len = std::min<std::size_t>(1024, n - i);
+                float const * in[] = { x.data() + i };
+                float * out[] = { floors.data() + i };
+                bank.push(in, len, [&](std::size_t, std::size_t offset, bool open) {
+                                events[0].push_back(event_t(i + offset, open));
+                        }, nullptr, out);
+                fixed_bank.push(in, len, [&](std::size_t, std::size_t offset, bool open) {
+                                events[1].push_back(event_t(i + offset, open));
+                        });
+        }
+        // every burst outside the transition is detected, and nothing else
+        std::size_t nbursts = 0;
+        for (std::size_t b = interval / 2; b < n; b += interval) {
+                if (b >= step && b < settle) continue;
+                nbursts += 1;
+                int opened = 0, closed = 0;
+                for (auto const & e : events[0]) {
+                        if (e.first >= b && e.first < b + burst && e.second) opened += 1;
+                        if (e.first >= b + burst && e.first < b + interval / 2 && !e.second) closed += 1;
+                }
+                assert(opened == 1 && closed == 1);
+        }
+        std::size_t nevents = 0;
+        for (auto const & e : events[0])
+                nevents += (e.first < step || e.first >= settle);
+        printf("adaptive: %zu events for %zu bursts, floor %.4f -> %.4f\n", nevents, nbursts,
+               floors[step - 1], floors[n - 1]);
+        assert(nevents == 2 * nbursts);
+        assert(floors[step - 1] > 0.002f && floors[step - 1] < 0.004f);
+        assert(floors[n - 1] > 0.02f && floors[n - 1] < 0.04f);
+        assert(bank.thresh(0) == bank.floor(0) * (bank.open(0) ? 2.0f : 3.0f));
+
+        // the fixed gate opens in the noise after the step and doesn't close
+        assert(!events[1].empty() && events[1].back().second);
+        assert(events[1].back().first >= step && events[1].back().first < step + interval);
+}
+
+/* throughput for many channels, in one bank or in separate detectors */
+static void
+benchmark(std::size_t nchannels, std::size_t nframes)
+{
+        using namespace boost::posix_time;
+        std::size_t const period_size = 441;
+        vector<vector<float> > signals;
+        vector<float const *> inputs;
+        for (std::size_t k = 0; k < nchannels; ++k) {
+                signals.push_back(make_signal(nframes, 1000));
+                inputs.push_back(signals.back().data());
+        }
+        std::size_t nblocks = (1 << 24) / (nframes * nchannels);
+        int nevents = 0;
+
+        bank_type bank(vector<bank_type::params_type>(nchannels, { 0.1f, 100, 25, 0.1f, 10, 100 }),
+                       period_size);
+        ptime t0 = microsec_clock::universal_time();
+        for (std::size_t i = 0; i < nblocks; ++i)
+                bank.push(inputs.data(), nframes, [&](std::size_t, std::size_t, bool) { ++nevents; });
+        double secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+        printf("bank of %zu, block=%zu: %.1f Msamples/s\n", nchannels, nframes,
+               nblocks * nframes * nchannels / secs * 1e-6);
+
+        vector<std::unique_ptr<dsp::crossing_trigger<float> > > triggers;
+        for (std::size_t k = 0; k < nchannels; ++k)
+                triggers.emplace_back(new dsp::crossing_trigger<float>(0.1f, 100, 25, 0.1f, 10, 100,
+                                                                       period_size));
+        t0 = microsec_clock::universal_time();
+        for (std::size_t i = 0; i < nblocks; ++i)
+                for (std::size_t k = 0; k < nchannels; ++k)
+                        nevents += triggers[k]->push(inputs[k], nframes) >= 0;
+        secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+        printf("%zu crossing_triggers, block=%zu: %.1f Msamples/s (%d)\n", nchannels, nframes,
+               nblocks * nframes * nchannels / secs * 1e-6, nevents);
+}
+
+/* throughput for a grid of parameter sets on one input (samples of input per second) */
+static void
+benchmark_grid(std::size_t nthresh, std::size_t nsets, std::size_t nframes)
+{
+        using namespace boost::posix_time;
+        std::size_t const period_size = 441;
+        vector<float> x = make_signal(nframes, 1000);
+        vector<bank_type::params_type> params;
+        for (std::size_t t = 0; t < nthresh; ++t)
+                for (std::size_t s = 0; s < nsets / nthresh; ++s)
+                        params.push_back({ 0.05f + 0.05f * t, int(10 + 10 * s), 25, 0.05f, 10, 100 });
+        vector<float const *> inputs(params.size(), x.data());
+        bank_type bank(params, period_size);
+        std::size_t nblocks = (1 << 24) / nframes;
+        int nevents = 0;
+        ptime t0 = microsec_clock::universal_time();
+        for (std::size_t i = 0; i < nblocks; ++i)
+                bank.push(inputs.data(), nframes, [&](std::size_t, std::size_t, bool) { ++nevents; });
+        double secs = (microsec_clock::universal_time() - t0).total_microseconds() * 1e-6;
+        printf("grid of %zu (%zu thresholds), block=%zu: %.1f Msamples/s (%d)\n", params.size(),
+               nthresh, nframes, nblocks * nframes / secs * 1e-6, nevents);
+}
+
+int
+main(int, char **)
+{
+        test_bank(1, 441, 1024);
+        test_bank(16, 441, 1024);
+        test_bank(5, 64, 64);
+        test_bank(3, 10, 7);
+        test_grid(441, 1024);
+        test_grid(64, 37);
+        test_stage();
+        test_adaptive();
+
+        benchmark(16, 1024);
+        benchmark(16, 64);
+        benchmark_grid(4, 64, 1024);
+        benchmark_grid(64, 64, 1024);
+        printf("passed tests\n");
+}
@@ -0,0 +1,120 @@
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jill/dsp/triggered_data_writer.hh"
+#include "jill/midi.hh"
+
+using namespace jill;
+
+/* records the entries and the frames written to them */
+class entry_writer : public data_writer {
+public:
+        struct entry_t {
+                nframes_t start;
+                std::map<std::string, std::vector<nframes_t> > frames;
+        };
+
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t frame) override {
+                close_entry();
+                entries.push_back({frame, {}});
+                _open = true;
+        }
+        void close_entry() override { _open = false; }
+        void xrun() override { xruns += 1; }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                assert(_open);
+                stop = (stop > 0) ? std::min(stop, data->nframes()) : data->nframes();
+                for (nframes_t i = start; i < stop; ++i)
+                        entries.back().frames[data->id()].push_back(data->time + i);
+        }
+
+        std::vector<entry_t> entries;
+        int xruns = 0;
+private:
+        bool _open = false;
+};
+
+/* check that an entry holds every frame of a channel from onset to offset */
+static void
+check_entry(entry_writer::entry_t const & entry, std::string const & id,
+            nframes_t onset, nframes_t offset)
+{
+        std::vector<nframes_t> const & frames = entry.frames.at(id);
+        printf("%s: entry=%u, frames=%u--%u\n", id.c_str(), entry.start, frames.front(),
+               frames.back() + 1);
+        assert(entry.start == onset);
+        assert(frames.size() == offset - onset);
+        for (std::size_t i = 0; i < frames.size(); ++i)
+                assert(frames[i] == onset + i);
+}
+
+int
+main(int, char **)
+{
+        const nframes_t nframes = 64;
+        const nframes_t pretrigger = 200;
+        const nframes_t posttrigger = 100;
+        std::vector<sample_t> samples(nframes, 0.0f);
+        midi::data_type onset[] = { midi::note_on, midi::default_pitch, midi::default_velocity };
+        midi::data_type offset[] = { midi::note_off, midi::default_pitch, midi::default_velocity };
+
+        entry_writer * writer_a = new entry_writer;
+        entry_writer * writer_b = new entry_writer;
+        entry_writer * writer_c = new entry_writer;
+        dsp::basic_triggered_data_writer<entry_writer> thread((std::unique_ptr<entry_writer>(writer_a)),
+                                                              "trig_a", pretrigger, posttrigger);
+        thread.add_trigger_group(std::unique_ptr<entry_writer>(writer_b), "trig_b",
+                                 { "pcm_b1", "pcm_b2" }, pretrigger * 2, posttrigger * 2);
+        // a short posttrigger, with the trigger events pushed after the samples
+        thread.add_trigger_group(std::unique_ptr<entry_writer>(writer_c), "trig_c",
+                                 { "pcm_c" }, pretrigger / 2, 10);
+        thread.request_buffer_size(1 << 20);
+
+        // the groups are triggered at different times and overlap
+        for (nframes_t i = 0; i < 100; ++i) {
+                nframes_t time = i * nframes;
+                if (i == 10) thread.push(time + 5, EVENT, "trig_a", sizeof(onset), onset);
+                if (i == 20) thread.push(time + 5, EVENT, "trig_a", sizeof(offset), offset);
+                if (i == 15) thread.push(time + 9, EVENT, "trig_b", sizeof(onset), onset);
+                if (i == 40) thread.push(time + 9, EVENT, "trig_b", sizeof(offset), offset);
+                if (i == 60) thread.push(time, EVENT, "trig_a", sizeof(onset), onset);
+                if (i == 62) thread.push(time, EVENT, "trig_a", sizeof(offset), offset);
+                for (char const * id : { "pcm_a", "pcm_b1", "pcm_b2", "pcm_c" })
+                        thread.push(time, SAMPLED, id, nframes * sizeof(sample_t), samples.data());
+                if (i == 65 || i == 73) thread.push(time + 40, EVENT, "trig_c", sizeof(onset), onset);
+                if (i == 72 || i == 80) thread.push(time + 40, EVENT, "trig_c", sizeof(offset), offset);
+        }
+        thread.start();
+        thread.xrun();
+        thread.stop();
+        thread.join();
+
+        // each group only records its own channels, in its own entries
+        assert(writer_a->entries.size() == 2);
+        assert(writer_b->entries.size() == 1);
+        check_entry(writer_a->entries[0], "pcm_a", 10 * nframes + 5 - pretrigger,
+                    20 * nframes + 5 + posttrigger);
+        check_entry(writer_a->entries[1], "pcm_a", 60 * nframes - pretrigger,
+                    62 * nframes + posttrigger);
+        for (auto const & entry : writer_a->entries) {
+                assert(entry.frames.size() == 2);  // pcm_a and trig_a
+                assert(entry.frames.at("trig_a").size() == 2);
+        }
+        check_entry(writer_b->entries[0], "pcm_b1", 15 * nframes + 9 - 2 * pretrigger,
+                    40 * nframes + 9 + 2 * posttrigger);
+        check_entry(writer_b->entries[0], "pcm_b2", 15 * nframes + 9 - 2 * pretrigger,
+                    40 * nframes + 9 + 2 * posttrigger);
+        assert(writer_b->entries[0].frames.count("pcm_a") == 0);
+        // the prebuffer of the second entry starts where the first entry's
+        // data (written through the end of the offset's period) stopped
+        assert(writer_c->entries.size() == 2);
+        check_entry(writer_c->entries[0], "pcm_c", 65 * nframes + 40 - pretrigger / 2, 73 * nframes);
+        check_entry(writer_c->entries[1], "pcm_c", 73 * nframes, 81 * nframes);
+        // xruns go to every group
+        assert(writer_a->xruns == 1 && writer_b->xruns == 1 && writer_c->xruns == 1);
+        printf("passed tests\n");
+}
@@ -0,0 +1,168 @@
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "jill/dsp/triggered_data_writer.hh"
+#include "jill/midi.hh"
+
+using namespace jill;
+
+typedef std::pair<nframes_t, nframes_t> interval_t;
+
+/* records the frames, gaps, and segments written to each entry */
+class segment_writer : public data_writer {
+public:
+        struct entry_t {
+                nframes_t start;
+                std::vector<nframes_t> frames;          // pcm
+                std::vector<interval_t> gaps;           // pcm
+                std::vector<interval_t> segments;
+                int events = 0;
+        };
+
+        bool ready() const override { return _open; }
+        void new_entry(nframes_t frame) override {
+                close_entry();
+                entries.push_back({frame, {}, {}, {}});
+                _open = true;
+        }
+        void close_entry() override { _open = false; }
+        void xrun() override {}
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) override {
+                assert(_open);
+                if (data->dtype == EVENT) {
+                        entries.back().events += 1;
+                        return;
+                }
+                stop = (stop > 0) ? std::min(stop, data->nframes()) : data->nframes();
+                for (nframes_t i = start; i < stop; ++i)
+                        entries.back().frames.push_back(data->time + i);
+        }
+        void gap(std::string const & id, nframes_t frame, nframes_t nframes, gap_cause_t cause) override {
+                assert(_open && id == "pcm" && cause == INACTIVE);
+                entries.back().gaps.push_back(interval_t(frame, frame + nframes));
+        }
+        void segment(nframes_t onset, nframes_t offset) override {
+                assert(_open);
+                entries.back().segments.push_back(interval_t(onset, offset));
+        }
+
+        std::vector<entry_t> entries;
+private:
+        bool _open = false;
+};
+
+const nframes_t nframes = 64;
+const nframes_t pretrigger = 200;
+const nframes_t posttrigger = 100;
+
+/* trigger onset and offset periods */
+const std::vector<interval_t> triggers = { {10, 12}, {20, 22}, {60, 62} };
+
+/*
+ * Run the writer over 100 periods. If events is true, an event on another port
+ * is pushed after the samples in each period, in the middle of the period.
+ */
+static std::vector<segment_writer::entry_t>
+run(nframes_t holdoff, bool pack, std::vector<interval_t> const & triggers = ::triggers,
+    bool events = false)
+{
+        std::vector<sample_t> samples(nframes, 0.0f);
+        midi::data_type onset[] = { midi::note_on, midi::default_pitch, midi::default_velocity };
+        midi::data_type offset[] = { midi::note_off, midi::default_pitch, midi::default_velocity };
+
+        segment_writer * writer = new segment_writer;
+        dsp::basic_triggered_data_writer<segment_writer> thread((std::unique_ptr<segment_writer>(writer)),
+                                                                "trig", pretrigger, posttrigger);
+        thread.set_merge_holdoff(holdoff);
+        thread.set_pack_segments(pack);
+        thread.request_buffer_size(1 << 20);
+        for (nframes_t i = 0; i < 100; ++i) {
+                for (auto const & t : triggers) {
+                        if (i == t.first) thread.push(i * nframes, EVENT, "trig", sizeof(onset), onset);
+                        if (i == t.second) thread.push(i * nframes, EVENT, "trig", sizeof(offset), offset);
+                }
+                thread.push(i * nframes, SAMPLED, "pcm", nframes * sizeof(sample_t), samples.data());
+                if (events)
+                        thread.push(i * nframes + nframes / 2, EVENT, "events", sizeof(onset), onset);
+        }
+        thread.start();
+        thread.stop();
+        thread.join();
+        std::vector<segment_writer::entry_t> ret(writer->entries);
+        for (auto const & entry : ret) {
+                printf("entry %u:", entry.start);
+                for (auto const & seg : entry.segments)
+                        printf(" [%u, %u)", seg.first, seg.second);
+                printf("\n");
+        }
+        return ret;
+}
+
+/* check that an entry holds the segments, and that the segment index is the
+ * only record of the frames skipped between them */
+static void
+check_entry(segment_writer::entry_t const & entry, std::vector<interval_t> const & segments)
+{
+        assert(entry.start == segments.front().first);
+        assert(entry.segments == segments);
+        std::vector<nframes_t> frames;
+        for (auto const & seg : segments)
+                for (nframes_t t = seg.first; t < seg.second; ++t)
+                        frames.push_back(t);
+        assert(entry.frames == frames);
+        assert(entry.gaps.empty());
+}
+
+/* the segment recorded for a trigger, without merging */
+static interval_t
+segment(std::size_t i)
+{
+        return interval_t(triggers[i].first * nframes - pretrigger,
+                          triggers[i].second * nframes + posttrigger);
+}
+
+int
+main(int, char **)
+{
+        // without a hold-off, every onset starts an entry with one segment
+        auto entries = run(0, false);
+        assert(entries.size() == 3);
+        for (std::size_t i = 0; i < 3; ++i)
+                check_entry(entries[i], { segment(i) });
+
+        // onsets within the hold-off extend the entry
+        entries = run(10 * nframes, false);
+        assert(entries.size() == 2);
+        check_entry(entries[0], { segment(0), segment(1) });
+        check_entry(entries[1], { segment(2) });
+
+        // an onset during the posttrigger period continues the same segment
+        std::vector<interval_t> close = { {10, 12}, {13, 15} };
+        entries = run(0, false, close);
+        assert(entries.size() == 2);
+        entries = run(nframes, false, close);
+        assert(entries.size() == 1);
+        check_entry(entries[0], { interval_t(segment(0).first, 15 * nframes + posttrigger) });
+
+        // events that end before the samples of the same period don't
+        // cause the prebuffer to repeat frames already in the entry
+        entries = run(nframes, false, close, true);
+        assert(entries.size() == 1);
+        check_entry(entries[0], { interval_t(segment(0).first, 15 * nframes + posttrigger) });
+        std::vector<interval_t> spaced = { {10, 12}, {18, 20} };
+        entries = run(8 * nframes, false, spaced, true);
+        assert(entries.size() == 1);
+        check_entry(entries[0], { interval_t(segment(0).first, 12 * nframes + posttrigger),
+                                  interval_t(18 * nframes - pretrigger, 20 * nframes + posttrigger) });
+
+        // packing puts everything in one entry
+        entries = run(0, true);
+        assert(entries.size() == 1);
+        check_entry(entries[0], { segment(0), segment(1), segment(2) });
+        assert(entries[0].events == 6);
+        printf("passed tests\n");
+}
@@ -0,0 +1,65 @@
+/*
+ * Measures the per-block overhead of the buffered writer thread, comparing the
+ * polymorphic buffered_data_writer with basic_buffered_data_writer bound to a
+ * concrete sink. Both use a quiet null_writer so that only the cost of moving
+ * blocks through the ringbuffer and calling the sink is measured.
+ *
+ * usage: test_writer_overhead [nblocks] [period_size] [nchannels]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include "jill/file/null_writer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+
+using namespace jill;
+
+template <typename Thread, typename Writer>
+double
+run(std::size_t nblocks, nframes_t period_size, std::size_t nchannels)
+{
+        std::vector<sample_t> samples(period_size, 0.5f);
+        std::size_t block_bytes = sizeof(data_block_t) + 8 + period_size * sizeof(sample_t);
+        Thread thread(std::unique_ptr<Writer>(new file::null_writer(false)),
+                      block_bytes * nblocks * 2);
+
+        // fill the buffer before starting the thread so that only the consumer
+        // side is timed
+        nframes_t time = 0;
+        char id[16];
+        for (std::size_t i = 0; i < nblocks; i += nchannels) {
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        snprintf(id, sizeof(id), "pcm_%03zu", c);
+                        thread.push(time, SAMPLED, id, period_size * sizeof(sample_t), samples.data());
+                }
+                time += period_size;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        thread.start();
+        thread.stop();
+        thread.join();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / nblocks;
+}
+
+int
+main(int argc, char ** argv)
+{
+        std::size_t nblocks = (argc > 1) ? atol(argv[1]) : 200000;
+        nframes_t period_size = (argc > 2) ? atol(argv[2]) : 32;
+        std::size_t nchannels = (argc > 3) ? atol(argv[3]) : 16;
+
+        printf("blocks=%zu, period=%u, channels=%zu\n", nblocks, period_size, nchannels);
+        // warm up
+        run<dsp::buffered_data_writer, data_writer>(nblocks, period_size, nchannels);
+
+        double poly = run<dsp::buffered_data_writer, data_writer>(nblocks, period_size, nchannels);
+        double bound = run<dsp::basic_buffered_data_writer<file::null_writer>, file::null_writer>
+                (nblocks, period_size, nchannels);
+        printf("buffered_data_writer:                          %8.1f ns/block\n", poly);
+        printf("basic_buffered_data_writer<null_writer>:       %8.1f ns/block\n", bound);
+        return 0;
+}